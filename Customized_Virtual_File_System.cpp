@@ -1,161 +1,55 @@
 #include <stdio.h>
-#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/stat.h>
- 
-// read, write, append
-#define READ 1
-#define WRITE 2
-#define APPEND 4
-#define END_OF_FILE -4
- 
-// inode
-#define REGULAR 1
-#define MAX_INODES 50
-#define FILE_SIZE 1024
-
-// lseek
-#define SEEK_SET 0
-#define SEEK_CUR 1
-#define SEEK_END 2
-
-struct inode
-{
-    char file_name[50];
-    int inode_number;
-    int file_size;            // block size
-    int file_actual_size;     // to determine actual size of file
-    int file_type;            // remains 1 throughout the execution (only supports regular file)
-    char *file_data;          // pointer to the data of file
-    int link_count;           // remains 1 throughout the exexution (no hardlinks)
-    int reference_count;      // remains 1 throughout the execution
-    int permission;           // read, write and read + write
-    struct inode *next_inode; // pointer to the next inode
-};
+#include <signal.h>
 
-struct filetable
-{
-    int read_offset;         // from where to read
-    int write_offset;        // from where to write
-    int reference_count;     // remains 1 throughout the program because only one process will point to file table (no child process or dup)
-    int mode;                // in which mode file is opened
-    struct inode *ptr_inode; // pointer to an inode
-};
+#include "cvfs.h"
 
-struct ufdt
-{
-    struct filetable *ptr_filetable; // pointer to the filetable
-};
+#define END_OF_FILE -4
+#define MAX_LINE 4096           // longest command line
+#define MAX_TOKENS 10           // most tokens of a command (including its name)
+#define COMMAND_TABLE_SIZE 64   // slots of command hash table (power of 2)
 
-struct superblock
+struct command
 {
-    int total_inodes; // total number of inodes
-    int free_inodes;  // to indicate free inodes
+    const char *name;
+    int min_tokens;   // tokens including command name
+    int max_tokens;
+    int rest_of_line; // 1 if last token is the rest of the line (data of 'write')
+    void (*run)(int argc, char *argv[]);
 };
 
-struct superblock super_block;      // global object for managing total inodes and free inodes
-struct ufdt ufdt_array[MAX_INODES]; // UFDT array
-struct inode *inode_head = NULL;    // linked list of inodes
-
-void initialize_superblock()
-{
-    int counter;
-
-    for (counter = 0; counter < MAX_INODES; counter++)
-        ufdt_array[counter].ptr_filetable = NULL;
-
-    super_block.total_inodes = MAX_INODES;
-    super_block.free_inodes = MAX_INODES;
-}
+int batch_mode = 0;       // 1: commands come from file or pipe, no prompt and nothing interactive
+char *image_path = NULL;  // image given with --image (NULL if file system is only in memory)
+char *segment_name = NULL; // shared memory segment given with --shared
+FILE *input_file = NULL;  // where commands are read from
 
-void create_dilb()
+void display_file_list(const char *path)
 {
-    int counter;
-    struct inode *inode_ptr = NULL;
-    struct inode *new_inode = NULL;
+    int position;
+    struct cvfs_stat stat_buf;
 
-    for (counter = 1; counter <= MAX_INODES; counter++)
+    position = cvfs_next_entry(path, 0, &stat_buf);
+    if (position == -2)
     {
-        new_inode = (struct inode *)malloc(sizeof(struct inode));
-        if (new_inode == NULL)
-        {
-            printf("Memory allocation FAILED\n");
-            return;
-        }
-        new_inode->inode_number = counter;
-        new_inode->file_size;
-        new_inode->file_actual_size = 0;
-        new_inode->file_type = 0;
-        new_inode->file_data = NULL;
-        new_inode->link_count = 0;
-        new_inode->reference_count = 0;
-        new_inode->permission = 0;
-        new_inode->next_inode = NULL;
-
-        inode_ptr = inode_head;
-        if (inode_ptr == NULL)
-        {
-            inode_ptr = new_inode;
-            inode_head = inode_ptr;
-        }
-        else
-        {
-            while (inode_ptr->next_inode != NULL)
-                inode_ptr = inode_ptr->next_inode;
-            inode_ptr->next_inode = new_inode;
-        }
+        printf("ERROR: There is no such directory.\n");
+        return;
     }
-    printf("DILB created successfully.\n");
-}
-
-void display_file_list()
-{
-    struct inode *inode_ptr = inode_head;
-
-    if (super_block.free_inodes == MAX_INODES)
+    if (position == -1)
     {
         printf("There are no files.\n");
         return;
     }
 
-    while (inode_ptr != NULL)
+    while (position >= 0)
     {
-        if (inode_ptr->file_type != 0)             // file type is non zero means file exists
-            printf("%s   ", inode_ptr->file_name); // print file names
-        inode_ptr = inode_ptr->next_inode;
+        printf("%s%s   ", stat_buf.file_name, (stat_buf.file_type == DIRECTORY) ? "/" : ""); // print file names
+        position = cvfs_next_entry(path, position + 1, &stat_buf);
     }
     printf("\n");
 }
 
-void close_all_files()
-{
-    int counter;
-    struct filetable *filetable_ptr = NULL;
-
-    for (counter = 0; counter < MAX_INODES; counter++)
-    {
-        filetable_ptr = ufdt_array[counter].ptr_filetable;
-
-        if ((filetable_ptr != NULL))
-        {
-            (filetable_ptr->reference_count)--;
-
-            if ((filetable_ptr->reference_count == 0)) // if reference count 0 free file table entry
-            {
-                filetable_ptr->mode = 0;
-                filetable_ptr->read_offset = 0;
-                filetable_ptr->write_offset = 0;
-                filetable_ptr->ptr_inode = NULL;
-                free(filetable_ptr);
-                ufdt_array[counter].ptr_filetable = NULL;
-            }
-        }
-    }
-    printf("All files are closed.\n");
-}
-
 void clear_screen()
 {
 #ifdef _WIN // for windows
@@ -171,126 +65,87 @@ void display_commands()
     printf("open:\t\tto open a file.\n");
     printf("read:\t\tto read from file.\n");
     printf("write:\t\tto write from file.\n");
-    printf("ls:\t\tto display all files.\n");
+    printf("ls:\t\tto display all files of a directory.\n");
+    printf("mkdir:\t\tto create new directory.\n");
+    printf("rmdir:\t\tto remove empty directory.\n");
+    printf("cd:\t\tto change current directory.\n");
+    printf("pwd:\t\tto display current directory.\n");
     printf("closeall:\tto close all opened files.\n");
     printf("clear:\t\tto clear the screen.\n");
-    printf("backup:\t\tto take backup of all files.\n");
-    printf("stat:\t\tto display file info by file name.\n");
+    printf("backup:\t\tto take backup of changed files.\n");
+    printf("restore:\tto create files from backup archive.\n");
+    printf("checkpoint:\tto write file system image to disk.\n");
+    printf("perf:\t\tto display call counts and latencies of file operations.\n");
+    printf("stat:\t\tto display file info by file name (or file system info).\n");
     printf("fstat:\t\tto display file info by file descriptor.\n");
     printf("close:\t\tto close a file.\n");
     printf("rm:\t\tto remove file.\n");
+    printf("cp:\t\tto copy a file without copying its data (copy on write).\n");
+    printf("compress:\tto keep data of a file compressed.\n");
+    printf("grep:\t\tto find files which contain a pattern.\n");
     printf("man:\t\tto display info about commands.\n");
     printf("truncate:\tto remove data from file.\n");
     printf("lseek:\t\tto change byte read/write byte offset of file.\n");
     printf("exit:\t\tto exit file system.\n");
+    printf("\nFiles are named by paths like 'docs/notes' or '/docs/notes', relative paths start in current directory.\n");
+    printf("\nStart with --batch [<command_file>] to run commands from a file or pipe without prompts,\n");
+    printf("'write <file_name> <data>' then takes the data from the same line.\n");
 }
 
-void backup_all_files()
+void display_stat(struct cvfs_stat *stat_buf)
 {
-    int file_desc;
-    int permission;
-    struct inode *inode_ptr = inode_head;
-
-    while (inode_ptr != NULL)
-    {
-        if (inode_ptr->file_type != 0)
-        {
-            if (inode_ptr->permission == READ)
-                permission = S_IRUSR;
-            if (inode_ptr->permission == WRITE)
-                permission = S_IWUSR;
-            if (inode_ptr->permission == READ + WRITE)
-                permission = S_IRWXU;
-
-            file_desc = creat(inode_ptr->file_name, permission);
-            if (file_desc == -1)
-                perror("ERROR");
-            else
-            {
-                write(file_desc, inode_ptr->file_data, strlen(inode_ptr->file_data));
-                close(file_desc);
-            }
-        }
-        inode_ptr = inode_ptr->next_inode;
-    }
-}
-
-struct inode *get_free_inode()
-{
-    struct inode *inode_ptr = inode_head;
-
-    while (inode_ptr != NULL)
-    {
-        if (inode_ptr->file_type == 0) // if file type == 0 that means inode is free
-            return inode_ptr;
-        inode_ptr = inode_ptr->next_inode;
-    }
-    return NULL;
-}
-
-int is_file_exists(char *file_name)
-{
-    struct inode *inode_ptr = inode_head;
-
-    while (inode_ptr != NULL)
-    {
-        if ((!strcmp(inode_ptr->file_name, file_name)) && (inode_ptr->file_type != 0))
-            return 1; // file exists
-        inode_ptr = inode_ptr->next_inode;
-    }
-    return 0; // file does not exists
-}
-
-int get_file_desc(char *file_name)
-{
-    int counter;
-
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
-
-    for (counter = 0; ufdt_array[counter].ptr_filetable != NULL; counter++)
-    {
-        if (!strcmp(ufdt_array[counter].ptr_filetable->ptr_inode->file_name, file_name))
-            return counter; // returning file descriptor
-    }
-    return -1;
+    printf("File name: %s\n", stat_buf->file_name);
+    printf("Inode number: %d\n", stat_buf->inode_number);
+    printf("File size: %lld\n", stat_buf->file_size);
+    printf("Actual file size: %lld\n", stat_buf->file_actual_size);
+    printf("Link count: %d\n", stat_buf->link_count);
+    printf("File type: %s\n", (stat_buf->file_type == DIRECTORY) ? "Directory" : "Regular");
+    if (stat_buf->permission == READ)
+        printf("Permission: Read\n");
+    else if (stat_buf->permission == WRITE)
+        printf("Permission: Write\n");
+    else if (stat_buf->permission == READ + WRITE)
+        printf("Permission: Read & Write\n");
+    if (stat_buf->compression)
+        printf("Compression: LZ (%lld bytes stored)\n", stat_buf->file_size);
 }
 
 void stat(char *file_name)
 {
-    struct inode *inode_ptr = inode_head;
+    struct cvfs_stat stat_buf;
 
-    if (!is_file_exists(file_name))
+    if (cvfs_stat(file_name, &stat_buf) == -1)
     {
         printf("ERROR: There is no such file.\n"); // there is no such file
         return;
     }
+    display_stat(&stat_buf);
+}
 
-    while (inode_ptr != NULL)
-    {
-        if (!strcmp(inode_ptr->file_name, file_name))
-        {
-            printf("File name: %s\n", inode_ptr->file_name);
-            printf("Inode number: %d\n", inode_ptr->inode_number);
-            printf("File size: %d\n", inode_ptr->file_size);
-            printf("Actual file size: %d\n", inode_ptr->file_actual_size);
-            printf("Link count: %d\n", inode_ptr->link_count);
-            printf("File type: Regular\n");
-            if (inode_ptr->permission == READ)
-                printf("Permission: Read\n");
-            else if (inode_ptr->permission == WRITE)
-                printf("Permission: Write\n");
-            else if (inode_ptr->permission == READ + WRITE)
-                printf("Permission: Read & Write\n");
-            break;
-        }
-        inode_ptr = inode_ptr->next_inode;
-    }
+void statfs()
+{
+    struct cvfs_statfs statfs_buf;
+    long long used_blocks;
+
+    cvfs_statfs(&statfs_buf);
+    used_blocks = statfs_buf.total_blocks - statfs_buf.free_blocks;
+    printf("Block size: %d\n", statfs_buf.block_size);
+    printf("Inodes: %d used, %d free\n", statfs_buf.total_inodes - statfs_buf.free_inodes, statfs_buf.free_inodes);
+    printf("Blocks: %lld used, %lld free\n", used_blocks, statfs_buf.free_blocks);
+    printf("Blocks referenced by files: %lld\n", statfs_buf.referenced_blocks);
+    printf("Blocks deduplicated: %lld\n", statfs_buf.deduplicated_blocks);
+    printf("Dedup ratio: %.2f\n", (used_blocks > 0) ? (double)statfs_buf.referenced_blocks / used_blocks : 1.0);
+    if (statfs_buf.budget_blocks == 0)
+        return;
+    printf("Blocks in memory: %lld of %lld allowed\n", statfs_buf.resident_blocks, statfs_buf.budget_blocks);
+    printf("Block accesses: %lld hits, %lld misses (hit ratio %.2f)\n", statfs_buf.block_hits, statfs_buf.block_misses,
+           (statfs_buf.block_hits + statfs_buf.block_misses > 0) ? (double)statfs_buf.block_hits / (statfs_buf.block_hits + statfs_buf.block_misses) : 1.0);
+    printf("Blocks evicted to backing file: %lld\n", statfs_buf.evicted_blocks);
 }
 
 void fstat(int fd)
 {
-    struct inode *inode_ptr = NULL;
+    struct cvfs_stat stat_buf;
 
     if (fd < 0)
     {
@@ -298,26 +153,12 @@ void fstat(int fd)
         return; // file descriptor not valid
     }
 
-    if (ufdt_array[fd].ptr_filetable == NULL)
+    if (cvfs_fstat(fd, &stat_buf) == -1)
     {
         printf("ERROR: File is not opened.\n");
         return; // there is no such file
     }
-
-    inode_ptr = ufdt_array[fd].ptr_filetable->ptr_inode; // for efficiency
-
-    printf("File name: %s\n", inode_ptr->file_name);
-    printf("Inode number: %d\n", inode_ptr->inode_number);
-    printf("File size: %d\n", inode_ptr->file_size);
-    printf("Actual file size: %d\n", inode_ptr->file_actual_size);
-    printf("Link count: %d\n", inode_ptr->link_count);
-    printf("File type: Regular\n");
-    if (inode_ptr->permission == READ)
-        printf("Permission: Read\n");
-    else if (inode_ptr->permission == WRITE)
-        printf("Permission: Write\n");
-    else if (inode_ptr->permission == READ + WRITE)
-        printf("Permission: Read & Write\n");
+    display_stat(&stat_buf);
 }
 
 void manual(char *command)
@@ -329,11 +170,19 @@ void manual(char *command)
     else if (!strcmp(command, "read"))
         printf("\nCommand: read\nDescription: Used to read data from regular file.\nUsage: read <file_name> <no_of_bytes_to_read>\n\n");
     else if (!strcmp(command, "write"))
-        printf("\nCommand: write\nDescription: Used to write data into regular file.\nUsage: write <file_name> <data>\n\n");
+        printf("\nCommand: write\nDescription: Used to write data into regular file.\nUsage: write <file_name> [<data>]\n\n");
     else if (!strcmp(command, "ls"))
-        printf("\nCommand: ls\nDescription: Used to list all files.\nUsage: ls\n\n");
+        printf("\nCommand: ls\nDescription: Used to list all files of current or given directory (directories end with '/').\nUsage: ls [<directory>]\n\n");
+    else if (!strcmp(command, "mkdir"))
+        printf("\nCommand: mkdir\nDescription: Used to create new directory.\nUsage: mkdir <directory>\n\n");
+    else if (!strcmp(command, "rmdir"))
+        printf("\nCommand: rmdir\nDescription: Used to remove empty directory.\nUsage: rmdir <directory>\n\n");
+    else if (!strcmp(command, "cd"))
+        printf("\nCommand: cd\nDescription: Used to change current directory ('..' is parent directory, '/' is root directory).\nUsage: cd <directory>\n\n");
+    else if (!strcmp(command, "pwd"))
+        printf("\nCommand: pwd\nDescription: Used to display path of current directory.\nUsage: pwd\n\n");
     else if (!strcmp(command, "stat"))
-        printf("\nCommand: stat\nDescription: Used to display information of file by name.\nUsage: stat <file_name>\n\n");
+        printf("\nCommand: stat\nDescription: Used to display information of file by name, without a name blocks and dedup ratio of file system.\nUsage: stat [<file_name>]\n\n");
     else if (!strcmp(command, "fstat"))
         printf("\nCommand: fstat\nDescription: Used to display information of file by file descriptor.\nUsage: fstat <file_name>\n\n");
     else if (!strcmp(command, "truncate"))
@@ -345,603 +194,847 @@ void manual(char *command)
     else if (!strcmp(command, "closeall"))
         printf("\nCommand: closeall\nDescription: Used to close all opened files.\nUsage: closeall\n\n");
     else if (!strcmp(command, "lseek"))
-        printf("\nCommand: lseek\nDescription: Used to change the file offset.\nUsage: lseek <file_name> <change_in_offset> <starting_point>\n\n");
+        printf("\nCommand: lseek\nDescription: Used to change the file offset.\nUsage: lseek <file_name> <change_in_offset> <starting_point>\n"
+               "Starting point: 0 start, 1 current offset, 2 end, 3 next data, 4 next hole (file grows by a hole past its end)\n\n");
     else if (!strcmp(command, "rm"))
         printf("\nCommand: rm\nDescription: Used to delete the existing file.\nUsage: rm <file_name>\n\n");
+    else if (!strcmp(command, "cp"))
+        printf("\nCommand: cp\nDescription: Used to copy a file, the copy shares data blocks of the file until either of them is written (--reflink is the only kind of copy and may be omitted).\nUsage: cp [--reflink] <source_file> <destination_file>\n\n");
+    else if (!strcmp(command, "compress"))
+        printf("\nCommand: compress\nDescription: Used to compress data of an existing file, 'off' stores it uncompressed again (start with --compress to compress all new files).\nUsage: compress <file_name> [off]\n\n");
+    else if (!strcmp(command, "grep"))
+        printf("\nCommand: grep\nDescription: Used to display every offset where pattern occurs in given files (or in all files).\nUsage: grep <pattern> [file_name]...\n\n");
     else if (!strcmp(command, "backup"))
-        printf("\nCommand: backup\nDescription: Used to take backup of all the files created.\nUsage: backup\n\n");
+        printf("\nCommand: backup\nDescription: Used to take backup of the files changed since last backup ('full' copies every file, '--archive' writes all files into one archive).\nUsage: backup [full]\n       backup --archive <archive_file>\n\n");
+    else if (!strcmp(command, "restore"))
+        printf("\nCommand: restore\nDescription: Used to create all files of an archive written by 'backup --archive'.\nUsage: restore <archive_file>\n\n");
+    else if (!strcmp(command, "checkpoint"))
+        printf("\nCommand: checkpoint\nDescription: Used to write changed data of file system image to disk (only when started with --image).\nUsage: checkpoint\n\n");
+    else if (!strcmp(command, "perf"))
+        printf("\nCommand: perf\nDescription: Used to display calls, bytes, errors and latency percentiles of every file operation ('json' prints them as JSON or writes them into a host file, 'reset' clears them).\nUsage: perf\n       perf json [<output_file>]\n       perf reset\n\n");
     else if (!strcmp(command, "exit"))
         printf("\nCommand: exit\nDescription: Cause normal process termination.\nUsage: exit\n\n");
     else
         printf("\nERROR: No manual entry for '%s'\n", command);
 }
 
-int is_open(char *file_name)
+void backup(int full)
+{
+    struct cvfs_backup_summary summary;
+
+    if (cvfs_backup(full, &summary) == 0)
+        printf("Backup taken successfully.\n");
+    printf("%d files copied, %d unchanged, %d failed, %lld bytes written in %.3f seconds.\n", summary.files_copied, summary.files_skipped, summary.files_failed, summary.bytes_written, summary.elapsed_seconds);
+}
+
+void print_match(const char *path, long long offset, void *argument)
+{
+    printf("%s:%lld\n", path, offset);
+}
+
+void grep(char *pattern, char *file_names[], int file_count)
 {
-    struct inode *inode_ptr = inode_head;
+    struct cvfs_grep_summary summary;
 
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
+    if (cvfs_grep(pattern, (file_count > 0) ? file_names : NULL, file_count, print_match, NULL, &summary) == -1)
+    {
+        printf("ERROR: Pattern must have 1 to %d characters.\n", MAX_PATTERN_LENGTH);
+        return;
+    }
+    printf("%lld matches in %d of %d files, %d failed, %lld bytes scanned in %.3f seconds (%.2f GB/s).\n", summary.matches, summary.files_matched,
+           summary.files_scanned, summary.files_failed, summary.bytes_scanned, summary.elapsed_seconds,
+           (summary.elapsed_seconds > 0) ? summary.bytes_scanned / summary.elapsed_seconds / 1e9 : 0.0);
+}
+
+void backup_archive(char *archive_path)
+{
+    struct cvfs_backup_summary summary;
 
-    while (inode_ptr != NULL)
+    if (cvfs_backup_archive(archive_path, &summary) != 0)
     {
-        if (!strcmp(inode_ptr->file_name, file_name))
+        printf("ERROR: Could not write archive '%s'.\n", archive_path);
+        return;
+    }
+    printf("Backup taken successfully.\n");
+    printf("%d files archived, %lld bytes written in %.3f seconds.\n", summary.files_copied, summary.bytes_written, summary.elapsed_seconds);
+}
+
+void restore(char *archive_path)
+{
+    int status;
+    struct cvfs_backup_summary summary;
+
+    status = cvfs_restore_archive(archive_path, &summary);
+    if (status == -1)
+        printf("ERROR: Could not open archive '%s'.\n", archive_path);
+    else if (status == -2)
+        printf("ERROR: '%s' is not a backup archive.\n", archive_path);
+    else
+        printf("%d files restored, %d failed, %lld bytes written in %.3f seconds.\n", summary.files_copied, summary.files_failed, summary.bytes_written, summary.elapsed_seconds);
+}
+
+void display_perf()
+{
+    int op;
+    int count;
+    int code;
+    struct cvfs_perf_op ops[16];
+
+    count = cvfs_perf_snapshot(ops, 16);
+    printf("%-10s %10s %14s %8s %10s %10s %10s %10s %10s\n", "operation", "calls", "bytes", "errors", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (op = 0; op < count; op++)
+    {
+        printf("%-10s %10lld %14lld %8lld %10.2f %10.2f %10.2f %10.2f %10.2f", ops[op].name, ops[op].calls, ops[op].bytes, ops[op].error_calls,
+               ops[op].mean_ns / 1000, ops[op].p50_ns / 1000, ops[op].p99_ns / 1000, ops[op].p999_ns / 1000, ops[op].max_ns / 1000);
+        for (code = 1; code < CVFS_PERF_ERROR_CODES; code++)
         {
-            if (inode_ptr->reference_count != 0)
-                return 1; // file is open
-            return 0;     // file is closed
+            if (ops[op].errors[code] > 0)
+                printf("  %d:%lld", -code, ops[op].errors[code]); // breakdown of errors by returned value
         }
-        inode_ptr = inode_ptr->next_inode;
+        printf("\n");
     }
-    return 0;
 }
 
-int close_file(int file_desc)
+long long read_file(char *file_name, long long byte_to_read)
 {
-    struct inode *inode_ptr = NULL;
-    struct filetable *filetable_ptr = NULL;
-    filetable_ptr = ufdt_array[file_desc].ptr_filetable;
-
-    if (filetable_ptr == NULL)
-        return -1; // file already closed or file does not exists
+    int file_desc;
+    long long read_bytes = 0;
+    long long chunk;
+    char buffer[4096];
 
-    inode_ptr = ufdt_array[file_desc].ptr_filetable->ptr_inode;
-    (filetable_ptr->reference_count)--; // decrementing reference count of filetable
+    file_desc = cvfs_get_fd(file_name);
+    if (file_desc < 0)
+        return file_desc; // -1: there is no such file, -2: file is not opened
 
-    if (filetable_ptr->reference_count == 0)
+    while (read_bytes < byte_to_read)
     {
-        free(ufdt_array[file_desc].ptr_filetable);  // deallocating memory of file table
-        ufdt_array[file_desc].ptr_filetable = NULL; // most important (dependency in open_file())
-        (inode_ptr->reference_count)--;             // decrementing reference count of inode
+        chunk = byte_to_read - read_bytes;
+        if (chunk > (long long)sizeof(buffer))
+            chunk = sizeof(buffer);
+
+        chunk = cvfs_read(file_desc, buffer, chunk);
+        if (chunk == -3)
+            return -3; // don't have pemission to read
+        if (chunk <= 0)
+            break; // end of file
+
+        fwrite(buffer, 1, chunk, stdout); // print data on console
+        read_bytes += chunk;
     }
-    return 0;
+
+    if (read_bytes == 0 && byte_to_read > 0)
+        return END_OF_FILE; // there are no more bytes to read
+
+    printf("\n");
+    return read_bytes;
+}
+
+void command_ls(int argc, char *argv[])
+{
+    display_file_list(argc == 2 ? argv[1] : ".");
 }
 
-// int close_file(char *file_name)
-// {
-//     int file_desc;
-//     struct inode *inode_ptr = NULL;
-//     struct filetable *filetable_ptr = NULL;
+void command_mkdir(int argc, char *argv[])
+{
+    int status = cvfs_mkdir(argv[1]);
+
+    if (status == -1)
+        printf("ERROR: Incorrect path or there is no such directory.\n");
+    else if (status == -2)
+        printf("ERROR: There is no free space.\n");
+    else if (status == -3)
+        printf("ERROR: File already exists.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("Directory '%s' created successfully.\n", argv[1]);
+}
 
-//     if (!is_file_exists(file_name))
-//         return -1; // there is no such file
+void command_rmdir(int argc, char *argv[])
+{
+    int status = cvfs_rmdir(argv[1]);
+
+    if (status == -1)
+        printf("ERROR: There is no such directory.\n");
+    else if (status == -2)
+        printf("ERROR: '%s' is not a directory.\n", argv[1]);
+    else if (status == -3)
+        printf("ERROR: Directory is not empty.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("Directory deleted successfully.\n");
+}
 
-//     if (!is_open(file_name))
-//         return -2; // file already closed
+void command_cd(int argc, char *argv[])
+{
+    if (cvfs_chdir(argv[1]) == -1)
+        printf("ERROR: There is no such directory.\n");
+}
 
-//     file_desc = get_file_desc(file_name);
+void command_pwd(int argc, char *argv[])
+{
+    char path[MAX_PATH_LENGTH];
 
-//     inode_ptr = ufdt_array[file_desc].ptr_filetable->ptr_inode;
-//     filetable_ptr = ufdt_array[file_desc].ptr_filetable;
-//     (filetable_ptr->reference_count)--; // decrementing reference count of filetable
+    if (cvfs_getcwd(path, sizeof(path)) == 0)
+        printf("%s\n", path);
+}
 
-//     if (filetable_ptr->reference_count == 0)
-//     {
-//         free(ufdt_array[file_desc].ptr_filetable);  // deallocating memory of file table
-//         ufdt_array[file_desc].ptr_filetable = NULL; // most important (dependency in open_file())
-//         (inode_ptr->reference_count)--;             // decrementing reference count of inode
-//     }
-//     return 0;
-// }
+void command_closeall(int argc, char *argv[])
+{
+    cvfs_close_all();
+    printf("All files are closed.\n");
+}
 
-int create_file(char *file_name, int permission)
+void command_clear(int argc, char *argv[])
 {
-    int counter;
-    struct inode *new_inode = NULL;
+    if (!batch_mode)
+        clear_screen();
+}
 
-    if (file_name == NULL || permission == 0 || permission > 3)
-        return -1; // checking for incorrect parameters
+void command_help(int argc, char *argv[])
+{
+    display_commands();
+}
 
-    if (super_block.free_inodes == 0)
-        return -2; // there is no enough space
+void command_backup(int argc, char *argv[])
+{
+    if (argc == 1)
+        backup(0);
+    else if (argc == 2 && !strcmp(argv[1], "full"))
+        backup(1);
+    else if (argc == 3 && !strcmp(argv[1], "--archive"))
+        backup_archive(argv[2]);
+    else
+        printf("ERROR: Invalid arguments.\n");
+}
 
-    if (is_file_exists(file_name))
-        return -3; // file already exists
+void command_grep(int argc, char *argv[])
+{
+    grep(argv[1], argv + 2, argc - 2);
+}
+
+void command_restore(int argc, char *argv[])
+{
+    restore(argv[1]);
+}
+
+void command_checkpoint(int argc, char *argv[])
+{
+    int status = cvfs_checkpoint();
+
+    if (status == -1)
+        printf("ERROR: File system is not stored in an image.\n");
+    else if (status == -2)
+        printf("ERROR: Could not write image.\n");
+    else
+        printf("Checkpoint taken successfully.\n");
+}
 
-    for (counter = 0; counter < MAX_INODES; counter++)
+void command_perf(int argc, char *argv[])
+{
+    if (argc == 1)
+        display_perf();
+    else if (!strcmp(argv[1], "reset") && argc == 2)
+    {
+        cvfs_perf_reset();
+        printf("Counters are reset.\n");
+    }
+    else if (!strcmp(argv[1], "json"))
     {
-        if (ufdt_array[counter].ptr_filetable == NULL) // searching 'NULL' entry for file table
-            break;
+        fflush(stdout);
+        if (cvfs_perf_json(argc == 3 ? argv[2] : NULL) != 0)
+            printf("ERROR: Could not write '%s'.\n", argv[2]);
     }
+    else
+        printf("ERROR: Invalid arguments.\n");
+}
 
-    ufdt_array[counter].ptr_filetable = (struct filetable *)malloc(sizeof(struct filetable)); // allocating memory for 'filetable'
+void command_exit(int argc, char *argv[])
+{
+    if ((image_path != NULL || segment_name != NULL) && cvfs_unmount() != 0)
+        printf("ERROR: Could not write image.\n");
+    exit(0);
+}
 
-    if (ufdt_array[counter].ptr_filetable == NULL)
-        return -4; // memory allocation failed
+void command_stat(int argc, char *argv[])
+{
+    if (argc == 1)
+        statfs();
+    else
+        stat(argv[1]);
+}
 
-    // initialize file table
-    ufdt_array[counter].ptr_filetable->mode = permission;
-    ufdt_array[counter].ptr_filetable->read_offset = 0;
-    ufdt_array[counter].ptr_filetable->write_offset = 0;
-    ufdt_array[counter].ptr_filetable->reference_count = 1;
+void command_fstat(int argc, char *argv[])
+{
+    fstat(atoi(argv[1]));
+}
 
-    if ((new_inode = get_free_inode()) != NULL) // searching free inode
-        ufdt_array[counter].ptr_filetable->ptr_inode = new_inode;
+void command_man(int argc, char *argv[])
+{
+    manual(argv[1]);
+}
 
-    // initializing new inode
-    strcpy(new_inode->file_name, file_name);
-    new_inode->file_actual_size = 0;
-    new_inode->file_size = FILE_SIZE;
-    new_inode->file_type = REGULAR;
-    new_inode->permission = permission;
-    new_inode->reference_count = 1;
-    new_inode->link_count = 1;
+void command_close(int argc, char *argv[])
+{
+    if (cvfs_close(atoi(argv[1])) == -1)
+        printf("ERROR: There is no such file or File already closed.\n");
+    else
+        printf("File closed successfully.\n");
+}
 
-    if (new_inode->file_data == NULL) // checks if memory already allocated (is old inode?)
-        new_inode->file_data = (char *)malloc(FILE_SIZE);
+void command_rm(int argc, char *argv[])
+{
+    int status = cvfs_unlink(argv[1]);
+
+    if (status == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (status == -2)
+        printf("ERROR: '%s' is a directory, use rmdir.\n", argv[1]);
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("File deleted successfully.\n");
+}
 
-    if (new_inode->file_data == NULL)
-        return -4; // memory allocation failed
+void command_cp(int argc, char *argv[])
+{
+    int status;
 
-    memset(new_inode->file_data, 0, FILE_SIZE); // clearing garbage
+    if (argc == 4 && strcmp(argv[1], "--reflink") != 0)
+    {
+        printf("ERROR: Invalid arguments.\n");
+        return;
+    }
 
-    (super_block.free_inodes)--; // decrementing the count of free inodes
+    status = cvfs_clone(argv[argc - 2], argv[argc - 1]);
+    if (status == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (status == -2)
+        printf("ERROR: '%s' is a directory.\n", argv[argc - 2]);
+    else if (status == -3)
+        printf("ERROR: Incorrect destination or there is no such directory.\n");
+    else if (status == -4)
+        printf("ERROR: There is no free inode or file descriptor.\n");
+    else if (status == -5)
+        printf("ERROR: File already exists.\n");
+    else if (status == -6)
+        printf("ERROR: There is no free space.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("'%s' copied to '%s'.\n", argv[argc - 2], argv[argc - 1]);
+}
 
-    return counter;
+void command_compress(int argc, char *argv[])
+{
+    int status;
+
+    if (argc == 3 && strcmp(argv[2], "off") != 0)
+    {
+        printf("ERROR: Invalid arguments.\n");
+        return;
+    }
+
+    status = cvfs_compress(argv[1], argc == 2);
+    if (status == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (status == -2)
+        printf("ERROR: '%s' is a directory.\n", argv[1]);
+    else if (status == -3)
+        printf("ERROR: There is no free space.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("'%s' is %s.\n", argv[1], (argc == 2) ? "compressed" : "no longer compressed");
 }
 
-int delete_file(char *file_name)
+void command_write(int argc, char *argv[])
 {
     int file_desc;
-    struct inode *inode_ptr = inode_head;
-
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
+    long long status;
+    char *file_data;
+    char data_line[MAX_LINE];
 
-    while (inode_ptr != NULL)
+    file_desc = cvfs_get_fd(argv[1]);
+    if (file_desc == -1)
     {
-        if (!strcmp(inode_ptr->file_name, file_name))
-            break;
-        inode_ptr = inode_ptr->next_inode;
+        printf("ERROR: There is no such file.\n");
+        return;
+    }
+    if (file_desc == -2)
+    {
+        printf("ERROR: File is not opened.\n");
+        return;
     }
 
-    (inode_ptr->link_count)--;
-
-    if ((inode_ptr->link_count) == 0)
+    if (argc == 3)
+        file_data = argv[2]; // data given on same line (rest of line)
+    else if (batch_mode)
     {
-        file_desc = get_file_desc(file_name);
+        printf("ERROR: Data has to follow the file name in batch mode.\n");
+        return;
+    }
+    else
+    {
+        printf("Enter the data: ");
+        if (fgets(data_line, sizeof(data_line), input_file) == NULL)
+            return;
+        data_line[strcspn(data_line, "\r\n")] = '\0';
+        file_data = data_line;
+    }
 
-        if (file_desc != -1)
-        {
-            ufdt_array[file_desc].ptr_filetable->ptr_inode = NULL;
-            free(ufdt_array[file_desc].ptr_filetable);  // freeing file table entry
-            ufdt_array[file_desc].ptr_filetable = NULL; // initialize with NULL (most important)
-        }
+    status = cvfs_write(file_desc, file_data, strlen(file_data));
 
-        inode_ptr->file_type = 0; // most important (dependency in get_free_inode())
-        inode_ptr->file_actual_size = 0;
-        inode_ptr->reference_count = 0; // any file table entry is not pointing at inode
-        inode_ptr->permission = 0;
-        inode_ptr = NULL;
+    if (status == -3)
+        printf("ERROR: Permission denied to write to the file.\n");
+    else if (status == -4)
+        printf("ERROR: The file is not a regular file.\n");
+    else if (status == -5)
+        printf("ERROR: There is not enough space to write to the file.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("Successfully wrote %lld bytes to '%s'.\n", status, argv[1]);
+}
 
-        (super_block.free_inodes)++;
-    }
+void command_create(int argc, char *argv[])
+{
+    int file_desc = cvfs_create(argv[1], atoi(argv[2]));
+
+    if (file_desc == -1)
+        printf("ERROR: Incorrect parameters or there is no such directory.\n");
+    else if (file_desc == -2)
+        printf("ERROR: There is no free space.\n");
+    else if (file_desc == -3)
+        printf("ERROR: File already exists.\n");
+    else if (file_desc == -4)
+        printf("ERROR: There is no free file descriptor.\n");
+    else if (file_desc == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("'%s' successfully created with file descriptor %d.\n", argv[1], file_desc);
+}
 
-    return 0;
+void command_truncate(int argc, char *argv[])
+{
+    int status = cvfs_truncate(argv[1], atoll(argv[2]));
+
+    if (status == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (status == -2)
+        printf("ERROR: Invalid size.\n");
+    else if (status == -3)
+        printf("ERROR: '%s' is a directory.\n", argv[1]);
+    else if (status == -4)
+        printf("ERROR: There is no free space.\n");
+    else if (status == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else
+        printf("Data truncated successfully.\n");
 }
 
-int write_file(char *file_name, char *file_data, int no_of_bytes)
+void command_open(int argc, char *argv[])
 {
-    int result;
-    int file_desc;
-    struct inode *inode_ptr = NULL;
-    struct filetable *filetable_ptr = NULL;
+    int file_desc = cvfs_open(argv[1], atoi(argv[2]));
+
+    if (file_desc == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (file_desc == -2)
+        printf("ERROR: Invalid opening mode.\n");
+    else if (file_desc == -3)
+        printf("ERROR: There is no permission for this opening mode.\n");
+    else if (file_desc == -4)
+        printf("ERROR: There is no free file descriptor.\n");
+    else if (file_desc == -5)
+        printf("ERROR: '%s' is a directory.\n", argv[1]);
+    else
+        printf("'%s' opened with file descriptor %d\n", argv[1], file_desc);
+}
 
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
+void command_read(int argc, char *argv[])
+{
+    long long status = read_file(argv[1], atoll(argv[2]));
 
-    if (!is_open(file_name))
-        return -2; // file is not opened
+    if (status == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (status == -2)
+        printf("ERROR: File is not opened.\n");
+    else if (status == -3)
+        printf("ERROR: Permission denied to read from the file.\n");
+    else if (status == END_OF_FILE)
+        printf("ERROR : There is no more data to read.\n");
+}
 
-    file_desc = get_file_desc(file_name);
-    filetable_ptr = ufdt_array[file_desc].ptr_filetable; // for efficiency
-    inode_ptr = filetable_ptr->ptr_inode;                // for efficiency
+void command_lseek(int argc, char *argv[])
+{
+    int file_desc = cvfs_get_fd(argv[1]);
+    int whence = atoi(argv[3]);
+    long long offset = (file_desc < 0) ? file_desc : cvfs_lseek(file_desc, atoll(argv[2]), whence);
 
-    if ((filetable_ptr->mode != WRITE) && (filetable_ptr->mode != READ + WRITE && (filetable_ptr->mode != WRITE + APPEND) && (filetable_ptr->mode != READ + WRITE + APPEND)))
-        return -3; // don't have permission to write
+    if (offset == -1)
+        printf("ERROR: There is no such file.\n");
+    else if (offset == -2)
+        printf("ERROR: File is not opened.\n");
+    else if (offset == -3)
+        printf("ERROR: Invalid arguments.\n");
+    else if (offset == -4)
+        printf("ERROR: No %s after given offset.\n", (whence == SEEK_DATA) ? "data" : "hole");
+    else if (offset == CVFS_JOURNAL_FAILED)
+        printf("ERROR: Journal could not be written, the change is not durable.\n");
+    else if (whence == SEEK_DATA || whence == SEEK_HOLE)
+        printf("Offset: %lld\n", offset);
+    else
+        printf("Success\n");
+}
 
-    if (inode_ptr->file_type != REGULAR)
-        return -4; // file is not a regular file
+struct command commands[] = {
+    // name, min_tokens, max_tokens, rest_of_line, run (token counts include command name)
+    {"ls", 1, 2, 0, command_ls},
+    {"pwd", 1, 1, 0, command_pwd},
+    {"closeall", 1, 1, 0, command_closeall},
+    {"clear", 1, 1, 0, command_clear},
+    {"help", 1, 1, 0, command_help},
+    {"backup", 1, 3, 0, command_backup},
+    {"restore", 2, 2, 0, command_restore},
+    {"grep", 2, MAX_TOKENS, 0, command_grep},
+    {"checkpoint", 1, 1, 0, command_checkpoint},
+    {"perf", 1, 3, 0, command_perf},
+    {"exit", 1, 1, 0, command_exit},
+    {"stat", 1, 2, 0, command_stat},
+    {"fstat", 2, 2, 0, command_fstat},
+    {"man", 2, 2, 0, command_man},
+    {"close", 2, 2, 0, command_close},
+    {"rm", 2, 2, 0, command_rm},
+    {"mkdir", 2, 2, 0, command_mkdir},
+    {"rmdir", 2, 2, 0, command_rmdir},
+    {"cd", 2, 2, 0, command_cd},
+    {"write", 2, 3, 1, command_write},
+    {"create", 3, 3, 0, command_create},
+    {"cp", 3, 4, 0, command_cp},
+    {"compress", 2, 3, 0, command_compress},
+    {"truncate", 3, 3, 0, command_truncate},
+    {"open", 3, 3, 0, command_open},
+    {"read", 3, 3, 0, command_read},
+    {"lseek", 4, 4, 0, command_lseek},
+};
 
-    if ((filetable_ptr->write_offset + no_of_bytes) > FILE_SIZE)
-        return -5; // there is no space
+struct command *command_table[COMMAND_TABLE_SIZE]; // open addressed hash table of 'commands'
 
-    strcpy((inode_ptr->file_data) + (filetable_ptr->write_offset), file_data); // write data into file
+unsigned int command_hash(const char *name)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
 
-    filetable_ptr->write_offset += no_of_bytes;
-    if (filetable_ptr->write_offset > inode_ptr->file_actual_size) // adjusting write offset from file table
+    while (*name != '\0')
     {
-        result = filetable_ptr->write_offset - inode_ptr->file_actual_size;
-        inode_ptr->file_actual_size += result; // adjusting file actual size
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
     }
-
-    return no_of_bytes;
+    return hash;
 }
 
-int truncate_file(char *file_name, int size)
+void build_command_table()
 {
-    int file_desc;
-    struct inode *inode_ptr = inode_head;
-    struct filetable *filetable_ptr = NULL;
+    unsigned int slot;
+    unsigned int counter;
 
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
-
-    while (inode_ptr != NULL)
+    for (counter = 0; counter < sizeof(commands) / sizeof(commands[0]); counter++)
     {
-        if (!strcmp(inode_ptr->file_name, file_name)) // searching file
-        {
-            if (size <= inode_ptr->file_actual_size)
-            {
-                memset(inode_ptr->file_data + size, 0, inode_ptr->file_actual_size - size); // truncating data w.r.t 'size'
-                inode_ptr->file_actual_size = size;                                         // adjusting actual size of file
-            }
-            else // if size is greater than the actual size of file
-            {
-                inode_ptr->file_actual_size = size;                           // file actual size will increase because size is greater than actual size of file
-                memset(inode_ptr->file_data, 0, inode_ptr->file_actual_size); // truncating data
-            }
-            if (is_open(file_name)) // if file is open
-            {
-                file_desc = get_file_desc(file_name);
-                filetable_ptr = ufdt_array[file_desc].ptr_filetable;
-
-                if (filetable_ptr->write_offset > size) // if write offset is greater than the given 'size'
-                    filetable_ptr->write_offset = size; // adjust write offset from file table
-                if (filetable_ptr->read_offset > size)  // if read offset is greater than the given 'size'
-                    filetable_ptr->read_offset = size;  // adjust read offset from file table
-            }
-        }
-        inode_ptr = inode_ptr->next_inode;
+        slot = command_hash(commands[counter].name) & (COMMAND_TABLE_SIZE - 1);
+        while (command_table[slot] != NULL)
+            slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1);
+        command_table[slot] = &commands[counter];
     }
-    return 0; // success
 }
 
-struct inode *get_existing_inode(char *file_name)
+struct command *find_command(const char *name)
 {
-    struct inode *inode_ptr = inode_head;
+    unsigned int slot = command_hash(name) & (COMMAND_TABLE_SIZE - 1);
 
-    while (inode_ptr != NULL)
+    while (command_table[slot] != NULL)
     {
-        if (!strcmp(inode_ptr->file_name, file_name))
-            return inode_ptr;
-        inode_ptr = inode_ptr->next_inode;
+        if (!strcmp(command_table[slot]->name, name))
+            return command_table[slot];
+        slot = (slot + 1) & (COMMAND_TABLE_SIZE - 1);
     }
     return NULL;
 }
 
-int open_file(char *file_name, int mode)
+// splits 'line' in place at white space, with 'rest_of_line' the last of 'max_tokens' tokens keeps rest of line
+// returns number of tokens, max_tokens + 1 if line has more tokens
+int split_line(char *line, char *tokens[], int max_tokens, int rest_of_line)
 {
-    int counter;
-    struct inode *inode_ptr = NULL;
-    struct filetable *filetable_ptr = NULL;
+    int count = 0;
 
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
+    while (1)
+    {
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (*line == '\0' || *line == '\n' || *line == '\r')
+            return count;
 
-    if (mode < 1 || mode > 7)
-        return -2; // invalid opening mode
+        if (count == max_tokens)
+            return max_tokens + 1;
+        tokens[count++] = line;
 
-    inode_ptr = get_existing_inode(file_name);
+        if (rest_of_line && count == max_tokens)
+        {
+            line[strcspn(line, "\r\n")] = '\0';
+            return count;
+        }
 
-    if (((inode_ptr->permission == READ) && (mode == WRITE || mode == (READ + WRITE) || mode == (WRITE + APPEND) || mode == (READ + WRITE + APPEND))) || ((inode_ptr->permission == WRITE) && (mode == READ || mode == (READ + WRITE) || mode == (READ + APPEND) || (READ + WRITE + APPEND))))
-        // checking if the permissions are
-        return -3; // don't have permissions to open
+        while (*line != '\0' && *line != ' ' && *line != '\t' && *line != '\n' && *line != '\r')
+            line++;
+        if (*line == '\0')
+            return count;
+        *line++ = '\0';
+    }
+}
 
-    for (counter = 0; counter < MAX_INODES; counter++)
+void run_command(char *line)
+{
+    int count;
+    char *tokens[MAX_TOKENS];
+    char *name;
+    struct command *command_ptr;
+
+    while (*line == ' ' || *line == '\t')
+        line++;
+    name = line;
+    line += strcspn(line, " \t\r\n");
+    if (line == name)
+        return; // empty line
+
+    if (*line != '\0')
+        *line++ = '\0';
+
+    command_ptr = find_command(name);
+    if (command_ptr == NULL)
     {
-        if (ufdt_array[counter].ptr_filetable == NULL)
-            break;
+        printf("ERROR: Command '%s' not found.\n", name);
+        return;
     }
 
-    ufdt_array[counter].ptr_filetable = (filetable *)malloc(sizeof(filetable));
-    filetable_ptr = ufdt_array[counter].ptr_filetable;
-
-    if (filetable_ptr == NULL)
-        return -4; // memory allocation failed
-
-    filetable_ptr->read_offset = 0;                // set read offset to 0
-    filetable_ptr->mode = mode;                    // set file opening mode in file table
-    filetable_ptr->reference_count = 1;            // set reference count hardcoded 1
-    filetable_ptr->ptr_inode = inode_ptr;          // pointer pointing to inode
-    (filetable_ptr->ptr_inode->reference_count)++; // inode reference count will increment
-
-    if (mode == READ + APPEND || mode == APPEND || mode == WRITE + APPEND || mode == READ + WRITE + APPEND) // if append opned in append mode
-        filetable_ptr->write_offset = filetable_ptr->ptr_inode->file_actual_size;                           // then set write offset to end of the file
-    else
-        filetable_ptr->write_offset = 0; // else set write offset to 0
-
-    return counter;
+    tokens[0] = name;
+    count = 1 + split_line(line, tokens + 1, command_ptr->max_tokens - 1, command_ptr->rest_of_line);
+    if (count < command_ptr->min_tokens || count > command_ptr->max_tokens)
+    {
+        printf("ERROR: Invalid number of arguments for '%s' (see 'man %s').\n", name, name);
+        return;
+    }
+    command_ptr->run(count, tokens);
 }
 
-int read_file(char *file_name, int byte_to_read)
+void stop_server(int signal_number)
 {
-    int file_desc;
-    int read_bytes;
-    int remaining_bytes = 0;
-    struct inode *inode_ptr = NULL;
-    struct filetable *filetable_ptr = NULL;
-
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
+    cvfs_server_stop();
+}
 
-    if (!is_open(file_name))
-        return -2; // file is not opened
+// serves file system on 'socket_path' until SIGINT or SIGTERM
+void serve(char *socket_path)
+{
+    int status;
 
-    file_desc = get_file_desc(file_name);
-    filetable_ptr = ufdt_array[file_desc].ptr_filetable; // for efficiency
-    inode_ptr = filetable_ptr->ptr_inode;                // for efficiency
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    printf("Serving on '%s' (Ctrl+C stops).\n", socket_path);
+    fflush(stdout);
 
-    if ((filetable_ptr->mode != READ) && (filetable_ptr->mode != READ + WRITE) && (filetable_ptr->mode != READ + APPEND) && (filetable_ptr->mode != READ + WRITE + APPEND))
-        return -3; // don't have pemission to read
+    status = cvfs_serve(socket_path);
+    if (status == -1)
+        printf("ERROR: Could not listen on '%s'.\n", socket_path);
+    else if (status == -2)
+        printf("ERROR: Could not start server.\n");
+}
 
-    if (inode_ptr->file_actual_size == filetable_ptr->read_offset) // there are no more bytes to read
-        return END_OF_FILE;                                        // end of file
+int main(int argc, char *argv[])
+{
+    int counter;
+    int status;
+    int checkpoint_interval = 0;
+    int journal_latency = -1;
+    int max_inodes = 0;
+    int max_blocks = 0;
+    int block_size = 0;
+    int dedup = 0;
+    long long memory_budget = 0;
+    char *backing_path = NULL;
+    char *batch_path = NULL;
+    char *socket_path = NULL;
+    char line[MAX_LINE];
+
+    input_file = stdin;
+    for (counter = 1; counter < argc; counter++)
+    {
+        if (!strcmp(argv[counter], "--image") && counter + 1 < argc)
+            image_path = argv[++counter];
+        else if (!strcmp(argv[counter], "--shared") && counter + 1 < argc)
+            segment_name = argv[++counter];
+        else if (!strcmp(argv[counter], "--checkpoint") && counter + 1 < argc)
+            checkpoint_interval = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--journal") && counter + 1 < argc)
+            journal_latency = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--inodes") && counter + 1 < argc)
+            max_inodes = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--blocks") && counter + 1 < argc)
+            max_blocks = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--block-size") && counter + 1 < argc)
+            block_size = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--compress"))
+            cvfs_set_compression(1);
+        else if (!strcmp(argv[counter], "--dedup"))
+            dedup = 1;
+        else if (!strcmp(argv[counter], "--memory-budget") && counter + 1 < argc)
+            memory_budget = atoll(argv[++counter]) * 1024 * 1024;
+        else if (!strcmp(argv[counter], "--backing-file") && counter + 1 < argc)
+            backing_path = argv[++counter];
+        else if (!strcmp(argv[counter], "--server") && counter + 1 < argc)
+            socket_path = argv[++counter];
+        else if (!strcmp(argv[counter], "--batch"))
+        {
+            batch_mode = 1;
+            if (counter + 1 < argc && strncmp(argv[counter + 1], "--", 2) != 0)
+                batch_path = argv[++counter];
+        }
+        else
+        {
+            printf("Usage: %s [--image <image_file> [--checkpoint <seconds>] [--journal <commit_latency_ms>]] [--batch [<command_file>]]\n", argv[0]);
+            printf("       [--shared <segment_name>]   (file system in a shared memory segment other processes mount too)\n");
+            printf("       [--inodes <count>] [--blocks <count>] [--block-size <bytes>]   (sizes of a new file system)\n");
+            printf("       [--compress] [--dedup]   (data of new files is kept compressed / equal blocks are stored once)\n");
+            printf("       [--memory-budget <megabytes> --backing-file <file>]   (blocks beyond budget are kept in file on host)\n");
+            printf("       [--server <socket_path>]   (serves file system to other processes instead of reading commands)\n");
+            return 1;
+        }
+    }
 
-    remaining_bytes = (inode_ptr->file_actual_size - filetable_ptr->read_offset); // how many bytes remaining to read
-    remaining_bytes -= byte_to_read;                                              // for checking sufficient bytes are present to read
+    if (segment_name != NULL && (image_path != NULL || dedup))
+    {
+        printf("ERROR: A shared memory segment can not be used with an image or with deduplication.\n");
+        return 1;
+    }
 
-    if (remaining_bytes < 0)
+    if ((memory_budget != 0 || backing_path != NULL) && (image_path != NULL || segment_name != NULL))
     {
-        byte_to_read = byte_to_read - (-remaining_bytes);                                                          // if not sufficient bytes are present then read bytes all the remaining bytes
-        read_bytes = write(1, (filetable_ptr->ptr_inode->file_data) + (filetable_ptr->read_offset), byte_to_read); // print data on console
-        printf("\n");
+        printf("ERROR: A memory budget can only be used when file system is kept in memory.\n");
+        return 1;
     }
-    else
+    if ((memory_budget != 0 || backing_path != NULL) &&
+        (memory_budget <= 0 || backing_path == NULL || cvfs_set_memory_budget(memory_budget, backing_path) != 0))
     {
-        read_bytes = write(1, (filetable_ptr->ptr_inode->file_data) + (filetable_ptr->read_offset), byte_to_read); // normally print data on console
-        printf("\n");
+        printf("ERROR: A memory budget needs a size above 0 and a backing file.\n");
+        return 1;
     }
-    filetable_ptr->read_offset += byte_to_read; // update the read offset of file
 
-    return read_bytes; // no bytes read
-}
-
-int lseek(char *file_name, int offset, int whence)
-{
-    int result;
-    int file_desc;
-    struct inode *inode_ptr = NULL;
-    struct filetable *filetable_ptr = NULL;
-
-    if (!is_file_exists(file_name))
-        return -1; // there is no such file
-
-    if (!is_open(file_name))
-        return -2; // file is not opened
-
-    if (whence >= 3)
-        return -3; // invalid argument
+    if ((max_inodes != 0 || max_blocks != 0 || block_size != 0) && cvfs_configure(max_inodes, max_blocks, block_size) != 0)
+    {
+        printf("ERROR: Invalid file system size.\n");
+        return 1;
+    }
 
-    file_desc = get_file_desc(file_name);
+    if (dedup && cvfs_set_dedup(1) != 0)
+    {
+        printf("Memory allocation FAILED\n");
+        return 1;
+    }
 
-    filetable_ptr = ufdt_array[file_desc].ptr_filetable;
-    inode_ptr = filetable_ptr->ptr_inode;
+    if (batch_path != NULL && strcmp(batch_path, "-") != 0 && (input_file = fopen(batch_path, "r")) == NULL)
+    {
+        printf("ERROR: Could not open '%s'.\n", batch_path);
+        return 1;
+    }
+    if (batch_mode)
+    {
+        // nothing is interactive, so input and output are read and written in large pieces
+        setvbuf(input_file, NULL, _IOFBF, 1 << 20);
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }
+    build_command_table();
 
-    if (whence == SEEK_SET) // from 0
+    if (!batch_mode)
+        clear_screen();
+    if (segment_name != NULL)
     {
-        if (offset >= 0)
+        status = cvfs_mount_shared(segment_name);
+        if (status == -1)
         {
-            result = inode_ptr->file_actual_size - offset;
-
-            if (result < 0) // if offset is greater than file size
-            {
-                memset((inode_ptr->file_data + inode_ptr->file_actual_size), ' ', (-result)); // jar file size peksha jast asel offset tr je extra bytes ahet tevdhe white space characters taka mhnje calculations gandnar nahit
-                inode_ptr->file_actual_size += (-result);                                     // adjust file actual size
-            }
-            filetable_ptr->read_offset = filetable_ptr->write_offset = offset; // set read & write offset
-            return filetable_ptr->read_offset;
+            printf("ERROR: Could not open shared memory segment '%s'.\n", segment_name);
+            return 1;
         }
-        else
-            return -3; // invalid argument
+        if (status == -2)
+        {
+            printf("ERROR: '%s' is not a shared memory segment of this file system.\n", segment_name);
+            return 1;
+        }
+        if (!batch_mode)
+            printf("Shared memory segment '%s' mounted successfully.\n", segment_name);
     }
-    else if (whence == SEEK_END) // from end of file
+    else if (image_path == NULL)
     {
-        if (inode_ptr->file_actual_size < inode_ptr->file_actual_size + offset) // if offset is greater than file actual size
+        status = cvfs_init();
+        if (status != 0 && backing_path != NULL)
         {
-            memset((inode_ptr->file_data + inode_ptr->file_actual_size), ' ', offset);
-            inode_ptr->file_actual_size += offset;                                                  // increase file actual size
-            filetable_ptr->read_offset = filetable_ptr->write_offset = inode_ptr->file_actual_size; // adjust read and write offset if offset is greater than file actual size
+            printf("ERROR: Could not create backing file '%s'.\n", backing_path);
+            return 1;
         }
-        else
+        if (status != 0)
         {
-            if (inode_ptr->file_actual_size + offset < 0)
-                return -3;                                                                                   //    invalid argument
-            filetable_ptr->read_offset = filetable_ptr->write_offset = inode_ptr->file_actual_size + offset; // adjust read and write offset if offset is less than file actual size
+            printf("Memory allocation FAILED\n");
+            return 1;
         }
-        return filetable_ptr->read_offset;
+        if (!batch_mode)
+            printf("DILB created successfully.\n");
     }
-    else // for current scenario
+    else
     {
-        return 0; // temporary returned 0, but i have to write the code later.
+        if (journal_latency >= 0 && cvfs_set_journal(journal_latency) != 0)
+        {
+            printf("ERROR: Invalid commit latency.\n");
+            return 1;
+        }
+
+        status = cvfs_mount(image_path);
+        if (status == -1)
+        {
+            printf("ERROR: Could not open image '%s'.\n", image_path);
+            return 1;
+        }
+        if (status == -2)
+        {
+            printf("ERROR: '%s' is not an image of this file system.\n", image_path);
+            return 1;
+        }
+        if (checkpoint_interval > 0)
+            cvfs_set_checkpoint_interval(checkpoint_interval);
+        if (!batch_mode)
+            printf("Image '%s' mounted successfully.\n", image_path);
+    }
+    if (socket_path != NULL)
+    {
+        serve(socket_path);
+        command_exit(0, NULL);
     }
-}
 
-int main(void)
-{
-    int status;
-    int file_desc;
-    int token_count;
-    int no_of_bytes;
-    char str[80];
-    char file_data[1024];
-    char command[4][50];
-    clear_screen();
-    create_dilb();
-    initialize_superblock();
     // sleep(2);
-    clear_screen();
+    if (!batch_mode)
+        clear_screen();
 
     while (1)
     {
-        // fflush(stdin);
-        printf("\033[1;32mubuntu@linuxuser\033[0m"); // Green text
-        printf(":");
-        printf("\033[1;34m~/Desktop/Customized_Virtual_File_System\033[0m"); // blue text
-        printf("$ ");
-
-        fgets(str, 80, stdin);
-
-        token_count = sscanf(str, "%s %s %s %s", command[0], command[1], command[2], command[3]);
-
-        if (token_count == 1)
+        if (!batch_mode)
         {
-            if (!strcmp(command[0], "ls"))
-                display_file_list();
-
-            else if (!strcmp(command[0], "closeall"))
-                close_all_files();
-
-            else if (!strcmp(command[0], "clear"))
-                clear_screen();
-
-            else if (!strcmp(command[0], "help"))
-                display_commands();
+            printf("\033[1;32mubuntu@linuxuser\033[0m"); // Green text
+            printf(":");
+            printf("\033[1;34m~/Desktop/Customized_Virtual_File_System\033[0m"); // blue text
+            printf("$ ");
+        }
 
-            else if (!strcmp(command[0], "backup"))
-                backup_all_files();
+        if (fgets(line, sizeof(line), input_file) == NULL)
+            break; // end of input behaves like 'exit'
 
-            else if (!strcmp(command[0], "exit"))
-                exit(0);
-            else
-                printf("ERROR: Command '%s' not found.\n", command[0]);
-        }
-        else if (token_count == 2)
-        {
-            if (!strcmp(command[0], "stat"))
-                stat(command[1]);
-            else if (!strcmp(command[0], "fstat"))
-                fstat(atoi(command[1]));
-            else if (!strcmp(command[0], "man"))
-                manual(command[1]);
-            else if (!strcmp(command[0], "close"))
-            {
-                status = close_file(atoi(command[1]));
-
-                if (status == -1)
-                    printf("ERROR: There is no such file or File already closed.\n");
-                else
-                    printf("File closed successfully.\n");
-            }
-            else if (!strcmp(command[0], "rm"))
-            {
-                status = delete_file(command[1]);
-
-                if (status == -1)
-                    printf("ERROR: There is no such file.\n");
-                else
-                    printf("File deleted successfully.\n");
-            }
-            else if (!strcmp(command[0], "write"))
-            {
-                if (!is_file_exists(command[1]))
-                {
-                    printf("ERROR: There is no such file.\n");
-                    continue;
-                }
-
-                if (!is_open(command[1]))
-                {
-                    printf("ERROR: File is not opened.\n");
-                    continue;
-                }
-
-                printf("Enter the data: ");
-                scanf("%[^\n]%*c", file_data);
-
-                no_of_bytes = strlen(file_data);
-
-                status = write_file(command[1], file_data, no_of_bytes);
-
-                if (status == -3)
-                    printf("ERROR: Permission denied to write to the file.\n");
-                else if (status == -4)
-                    printf("ERROR: The file is not a regular file.\n");
-                else if (status == -5)
-                    printf("ERROR: There is not enough space to write to the file.\n");
-                else
-                    printf("Successfully wrote %d bytes to '%s'.\n", status, command[1]);
-            }
-            else
-                printf("ERROR: Command '%s' not found.\n", command[0]);
-        }
-        else if (token_count == 3)
-        {
-            if (!strcmp(command[0], "create"))
-            {
-                file_desc = create_file(command[1], atoi(command[2]));
-
-                if (file_desc == -1)
-                    printf("ERROR: Incorrect parameters.\n");
-                else if (file_desc == -2)
-                    printf("ERROR: There is no free space.\n");
-                else if (file_desc == -3)
-                    printf("ERROR: File already exists.\n");
-                else if (file_desc == -4)
-                    printf("ERROR: Something went wrong.\n");
-                else
-                    printf("'%s' successfully created with file descriptor %d.\n", command[1], file_desc);
-            }
-            else if (!strcmp(command[0], "truncate"))
-            {
-                status = truncate_file(command[1], atoi(command[2]));
-
-                if (status == -1)
-                    printf("ERROR: There is no such file.\n");
-                else
-                    printf("Data truncated successfully.\n");
-            }
-            else if (!strcmp(command[0], "open"))
-            {
-                file_desc = open_file(command[1], atoi(command[2]));
-
-                if (file_desc == -1)
-                    printf("ERROR: There is no such file.\n");
-                else if (file_desc == -2)
-                    printf("ERROR: Invalid opening mode.\n");
-                else if (file_desc == -3)
-                    printf("ERROR: There is no permission for this opening mode.\n");
-                else if (file_desc == -4)
-                    printf("ERROR: Something went wrong.\n");
-                else
-                    printf("'%s' opened with file descriptor %d\n", command[1], file_desc);
-            }
-            else if (!strcmp(command[0], "read"))
-            {
-                status = read_file(command[1], atoi(command[2]));
-
-                if (status == -1)
-                    printf("ERROR: There is no such file.\n");
-                else if (status == -2)
-                    printf("ERROR: File is not opened.\n");
-                else if (status == -3)
-                    printf("ERROR: Permission denied to read from the file.\n");
-                else if (status == END_OF_FILE)
-                    printf("ERROR : There is no more data to read.\n");
-            }
-            else
-                printf("ERROR: Command '%s' not found.\n", command[0]);
-        }
-        else if (token_count == 4)
-        {
-            if (!strcmp(command[0], "lseek"))
-            {
-                status = lseek(command[1], atoi(command[2]), atoi(command[3]));
-
-                if (status == -1)
-                    printf("ERROR: There is no such file.\n");
-                else if (status == -2)
-                    printf("ERROR: File is not opened.\n");
-                else if (status == -3)
-                    printf("ERROR: Invalid arguments.\n");
-                else
-                    printf("Success\n");
-            }
-            else
-                printf("ERROR: Command '%s' not found.\n", command[0]);
-        }
-        else
-            printf("ERROR: Invalid command.\n");
+        run_command(line);
     }
+
+    command_exit(0, NULL);
     return 0;
 }
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../cvfs.h"
+
+#define FILE_BYTES (8 * 1024 * 1024) // size of every file read by benchmark
+#define IO_SIZE 4096                  // bytes moved by one call
+#define MAX_THREADS 32
+
+struct reader
+{
+    int fd;                 // descriptor this thread reads from
+    unsigned int seed;      // for random offsets
+    long long operations;   // completed calls
+    volatile int *stop;     // set by main thread when time is over
+};
+
+double now_seconds()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *read_worker(void *argument)
+{
+    struct reader *reader_ptr = (struct reader *)argument;
+    char buffer[IO_SIZE];
+    long long offset;
+
+    while (!*(reader_ptr->stop))
+    {
+        offset = (rand_r(&(reader_ptr->seed)) % (FILE_BYTES / IO_SIZE)) * (long long)IO_SIZE;
+        if (cvfs_pread(reader_ptr->fd, buffer, IO_SIZE, offset) != IO_SIZE)
+        {
+            printf("ERROR: pread failed.\n");
+            exit(1);
+        }
+        reader_ptr->operations++;
+    }
+    return NULL;
+}
+
+int create_test_file(const char *file_name)
+{
+    int fd;
+    long long written;
+    char buffer[IO_SIZE];
+
+    memset(buffer, 'x', sizeof(buffer));
+    fd = cvfs_create(file_name, READ + WRITE);
+    if (fd < 0)
+        return fd;
+
+    for (written = 0; written < FILE_BYTES; written += IO_SIZE)
+    {
+        if (cvfs_write(fd, buffer, IO_SIZE) != IO_SIZE)
+            return -1;
+    }
+    return fd;
+}
+
+// every thread calls cvfs_pread() on its own descriptor, either on its own file or all on one shared file
+void run_read_scaling(int max_threads, double seconds, int shared_file)
+{
+    int counter;
+    int threads;
+    int fds[MAX_THREADS];
+    char file_name[MAX_FILE_NAME];
+    double start;
+    double elapsed;
+    double single = 0;
+    long long total;
+    volatile int stop;
+    pthread_t thread_ids[MAX_THREADS];
+    struct reader readers[MAX_THREADS];
+
+    for (counter = 0; counter < max_threads; counter++)
+    {
+        if (shared_file && counter > 0)
+            fds[counter] = cvfs_open("shared", READ);
+        else
+        {
+            snprintf(file_name, sizeof(file_name), shared_file ? "shared" : "private_%d", counter);
+            fds[counter] = create_test_file(file_name);
+        }
+
+        if (fds[counter] < 0)
+        {
+            printf("ERROR: Could not prepare file for thread %d.\n", counter);
+            exit(1);
+        }
+    }
+
+    printf("\nread scaling, %s file per thread, %d byte pread\n", shared_file ? "one shared" : "one private", IO_SIZE);
+    printf("threads\tops/sec\t\tMB/sec\t\tspeedup\n");
+
+    for (threads = 1; threads <= max_threads; threads *= 2)
+    {
+        stop = 0;
+        for (counter = 0; counter < threads; counter++)
+        {
+            readers[counter].fd = fds[counter];
+            readers[counter].seed = counter + 1;
+            readers[counter].operations = 0;
+            readers[counter].stop = &stop;
+        }
+
+        start = now_seconds();
+        for (counter = 0; counter < threads; counter++)
+            pthread_create(&thread_ids[counter], NULL, read_worker, &readers[counter]);
+
+        usleep((useconds_t)(seconds * 1e6));
+        stop = 1;
+
+        total = 0;
+        for (counter = 0; counter < threads; counter++)
+        {
+            pthread_join(thread_ids[counter], NULL);
+            total += readers[counter].operations;
+        }
+        elapsed = now_seconds() - start;
+
+        if (threads == 1)
+            single = total / elapsed;
+        printf("%d\t%.0f\t%.1f\t\t%.2fx\n", threads, total / elapsed, total / elapsed * IO_SIZE / (1024 * 1024), (total / elapsed) / single);
+    }
+
+    cvfs_close_all();
+    if (shared_file)
+        cvfs_unlink("shared");
+    else
+    {
+        for (counter = 0; counter < max_threads; counter++)
+        {
+            snprintf(file_name, sizeof(file_name), "private_%d", counter);
+            cvfs_unlink(file_name);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int counter;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    double seconds = 1.0;
+
+    for (counter = 1; counter < argc; counter++)
+    {
+        if (!strcmp(argv[counter], "--threads") && counter + 1 < argc)
+            max_threads = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--seconds") && counter + 1 < argc)
+            seconds = atof(argv[++counter]);
+        else
+        {
+            printf("Usage: %s [--threads <max_threads>] [--seconds <seconds_per_step>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+
+    if (cvfs_init() != 0)
+    {
+        printf("Memory allocation FAILED\n");
+        return 1;
+    }
+
+    run_read_scaling(max_threads, seconds, 0);
+    run_read_scaling(max_threads, seconds, 1);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../cvfs_client.h"
+
+#define FILE_BYTES (8 * 1024 * 1024) // size of file every client reads and writes
+#define MAX_CLIENTS 256
+#define MAX_DEPTH 1024
+#define MAX_SAMPLES 200000           // batch latencies kept per client
+
+struct load_client
+{
+    int number;
+    unsigned int seed;          // for random offsets and choice of reads and writes
+    long long operations;       // completed calls
+    long long errors;           // calls which did not move every byte
+    double *samples;            // latency of every batch in microseconds
+    long long sample_count;
+    volatile int *stop;         // set by main thread when time is over
+};
+
+const char *socket_path = NULL;
+int depth = 16;                 // calls sent before their responses are read
+int io_size = 4096;
+int write_percent = 0;
+pthread_barrier_t ready;        // clients wait here until every file is written, time is measured from then on
+
+double now_seconds()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_double(const void *first, const void *second)
+{
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+
+    return (a > b) - (a < b);
+}
+
+// every client has its own file and connection, calls go out 'depth' at a time
+void *client_worker(void *argument)
+{
+    struct load_client *load_ptr = (struct load_client *)argument;
+    struct cvfs_client *client = cvfs_connect(socket_path);
+    struct cvfs_call calls[MAX_DEPTH];
+    char file_name[MAX_FILE_NAME];
+    char *buffers;
+    int counter;
+    int fd;
+    long long offset;
+    double start;
+
+    buffers = (char *)malloc((long long)depth * io_size);
+    if (client == NULL || buffers == NULL)
+    {
+        printf("ERROR: Could not connect to '%s'.\n", socket_path);
+        exit(1);
+    }
+    memset(buffers, 'x', (long long)depth * io_size);
+
+    snprintf(file_name, sizeof(file_name), "load_%d", load_ptr->number);
+    cvfs_client_unlink(client, file_name);
+    fd = cvfs_client_create(client, file_name, READ + WRITE);
+    for (offset = 0; fd >= 0 && offset < FILE_BYTES; offset += io_size)
+        cvfs_client_write(client, fd, buffers, io_size);
+    if (fd < 0)
+    {
+        printf("ERROR: Could not create '%s'.\n", file_name);
+        exit(1);
+    }
+    pthread_barrier_wait(&ready);
+
+    while (!*(load_ptr->stop))
+    {
+        for (counter = 0; counter < depth; counter++)
+        {
+            calls[counter].op = ((int)(rand_r(&(load_ptr->seed)) % 100) < write_percent) ? CVFS_OP_PWRITE : CVFS_OP_PREAD;
+            calls[counter].fd = fd;
+            calls[counter].offset = (rand_r(&(load_ptr->seed)) % (FILE_BYTES / io_size)) * (long long)io_size;
+            calls[counter].buffer = buffers + (long long)counter * io_size;
+            calls[counter].count = io_size;
+        }
+
+        start = now_seconds();
+        if (cvfs_client_batch(client, calls, depth) != 0)
+        {
+            printf("ERROR: Connection to server failed.\n");
+            exit(1);
+        }
+        if (load_ptr->sample_count < MAX_SAMPLES)
+            load_ptr->samples[load_ptr->sample_count++] = (now_seconds() - start) * 1e6;
+
+        for (counter = 0; counter < depth; counter++)
+        {
+            if (calls[counter].result != io_size)
+                load_ptr->errors++;
+        }
+        load_ptr->operations += depth;
+    }
+
+    cvfs_client_close(client, fd);
+    cvfs_client_unlink(client, file_name);
+    cvfs_disconnect(client);
+    free(buffers);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int counter;
+    int clients = 8;
+    long long total = 0;
+    long long errors = 0;
+    long long sample_total = 0;
+    double seconds = 5;
+    double start;
+    double elapsed;
+    double *samples;
+    volatile int stop = 0;
+    pthread_t thread_ids[MAX_CLIENTS];
+    struct load_client *load_clients;
+
+    for (counter = 1; counter < argc; counter++)
+    {
+        if (!strcmp(argv[counter], "--socket") && counter + 1 < argc)
+            socket_path = argv[++counter];
+        else if (!strcmp(argv[counter], "--clients") && counter + 1 < argc)
+            clients = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--depth") && counter + 1 < argc)
+            depth = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--size") && counter + 1 < argc)
+            io_size = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--write-percent") && counter + 1 < argc)
+            write_percent = atoi(argv[++counter]);
+        else if (!strcmp(argv[counter], "--seconds") && counter + 1 < argc)
+            seconds = atof(argv[++counter]);
+        else
+            socket_path = NULL, counter = argc;
+    }
+
+    if (socket_path == NULL || clients < 1 || clients > MAX_CLIENTS || depth < 1 || depth > MAX_DEPTH ||
+        io_size < 1 || io_size > FILE_BYTES || seconds <= 0)
+    {
+        printf("Usage: %s --socket <socket_path> [--clients <1-%d>] [--depth <1-%d>] [--size <bytes>]\n", argv[0], MAX_CLIENTS, MAX_DEPTH);
+        printf("       [--write-percent <0-100>] [--seconds <seconds>]\n");
+        return 1;
+    }
+
+    load_clients = (struct load_client *)calloc(clients, sizeof(struct load_client));
+    samples = (double *)malloc((long long)clients * MAX_SAMPLES * sizeof(double));
+    if (load_clients == NULL || samples == NULL)
+    {
+        printf("Memory allocation FAILED\n");
+        return 1;
+    }
+
+    for (counter = 0; counter < clients; counter++)
+    {
+        load_clients[counter].number = counter;
+        load_clients[counter].seed = counter + 1;
+        load_clients[counter].samples = samples + (long long)counter * MAX_SAMPLES;
+        load_clients[counter].stop = &stop;
+    }
+
+    pthread_barrier_init(&ready, NULL, clients + 1);
+    for (counter = 0; counter < clients; counter++)
+        pthread_create(&thread_ids[counter], NULL, client_worker, &load_clients[counter]);
+    pthread_barrier_wait(&ready);
+    start = now_seconds();
+    usleep((useconds_t)(seconds * 1e6));
+    stop = 1;
+    elapsed = now_seconds() - start; // last batches finishing after this are not counted in time, a small error
+
+    for (counter = 0; counter < clients; counter++)
+    {
+        pthread_join(thread_ids[counter], NULL);
+        total += load_clients[counter].operations;
+        errors += load_clients[counter].errors;
+        memmove(samples + sample_total, load_clients[counter].samples, load_clients[counter].sample_count * sizeof(double));
+        sample_total += load_clients[counter].sample_count;
+    }
+    qsort(samples, sample_total, sizeof(double), compare_double);
+
+    printf("clients\tdepth\tsize\twrites\tops/sec\t\tMB/sec\t\tbatch p50 us\tbatch p99 us\terrors\n");
+    printf("%d\t%d\t%d\t%d%%\t%.0f\t%.1f\t\t%.1f\t\t%.1f\t\t%lld\n", clients, depth, io_size, write_percent, total / elapsed,
+           total / elapsed * io_size / (1024 * 1024), sample_total ? samples[sample_total / 2] : 0, sample_total ? samples[sample_total * 99 / 100] : 0, errors);
+    return 0;
+}
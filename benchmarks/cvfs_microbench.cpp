@@ -0,0 +1,738 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../cvfs.h"
+
+#define MAX_SAMPLES 4000000     // latency samples kept per benchmark
+#define MAX_IO_SIZE (1024 * 1024)
+#define WRAP_SIZE (64LL * 1024 * 1024) // files written by benchmarks are truncated once they reach this size
+
+enum output_format
+{
+    FORMAT_TABLE,
+    FORMAT_JSON,
+    FORMAT_CSV
+};
+
+struct result
+{
+    char name[128];
+    long long iterations;
+    double seconds;      // time spent in measured calls
+    long long bytes;     // bytes moved by measured calls (0 for metadata calls)
+    long long errors;    // calls which returned an unexpected value
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+struct benchmark_run
+{
+    struct result result;
+    double *samples;      // latency of every measured call in nanoseconds
+    long long sample_count;
+    double time_budget;  // seconds of measured calls after which benchmark stops
+};
+
+double min_time = 0.2; // seconds per benchmark
+const char *filter = NULL;
+enum output_format format = FORMAT_TABLE;
+int result_count = 0;
+char io_buffer[MAX_IO_SIZE];
+
+double now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int compare_double(const void *first, const void *second)
+{
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+
+    return (a > b) - (a < b);
+}
+
+double percentile(struct benchmark_run *run, double fraction)
+{
+    long long index = (long long)(fraction * (run->sample_count - 1));
+
+    return run->sample_count ? run->samples[index] : 0;
+}
+
+// returns 0 when benchmark with this name is filtered out
+int begin(struct benchmark_run *run, const char *name)
+{
+    if (filter != NULL && strstr(name, filter) == NULL)
+        return 0;
+
+    memset(&(run->result), 0, sizeof(run->result));
+    snprintf(run->result.name, sizeof(run->result.name), "%s", name);
+    run->sample_count = 0;
+    run->time_budget = min_time * 1e9;
+    return 1;
+}
+
+// measured call is between now_ns() in caller and record(), returns 0 once enough time was measured
+int record(struct benchmark_run *run, double start_ns, long long bytes, int ok)
+{
+    double elapsed = now_ns() - start_ns;
+
+    if (run->sample_count < MAX_SAMPLES)
+        run->samples[run->sample_count++] = elapsed;
+    run->result.iterations++;
+    run->result.seconds += elapsed / 1e9;
+    run->result.bytes += bytes;
+    if (!ok)
+        run->result.errors++;
+    return run->result.seconds * 1e9 < run->time_budget && run->sample_count < MAX_SAMPLES;
+}
+
+void report(struct benchmark_run *run)
+{
+    struct result *result = &(run->result);
+    double ops = result->seconds > 0 ? result->iterations / result->seconds : 0;
+
+    qsort(run->samples, run->sample_count, sizeof(double), compare_double);
+    result->p50_ns = percentile(run, 0.50);
+    result->p90_ns = percentile(run, 0.90);
+    result->p99_ns = percentile(run, 0.99);
+    result->p999_ns = percentile(run, 0.999);
+    result->max_ns = run->sample_count ? run->samples[run->sample_count - 1] : 0;
+
+    if (format == FORMAT_TABLE)
+    {
+        if (result_count == 0)
+            printf("%-40s %12s %14s %10s %10s %10s %10s %10s %10s\n", "benchmark", "iterations", "ops/sec", "MB/sec", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "errors");
+        printf("%-40s %12lld %14.0f %10.1f %10.0f %10.0f %10.0f %10.0f %10lld\n", result->name, result->iterations, ops,
+               result->seconds > 0 ? result->bytes / result->seconds / (1024 * 1024) : 0, result->p50_ns, result->p99_ns, result->p999_ns, result->max_ns, result->errors);
+    }
+    else if (format == FORMAT_CSV)
+    {
+        if (result_count == 0)
+            printf("name,iterations,ops_per_second,bytes_per_second,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,errors\n");
+        printf("%s,%lld,%.1f,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f,%lld\n", result->name, result->iterations, ops,
+               result->seconds > 0 ? result->bytes / result->seconds : 0, result->p50_ns, result->p90_ns, result->p99_ns, result->p999_ns, result->max_ns, result->errors);
+    }
+    else
+    {
+        printf("%s    {\n", result_count ? ",\n" : "");
+        printf("      \"name\": \"%s\",\n", result->name);
+        printf("      \"iterations\": %lld,\n", result->iterations);
+        printf("      \"real_time_seconds\": %.9f,\n", result->seconds);
+        printf("      \"ops_per_second\": %.1f,\n", ops);
+        printf("      \"bytes_per_second\": %.1f,\n", result->seconds > 0 ? result->bytes / result->seconds : 0);
+        printf("      \"p50_ns\": %.0f,\n      \"p90_ns\": %.0f,\n      \"p99_ns\": %.0f,\n      \"p999_ns\": %.0f,\n      \"max_ns\": %.0f,\n",
+               result->p50_ns, result->p90_ns, result->p99_ns, result->p999_ns, result->max_ns);
+        printf("      \"errors\": %lld\n    }", result->errors);
+    }
+    result_count++;
+}
+
+// fills file system with 'count' files named fill_<n>, returns number created
+int populate(int count)
+{
+    int counter;
+    int fd;
+    char file_name[MAX_FILE_NAME];
+
+    for (counter = 0; counter < count; counter++)
+    {
+        snprintf(file_name, sizeof(file_name), "fill_%d", counter);
+        if ((fd = cvfs_create(file_name, READ + WRITE)) < 0)
+            break;
+        cvfs_close(fd);
+    }
+    return counter;
+}
+
+void depopulate(int count)
+{
+    int counter;
+    char file_name[MAX_FILE_NAME];
+
+    for (counter = 0; counter < count; counter++)
+    {
+        snprintf(file_name, sizeof(file_name), "fill_%d", counter);
+        cvfs_unlink(file_name);
+    }
+}
+
+void bench_create_unlink(struct benchmark_run *create_run, struct benchmark_run *unlink_run, int inodes)
+{
+    char name[128];
+    int filled;
+    int fd;
+    int more = 1;
+    double start;
+
+    filled = populate(inodes);
+    snprintf(name, sizeof(name), "create/inodes:%d", filled);
+    if (!begin(create_run, name))
+        create_run = NULL;
+    snprintf(name, sizeof(name), "unlink/inodes:%d", filled);
+    if (!begin(unlink_run, name))
+        unlink_run = NULL;
+
+    while (create_run != NULL || unlink_run != NULL)
+    {
+        start = now_ns();
+        fd = cvfs_create("bench_file", READ + WRITE);
+        if (create_run != NULL && !record(create_run, start, 0, fd >= 0))
+            more = 0;
+        cvfs_close(fd);
+
+        start = now_ns();
+        fd = cvfs_unlink("bench_file");
+        if (unlink_run != NULL && !record(unlink_run, start, 0, fd == 0))
+            more = 0;
+
+        if (!more)
+            break;
+    }
+
+    if (create_run != NULL)
+        report(create_run);
+    if (unlink_run != NULL)
+        report(unlink_run);
+    depopulate(filled);
+}
+
+// open of existing and missing names, 'hit_percent' of calls find the file
+void bench_open(struct benchmark_run *run, int inodes, int hit_percent)
+{
+    char name[128];
+    char file_name[MAX_FILE_NAME];
+    int filled;
+    int fd;
+    int hit;
+    int more;
+    unsigned int seed = 1;
+    double start;
+
+    filled = populate(inodes);
+    snprintf(name, sizeof(name), "open/inodes:%d/hit:%d%%", filled, hit_percent);
+    if (filled > 0 && begin(run, name))
+    {
+        do
+        {
+            hit = (int)(rand_r(&seed) % 100) < hit_percent;
+            snprintf(file_name, sizeof(file_name), hit ? "fill_%d" : "missing_%d", rand_r(&seed) % filled);
+
+            start = now_ns();
+            fd = cvfs_open(file_name, READ);
+            more = record(run, start, 0, hit ? fd >= 0 : fd == -1);
+            if (fd >= 0)
+                cvfs_close(fd); // not measured
+        } while (more);
+        report(run);
+    }
+    depopulate(filled);
+}
+
+void bench_stat(struct benchmark_run *run, int inodes, int hit_percent)
+{
+    char name[128];
+    char file_name[MAX_FILE_NAME];
+    int filled;
+    int status;
+    int hit;
+    unsigned int seed = 1;
+    double start;
+    struct cvfs_stat stat_buf;
+
+    filled = populate(inodes);
+    snprintf(name, sizeof(name), "stat/inodes:%d/hit:%d%%", filled, hit_percent);
+    if (filled > 0 && begin(run, name))
+    {
+        do
+        {
+            hit = (int)(rand_r(&seed) % 100) < hit_percent;
+            snprintf(file_name, sizeof(file_name), hit ? "fill_%d" : "missing_%d", rand_r(&seed) % filled);
+
+            start = now_ns();
+            status = cvfs_stat(file_name, &stat_buf);
+        } while (record(run, start, 0, hit ? status == 0 : status == -1));
+        report(run);
+    }
+    depopulate(filled);
+}
+
+// words separated by spaces, compresses about as well as text does ('x' everywhere would only measure best case)
+void fill_text(char *buffer, long long length)
+{
+    const char *words[] = {"block ", "inode ", "file ", "system ", "journal ", "data ", "name ", "offset "};
+    const char *word;
+    long long position = 0;
+    unsigned int seed = 1;
+
+    while (position < length)
+    {
+        for (word = words[rand_r(&seed) % 8]; *word != '\0' && position < length; word++)
+            buffer[position++] = *word;
+    }
+}
+
+// 'compressed' runs same calls on a file whose data is kept compressed ("/lz" is added to name)
+void bench_write(struct benchmark_run *run, int io_size, int compressed)
+{
+    char name[128];
+    int fd;
+    long long written;
+    long long file_bytes = 0;
+    double start;
+
+    snprintf(name, sizeof(name), "write/size:%d%s", io_size, compressed ? "/lz" : "");
+    if (!begin(run, name))
+        return;
+
+    cvfs_set_compression(compressed);
+    fd = cvfs_create("bench_file", READ + WRITE);
+    cvfs_set_compression(0);
+    do
+    {
+        if (file_bytes + io_size > WRAP_SIZE)
+        {
+            cvfs_truncate("bench_file", 0); // not measured
+            cvfs_lseek(fd, 0, SEEK_SET);
+            file_bytes = 0;
+        }
+
+        start = now_ns();
+        written = cvfs_write(fd, io_buffer, io_size);
+        file_bytes += io_size;
+    } while (record(run, start, written > 0 ? written : 0, written == io_size));
+    report(run);
+
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// sequential reads of a file of 'file_size' bytes, offset goes back to start at end of file
+void bench_read(struct benchmark_run *run, int io_size, long long file_size, int compressed)
+{
+    char name[128];
+    int fd;
+    long long offset;
+    long long read_bytes;
+    double start;
+
+    snprintf(name, sizeof(name), "read/size:%d/file:%lld%s", io_size, file_size, compressed ? "/lz" : "");
+    if (!begin(run, name))
+        return;
+
+    cvfs_set_compression(compressed);
+    fd = cvfs_create("bench_file", READ + WRITE);
+    cvfs_set_compression(0);
+    for (offset = 0; offset < file_size; offset += MAX_IO_SIZE)
+        cvfs_write(fd, io_buffer, (file_size - offset < MAX_IO_SIZE) ? file_size - offset : MAX_IO_SIZE);
+    cvfs_lseek(fd, 0, SEEK_SET);
+
+    offset = 0;
+    do
+    {
+        if (offset + io_size > file_size)
+        {
+            cvfs_lseek(fd, 0, SEEK_SET); // not measured
+            offset = 0;
+        }
+
+        start = now_ns();
+        read_bytes = cvfs_read(fd, io_buffer, io_size);
+        offset += io_size;
+    } while (record(run, start, read_bytes > 0 ? read_bytes : 0, read_bytes == io_size));
+    report(run);
+
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// reads 'io_size' bytes at a time and adds them up, copied by cvfs_pread() or in place through a view
+void bench_scan(struct benchmark_run *run, int io_size, long long file_size, int view)
+{
+    char name[128];
+    int fd;
+    int counter;
+    long long offset;
+    long long index;
+    long long scanned;
+    long long sum = 0;
+    double start;
+    struct cvfs_view file_view;
+
+    snprintf(name, sizeof(name), "scan/size:%d/%s", io_size, view ? "view" : "pread");
+    if (!begin(run, name))
+        return;
+
+    fd = cvfs_create("bench_file", READ + WRITE);
+    for (offset = 0; offset < file_size; offset += MAX_IO_SIZE)
+        cvfs_write(fd, io_buffer, (file_size - offset < MAX_IO_SIZE) ? file_size - offset : MAX_IO_SIZE);
+
+    offset = 0;
+    do
+    {
+        if (offset + io_size > file_size)
+            offset = 0;
+
+        start = now_ns();
+        scanned = 0;
+        if (view && cvfs_view_open(fd, offset, io_size, &file_view) == 0)
+        {
+            for (counter = 0; counter < file_view.extent_count; counter++)
+            {
+                for (index = 0; index < file_view.extents[counter].length; index++)
+                    sum += file_view.extents[counter].data[index];
+            }
+            scanned = file_view.length;
+            cvfs_view_close(&file_view);
+        }
+        else if (!view && (scanned = cvfs_pread(fd, io_buffer, io_size, offset)) > 0)
+        {
+            for (index = 0; index < scanned; index++)
+                sum += io_buffer[index];
+        }
+        offset += io_size;
+    } while (record(run, start, scanned > 0 ? scanned : 0, scanned == io_size));
+    report(run);
+
+    if (sum == 0)
+        printf("%s: file holds no data\n", name); // keeps sums from being optimized away
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// records of 'fields' fields of 'field_size' bytes, written with one cvfs_writev() or with a cvfs_write() per field
+void bench_record(struct benchmark_run *run, int fields, int field_size, int vectored)
+{
+    char name[128];
+    int fd;
+    int counter;
+    long long written;
+    long long file_bytes = 0;
+    double start;
+    struct cvfs_iovec iov[64];
+
+    snprintf(name, sizeof(name), "%s/fields:%d/size:%d", vectored ? "writev" : "write_fields", fields, field_size);
+    if (!begin(run, name))
+        return;
+
+    for (counter = 0; counter < fields; counter++)
+    {
+        iov[counter].base = io_buffer + counter * field_size;
+        iov[counter].length = field_size;
+    }
+
+    fd = cvfs_create("bench_file", READ + WRITE);
+    do
+    {
+        if (file_bytes + fields * field_size > WRAP_SIZE)
+        {
+            cvfs_truncate("bench_file", 0); // not measured
+            cvfs_lseek(fd, 0, SEEK_SET);
+            file_bytes = 0;
+        }
+
+        start = now_ns();
+        if (vectored)
+            written = cvfs_writev(fd, iov, fields);
+        else
+        {
+            for (counter = 0, written = 0; counter < fields; counter++)
+                written += cvfs_write(fd, iov[counter].base, field_size);
+        }
+        file_bytes += fields * field_size;
+    } while (record(run, start, written > 0 ? written : 0, written == fields * field_size));
+    report(run);
+
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// batches of 64 reads of 4 KB at scattered offsets, run one after another by calling thread (workers 0) or
+// submitted to a ring with 'workers' threads and reaped together
+void bench_ring(struct benchmark_run *run, long long file_size, int workers)
+{
+    char name[128];
+    int fd;
+    int counter;
+    int reaped;
+    long long offset;
+    long long read_bytes;
+    unsigned int seed = 1;
+    double start;
+    struct cvfs_ring *ring = NULL;
+    struct cvfs_ring_request requests[64];
+    struct cvfs_ring_completion completions[64];
+
+    if (workers == 0)
+        snprintf(name, sizeof(name), "batch_read/requests:64/size:4096/sync");
+    else
+        snprintf(name, sizeof(name), "batch_read/requests:64/size:4096/ring:%d", workers);
+    if (!begin(run, name))
+        return;
+
+    fd = cvfs_create("bench_file", READ + WRITE);
+    for (offset = 0; offset < file_size; offset += MAX_IO_SIZE)
+        cvfs_write(fd, io_buffer, (file_size - offset < MAX_IO_SIZE) ? file_size - offset : MAX_IO_SIZE);
+    if (workers > 0)
+        ring = cvfs_ring_create(64, workers);
+
+    do
+    {
+        for (counter = 0; counter < 64; counter++)
+        {
+            requests[counter].op = CVFS_RING_READ;
+            requests[counter].fd = fd;
+            requests[counter].offset = (rand_r(&seed) % (file_size / 4096)) * 4096;
+            requests[counter].buffer = io_buffer + counter * 4096;
+            requests[counter].count = 4096;
+            requests[counter].user_data = counter;
+        }
+
+        start = now_ns();
+        read_bytes = 0;
+        if (ring == NULL)
+        {
+            for (counter = 0; counter < 64; counter++)
+                read_bytes += cvfs_pread(fd, requests[counter].buffer, 4096, requests[counter].offset);
+        }
+        else if (cvfs_ring_submit(ring, requests, 64) == 64)
+        {
+            for (reaped = 0; reaped < 64;)
+            {
+                counter = cvfs_ring_reap(ring, completions + reaped, 64 - reaped, 64 - reaped);
+                for (; counter > 0; counter--, reaped++)
+                    read_bytes += completions[reaped].result;
+            }
+        }
+    } while (record(run, start, read_bytes > 0 ? read_bytes : 0, read_bytes == 64 * 4096));
+    report(run);
+
+    cvfs_ring_destroy(ring);
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// clones of a file of 'file_size' bytes, cost grows with number of blocks but no data is copied
+void bench_clone(struct benchmark_run *run, long long file_size)
+{
+    char name[128];
+    int fd;
+    int status;
+    long long offset;
+    double start;
+
+    snprintf(name, sizeof(name), "clone/file:%lld", file_size);
+    if (!begin(run, name))
+        return;
+
+    fd = cvfs_create("bench_file", READ + WRITE);
+    for (offset = 0; offset < file_size; offset += MAX_IO_SIZE)
+        cvfs_write(fd, io_buffer, (file_size - offset < MAX_IO_SIZE) ? file_size - offset : MAX_IO_SIZE);
+    cvfs_close(fd);
+
+    do
+    {
+        cvfs_unlink("bench_clone"); // clone of previous iteration, not measured
+        start = now_ns();
+        status = cvfs_clone("bench_file", "bench_clone");
+    } while (record(run, start, 0, status == 0));
+    report(run);
+
+    cvfs_unlink("bench_clone");
+    cvfs_unlink("bench_file");
+}
+
+void bench_lseek(struct benchmark_run *run, int whence)
+{
+    const char *whence_names[] = {"set", "cur", "end"};
+    char name[128];
+    int fd;
+    long long offset;
+    unsigned int seed = 1;
+    double start;
+
+    snprintf(name, sizeof(name), "lseek/whence:%s", whence_names[whence]);
+    if (!begin(run, name))
+        return;
+
+    fd = cvfs_create("bench_file", READ + WRITE);
+    cvfs_write(fd, io_buffer, MAX_IO_SIZE);
+    do
+    {
+        offset = rand_r(&seed) % MAX_IO_SIZE;
+        if (whence == SEEK_CUR)
+            offset = 0;
+        else if (whence == SEEK_END)
+            offset = -offset;
+
+        start = now_ns();
+        offset = cvfs_lseek(fd, offset, whence);
+    } while (record(run, start, 0, offset >= 0));
+    report(run);
+
+    cvfs_close(fd);
+    cvfs_unlink("bench_file");
+}
+
+// scans of 'file_count' files of 'file_size' bytes for a pattern they do not contain, with search instructions 'simd'
+void bench_grep(struct benchmark_run *run, int file_count, long long file_size, int simd)
+{
+    const char *simd_names[] = {"scalar", "sse2", "avx2"};
+    char name[128];
+    char file_name[MAX_FILE_NAME];
+    int counter;
+    int fd;
+    int matched;
+    long long offset;
+    double start;
+    struct cvfs_grep_summary summary;
+
+    if (cvfs_set_grep_simd(simd) != simd)
+        return; // processor does not have these instructions
+    snprintf(name, sizeof(name), "grep/simd:%s/files:%d/file:%lld", simd_names[simd], file_count, file_size);
+    if (!begin(run, name))
+    {
+        cvfs_set_grep_simd(-1);
+        return;
+    }
+
+    for (counter = 0; counter < file_count; counter++)
+    {
+        snprintf(file_name, sizeof(file_name), "fill_%d", counter);
+        fd = cvfs_create(file_name, READ + WRITE);
+        for (offset = 0; offset < file_size; offset += MAX_IO_SIZE)
+            cvfs_write(fd, io_buffer, (file_size - offset < MAX_IO_SIZE) ? file_size - offset : MAX_IO_SIZE);
+        cvfs_close(fd);
+    }
+
+    do
+    {
+        start = now_ns();
+        matched = cvfs_grep("needle", NULL, 0, NULL, NULL, &summary);
+    } while (record(run, start, summary.bytes_scanned, matched == 0 && summary.files_scanned == file_count));
+    report(run);
+
+    depopulate(file_count);
+    cvfs_set_grep_simd(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    int counter;
+    int size_index;
+    int inode_index;
+    int hit_index;
+    int inode_counts[] = {1, 16, 48};
+    int hit_percents[] = {100, 50, 0};
+    int io_sizes[] = {64, 4096, 65536, MAX_IO_SIZE};
+    long long file_sizes[] = {64 * 1024, 16 * 1024 * 1024};
+    struct benchmark_run run;
+    struct benchmark_run second_run;
+
+    for (counter = 1; counter < argc; counter++)
+    {
+        if (!strcmp(argv[counter], "--min-time") && counter + 1 < argc)
+            min_time = atof(argv[++counter]);
+        else if (!strcmp(argv[counter], "--filter") && counter + 1 < argc)
+            filter = argv[++counter];
+        else if (!strcmp(argv[counter], "--format") && counter + 1 < argc && !strcmp(argv[counter + 1], "json"))
+            format = FORMAT_JSON, counter++;
+        else if (!strcmp(argv[counter], "--format") && counter + 1 < argc && !strcmp(argv[counter + 1], "csv"))
+            format = FORMAT_CSV, counter++;
+        else if (!strcmp(argv[counter], "--format") && counter + 1 < argc && !strcmp(argv[counter + 1], "table"))
+            format = FORMAT_TABLE, counter++;
+        else
+        {
+            printf("Usage: %s [--min-time <seconds>] [--filter <substring>] [--format table|json|csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    run.samples = (double *)malloc(MAX_SAMPLES * sizeof(double));
+    second_run.samples = (double *)malloc(MAX_SAMPLES * sizeof(double));
+    if (run.samples == NULL || second_run.samples == NULL || cvfs_init() != 0)
+    {
+        printf("Memory allocation FAILED\n");
+        return 1;
+    }
+    memset(io_buffer, 'x', sizeof(io_buffer));
+
+    if (format == FORMAT_JSON)
+    {
+        // same top level layout as Google Benchmark, so existing comparison scripts can read it
+        printf("{\n  \"context\": {\n    \"executable\": \"%s\",\n    \"num_cpus\": %ld,\n    \"min_time_seconds\": %.3f\n  },\n  \"benchmarks\": [\n",
+               argv[0], sysconf(_SC_NPROCESSORS_ONLN), min_time);
+    }
+
+    for (inode_index = 0; inode_index < 3; inode_index++)
+        bench_create_unlink(&run, &second_run, inode_counts[inode_index] - 1);
+
+    for (inode_index = 0; inode_index < 3; inode_index++)
+    {
+        for (hit_index = 0; hit_index < 3; hit_index++)
+        {
+            bench_open(&run, inode_counts[inode_index], hit_percents[hit_index]);
+            bench_stat(&run, inode_counts[inode_index], hit_percents[hit_index]);
+        }
+    }
+
+    for (size_index = 0; size_index < 4; size_index++)
+        bench_write(&run, io_sizes[size_index], 0);
+
+    for (inode_index = 0; inode_index < 2; inode_index++)
+    {
+        for (size_index = 0; size_index < 4; size_index++)
+        {
+            if (io_sizes[size_index] <= file_sizes[inode_index])
+                bench_read(&run, io_sizes[size_index], file_sizes[inode_index], 0);
+        }
+    }
+
+    for (size_index = 1; size_index < 4; size_index++)
+    {
+        bench_scan(&run, io_sizes[size_index], file_sizes[1], 0);
+        bench_scan(&run, io_sizes[size_index], file_sizes[1], 1);
+    }
+
+    bench_record(&run, 8, 16, 0);
+    bench_record(&run, 8, 16, 1);
+    bench_record(&run, 64, 64, 0);
+    bench_record(&run, 64, 64, 1);
+
+    for (counter = 0; counter <= 4; counter += 2)
+        bench_ring(&run, file_sizes[1], counter);
+
+    for (counter = SEEK_SET; counter <= SEEK_END; counter++)
+        bench_lseek(&run, counter);
+
+    for (inode_index = 0; inode_index < 2; inode_index++)
+        bench_clone(&run, file_sizes[inode_index]);
+
+    fill_text(io_buffer, sizeof(io_buffer)); // compressed files get data which is not all alike
+    for (size_index = 0; size_index < 4; size_index++)
+        bench_write(&run, io_sizes[size_index], 1);
+    for (size_index = 0; size_index < 4; size_index++)
+    {
+        if (io_sizes[size_index] <= file_sizes[1])
+            bench_read(&run, io_sizes[size_index], file_sizes[1], 1);
+    }
+
+    for (counter = 0; counter < 3; counter++)
+    {
+        bench_grep(&run, 1, file_sizes[1], counter);
+        bench_grep(&run, 8, file_sizes[1], counter);
+    }
+
+    if (format == FORMAT_JSON)
+        printf("\n  ]\n}\n");
+    return 0;
+}
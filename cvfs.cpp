@@ -0,0 +1,1873 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "cvfs_internal.h"
+
+struct superblock heap_super_block;          // super block used when file system is kept only in memory
+struct superblock *super_block = &heap_super_block; // global object for managing inodes and blocks (points into image when mounted)
+struct geometry geometry = {CVFS_MAX_INODES, CVFS_MAX_BLOCKS, CVFS_BLOCK_SIZE, __builtin_ctz(CVFS_BLOCK_SIZE), 0}; // see set_geometry()
+struct ufdt *ufdt_array = NULL;              // UFDT array (MAX_INODES entries)
+int descriptor_hint = 0;                     // search for a free descriptor starts here (descriptors below were in use)
+struct filetable *filetable_array = NULL;    // file tables are never freed, so a descriptor can be pinned without a lock
+struct inode *inode_table = NULL;            // DILB, contiguous array of inodes
+char *block_pool = NULL;                     // data region, block 'n' starts at block_pool + n * BLOCK_SIZE (block 0 is never used)
+int *free_block_stack = NULL;                // numbers of released blocks
+int *block_shares = NULL;                    // block_shares[n]: files sharing block 'n' besides its first owner (atomic, not in image)
+
+// state below is in memory of this process, unless file system is in a shared memory segment (see cvfs_mount_shared())
+int process_shared = 0;                      // 1 while file system is in a shared memory segment, its locks are process shared
+struct index_shard local_index[INDEX_SHARDS];
+struct index_shard *name_index = local_index; // name index, shard is selected by high bits of hash
+struct index_entry *index_slots = NULL;      // slots of every shard, SHARD_SIZE slots of a shard follow those of previous shard
+long long local_shared_block_count = 0;
+long long *shared_block_count = &local_shared_block_count; // sum of block_shares, files refer to this many blocks more than are used (atomic)
+pthread_mutex_t local_inode_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t *inode_alloc_lock = &local_inode_alloc_lock; // protects free inode list and free_inodes
+pthread_mutex_t local_block_alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t *block_alloc_lock = &local_block_alloc_lock; // protects free block stack and free_blocks
+
+void init_rwlock(pthread_rwlock_t *lock)
+{
+    pthread_rwlockattr_t attributes;
+
+    pthread_rwlockattr_init(&attributes);
+    if (process_shared)
+        pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_rwlock_init(lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+}
+
+void init_mutex(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attributes;
+
+    pthread_mutexattr_init(&attributes);
+    if (process_shared)
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+// files are indexed by directory and name, so every directory has its own part of the index
+unsigned int entry_hash(int parent, const char *name)
+{
+    int counter;
+    unsigned int hash = 2166136261u; // FNV-1a of inode number of directory followed by name
+
+    for (counter = 0; counter < (int)sizeof(int); counter++)
+    {
+        hash ^= (parent >> (8 * counter)) & 0xff;
+        hash *= 16777619u;
+    }
+
+    while (*name != '\0')
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+
+    if (hash <= INDEX_DELETED) // keep reserved values for empty and deleted slots
+        hash += 2;
+    return hash;
+}
+
+struct index_shard *get_shard(unsigned int hash)
+{
+    return &name_index[(hash >> 24) & (INDEX_SHARDS - 1)]; // low bits select slot inside shard
+}
+
+struct index_entry *shard_slots(struct index_shard *shard)
+{
+    return index_slots + (long long)(shard - name_index) * SHARD_SIZE;
+}
+
+struct inode *entry_inode(struct index_entry *entry)
+{
+    return &inode_table[entry->inode_number - 1];
+}
+
+// caller holds shard lock
+struct index_entry *shard_find(struct index_shard *shard, unsigned int hash, int parent, const char *name)
+{
+    unsigned int slot;
+    struct index_entry *slots = shard_slots(shard);
+    struct inode *inode_ptr;
+
+    for (slot = hash & (SHARD_SIZE - 1); slots[slot].hash != INDEX_EMPTY; slot = (slot + 1) & (SHARD_SIZE - 1))
+    {
+        if (slots[slot].hash != hash)
+            continue;
+        inode_ptr = entry_inode(&slots[slot]);
+        if ((inode_ptr->parent_inode == parent) && (!strcmp(inode_ptr->file_name, name)))
+            return &slots[slot]; // file found
+    }
+    return NULL; // reached an empty slot, so there is no such file
+}
+
+// caller holds shard lock for writing, slots are rebuilt in place (they may be in a shared memory segment),
+// tombstones stay when memory for a copy of live slots is not available
+void shard_rebuild(struct index_shard *shard)
+{
+    int counter;
+    int live_count = 0;
+    unsigned int slot;
+    struct index_entry *slots = shard_slots(shard);
+    struct index_entry *live = (struct index_entry *)malloc(SHARD_SIZE * sizeof(struct index_entry));
+
+    if (live == NULL)
+        return;
+
+    for (counter = 0; counter < SHARD_SIZE; counter++)
+    {
+        if (slots[counter].hash > INDEX_DELETED)
+            live[live_count++] = slots[counter];
+    }
+
+    memset(slots, 0, SHARD_SIZE * sizeof(struct index_entry));
+    for (counter = 0; counter < live_count; counter++)
+    {
+        for (slot = live[counter].hash & (SHARD_SIZE - 1); slots[slot].hash != INDEX_EMPTY; slot = (slot + 1) & (SHARD_SIZE - 1))
+            ;
+        slots[slot] = live[counter];
+    }
+
+    free(live);
+    shard->used = live_count;
+    shard->deleted = 0;
+}
+
+// caller holds shard lock for writing, returns -1 if shard is full
+int shard_insert(struct index_shard *shard, unsigned int hash, struct inode *inode_ptr)
+{
+    unsigned int slot;
+    struct index_entry *slots = shard_slots(shard);
+
+    if (shard->used - shard->deleted >= SHARD_SIZE - 1)
+        return -1; // at least one empty slot must remain so that probes terminate
+
+    for (slot = hash & (SHARD_SIZE - 1); slots[slot].hash > INDEX_DELETED; slot = (slot + 1) & (SHARD_SIZE - 1))
+        ;
+
+    if (slots[slot].hash == INDEX_DELETED) // reusing tombstone
+        shard->deleted--;
+    else
+        shard->used++;
+
+    slots[slot].hash = hash;
+    slots[slot].inode_number = inode_ptr->inode_number;
+
+    if (shard->used == SHARD_SIZE - 1 && shard->deleted > 0) // tombstones are about to fill the last empty slot
+        shard_rebuild(shard);
+    return 0;
+}
+
+// caller holds shard lock for writing
+void shard_remove(struct index_shard *shard, struct index_entry *entry)
+{
+    entry->hash = INDEX_DELETED; // leave tombstone so that probe chains remain unbroken
+    entry->inode_number = 0;
+    shard->deleted++;
+
+    if (shard->deleted > SHARD_SIZE / 4) // too many tombstones make misses slow
+        shard_rebuild(shard);
+}
+
+void inode_get(struct inode *inode_ptr)
+{
+    ATOMIC_ADD(&(inode_ptr->reference_count), 1);
+}
+
+void inode_put(struct inode *inode_ptr);
+
+// returns inode of 'name' in directory 'parent' (0 for root) with an extra reference (release with inode_put()),
+// NULL if there is no such file
+struct inode *index_lookup(int parent, const char *name)
+{
+    unsigned int hash;
+    struct index_shard *shard = NULL;
+    struct index_entry *entry = NULL;
+    struct inode *inode_ptr = NULL;
+
+    if (__atomic_load_n(&(super_block->free_inodes), __ATOMIC_RELAXED) == super_block->total_inodes)
+        return NULL; // there are no files at all
+
+    hash = entry_hash(parent, name);
+    shard = get_shard(hash);
+
+    pthread_rwlock_rdlock(&(shard->lock));
+    if ((entry = shard_find(shard, hash, parent, name)) != NULL)
+    {
+        inode_ptr = entry_inode(entry);
+        inode_get(inode_ptr); // inode can not be freed while shard is locked
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+
+    return inode_ptr;
+}
+
+int create_block_pool()
+{
+    // address space for all blocks is reserved once, pages are given by kernel only when block is written
+    block_pool = tier_create_pool();
+    free_block_stack = (int *)malloc(MAX_BLOCKS * sizeof(int));
+    block_shares = (int *)calloc(MAX_BLOCKS, sizeof(int));
+    *shared_block_count = 0;
+
+    if (block_pool == NULL || free_block_stack == NULL || block_shares == NULL)
+    {
+        block_pool = NULL;
+        return -1; // memory allocation failed
+    }
+    return 0;
+}
+
+char *block_address(int block)
+{
+    if (tier_state != NULL && block != 0)
+        tier_access(block); // block may have to be paged back in, and others evicted
+    return block_pool + ((long long)block << BLOCK_SHIFT);
+}
+
+int alloc_block()
+{
+    int block;
+    int reused = 0;
+
+    pthread_mutex_lock(block_alloc_lock);
+    if (super_block->free_block_count > 0)
+    {
+        block = free_block_stack[--super_block->free_block_count];
+        reused = 1;
+    }
+    else if (block_pool != NULL && super_block->initialized_blocks < MAX_BLOCKS)
+        block = super_block->initialized_blocks++; // block was never used so it is already zero filled
+    else
+        block = 0; // there is no free block
+
+    if (block != 0)
+        (super_block->free_blocks)--;
+    journal_log(super_block, sizeof(struct superblock));
+    pthread_mutex_unlock(block_alloc_lock);
+
+    if (reused && !tier_clears_released())
+    {
+        memset(block_address(block), 0, BLOCK_SIZE); // released block still holds data of old file
+        journal_log(block_address(block), BLOCK_SIZE);
+    }
+    return block;
+}
+
+void release_block(int block)
+{
+    tier_release(block); // before block can be handed out again
+    pthread_mutex_lock(block_alloc_lock);
+    journal_log(&free_block_stack[super_block->free_block_count], sizeof(int));
+    free_block_stack[super_block->free_block_count++] = block;
+    (super_block->free_blocks)++;
+    journal_log(super_block, sizeof(struct superblock));
+    pthread_mutex_unlock(block_alloc_lock);
+}
+
+// drops one owner of a data block, block is released when no file uses it anymore
+void put_block(int block)
+{
+    int shares = ATOMIC_LOAD(&block_shares[block]);
+
+    while (1)
+    {
+        while (shares > 0)
+        {
+            if (ATOMIC_CAS(&block_shares[block], &shares, shares - 1))
+            {
+                ATOMIC_ADD(shared_block_count, -1);
+                return;
+            }
+        }
+        if (!dedup_forget(block))
+            break; // block is not in dedup index, so no other file can start sharing it
+        shares = ATOMIC_LOAD(&block_shares[block]); // a file may have found it in index before it was removed
+    }
+    release_block(block);
+}
+
+// gives file its own copy of a shared data block, nobody writes a block while it is shared so it can be copied without a lock
+int unshare_block(int *slot)
+{
+    int block = alloc_block();
+
+    if (block == 0)
+        return -1; // there is no free block
+    memcpy(block_address(block), block_address(*slot), BLOCK_SIZE);
+    journal_log(block_address(block), BLOCK_SIZE);
+    put_block(*slot);
+    *slot = block;
+    journal_log(slot, sizeof(int));
+    return 0;
+}
+
+int *get_block_table(int *slot, int allocate)
+{
+    if ((*slot == 0) && (!allocate || (*slot = alloc_block()) == 0))
+        return NULL; // indirect block is not allocated
+    journal_log(slot, sizeof(int));
+    return (int *)block_address(*slot);
+}
+
+int *get_block_slot(struct inode *inode_ptr, long long block_index, int allocate)
+{
+    int *table = NULL;
+
+    if (block_index < DIRECT_BLOCKS)
+        return &(inode_ptr->direct_blocks[block_index]);
+    block_index -= DIRECT_BLOCKS;
+
+    if (block_index < POINTERS_PER_BLOCK)
+    {
+        if ((table = get_block_table(&(inode_ptr->indirect_block), allocate)) == NULL)
+            return NULL;
+        return &table[block_index];
+    }
+    block_index -= POINTERS_PER_BLOCK;
+
+    if (block_index >= (long long)POINTERS_PER_BLOCK * POINTERS_PER_BLOCK)
+        return NULL; // beyond maximum file size
+
+    if ((table = get_block_table(&(inode_ptr->double_indirect_block), allocate)) == NULL)
+        return NULL;
+    if ((table = get_block_table(&table[block_index >> POINTERS_SHIFT], allocate)) == NULL)
+        return NULL;
+    return &table[block_index & (POINTERS_PER_BLOCK - 1)];
+}
+
+// first block after 'block_index' which may have a slot, when get_block_slot() found no block table for 'block_index'
+long long skip_missing_table(long long block_index)
+{
+    if (block_index < DIRECT_BLOCKS + POINTERS_PER_BLOCK)
+        return DIRECT_BLOCKS + POINTERS_PER_BLOCK; // indirect block is not allocated
+
+    block_index -= DIRECT_BLOCKS + POINTERS_PER_BLOCK;
+    return DIRECT_BLOCKS + POINTERS_PER_BLOCK + (((block_index >> POINTERS_SHIFT) + 1) << POINTERS_SHIFT);
+}
+
+// first offset at or after 'offset' which holds data ('data' 1) or lies in a hole ('data' 0), actual size if there is none
+// (a compressed file has data or a hole unit by unit)
+long long seek_extent(struct inode *inode_ptr, long long offset, int data)
+{
+    int *slot;
+    int allocated;
+    long long step = inode_ptr->compression ? UNIT_BLOCKS : 1;
+    long long block_index = (offset >> BLOCK_SHIFT) / step * step;
+    long long last_block = file_block_count(inode_ptr);
+
+    while (block_index < last_block)
+    {
+        if (inode_ptr->compression)
+            allocated = !unit_is_hole(inode_ptr, block_index / UNIT_BLOCKS);
+        else if ((slot = get_block_slot(inode_ptr, block_index, 0)) == NULL)
+        {
+            if (data)
+            {
+                block_index = skip_missing_table(block_index); // whole block table is a hole
+                continue;
+            }
+            allocated = 0;
+        }
+        else
+            allocated = (*slot != 0);
+
+        if (allocated == data)
+        {
+            if ((block_index << BLOCK_SHIFT) > offset)
+                offset = block_index << BLOCK_SHIFT;
+            return (offset < inode_ptr->file_actual_size) ? offset : inode_ptr->file_actual_size;
+        }
+        block_index += step;
+    }
+    return inode_ptr->file_actual_size;
+}
+
+char *get_file_block(struct inode *inode_ptr, long long block_index, int allocate)
+{
+    int *slot = get_block_slot(inode_ptr, block_index, allocate);
+
+    if (slot == NULL)
+        return NULL;
+
+    if (*slot == 0)
+    {
+        if (!allocate || (*slot = alloc_block()) == 0)
+            return NULL; // block is not allocated or there is no free block
+        inode_ptr->file_size += BLOCK_SIZE;
+        journal_log(slot, sizeof(int));
+    }
+    else if (allocate)
+    {
+        dedup_forget(*slot); // block is about to be written, no other file may start sharing it
+        if (ATOMIC_LOAD(&block_shares[*slot]) > 0 && unshare_block(slot) != 0)
+            return NULL; // block is shared with a clone or a file holding equal data
+    }
+    return block_address(*slot);
+}
+
+// number of blocks which may be allocated, blocks never exist beyond actual size (or beyond its last unit if file is compressed)
+long long file_block_count(struct inode *inode_ptr)
+{
+    long long blocks = (inode_ptr->file_actual_size + BLOCK_SIZE - 1) >> BLOCK_SHIFT;
+
+    if (inode_ptr->compression)
+        blocks = (blocks + UNIT_BLOCKS - 1) & ~(long long)(UNIT_BLOCKS - 1);
+    return blocks;
+}
+
+int block_is_zero(const char *data, long long length)
+{
+    while (length > 0 && *data == 0)
+    {
+        data++;
+        length--;
+    }
+    return length == 0;
+}
+
+void release_file_blocks(struct inode *inode_ptr, long long first_block)
+{
+    int counter;
+    int *table = NULL;
+    int *slot = NULL;
+    long long block_index;
+    long long last_block = file_block_count(inode_ptr);
+
+    for (block_index = first_block; block_index < last_block; block_index++)
+    {
+        slot = get_block_slot(inode_ptr, block_index, 0);
+        if ((slot != NULL) && (*slot != 0))
+        {
+            put_block(*slot);
+            *slot = 0;
+            journal_log(slot, sizeof(int));
+            inode_ptr->file_size -= BLOCK_SIZE;
+        }
+    }
+
+    // releasing indirect blocks which do not map any block now
+    if ((inode_ptr->indirect_block != 0) && (first_block <= DIRECT_BLOCKS))
+    {
+        release_block(inode_ptr->indirect_block);
+        inode_ptr->indirect_block = 0;
+    }
+
+    if (inode_ptr->double_indirect_block != 0)
+    {
+        table = (int *)block_address(inode_ptr->double_indirect_block);
+        for (counter = 0; counter < POINTERS_PER_BLOCK; counter++)
+        {
+            if ((table[counter] != 0) && (first_block <= DIRECT_BLOCKS + POINTERS_PER_BLOCK + (long long)counter * POINTERS_PER_BLOCK))
+            {
+                release_block(table[counter]);
+                table[counter] = 0;
+                journal_log(&table[counter], sizeof(int));
+            }
+        }
+        if (first_block <= DIRECT_BLOCKS + POINTERS_PER_BLOCK)
+        {
+            release_block(inode_ptr->double_indirect_block);
+            inode_ptr->double_indirect_block = 0;
+        }
+    }
+    log_inode(inode_ptr);
+}
+
+long long copy_to_blocks(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill)
+{
+    char *block = NULL;
+    long long copied = 0;
+    long long chunk;
+    long long block_offset;
+
+    while (copied < no_of_bytes)
+    {
+        if ((offset >> BLOCK_SHIFT) >= MAX_FILE_BLOCKS || (block = get_file_block(inode_ptr, offset >> BLOCK_SHIFT, 1)) == NULL)
+            break; // maximum file size reached or there is no free block
+
+        block_offset = offset & (BLOCK_SIZE - 1);
+        chunk = BLOCK_SIZE - block_offset;
+        if (chunk > no_of_bytes - copied)
+            chunk = no_of_bytes - copied;
+
+        if (data != NULL)
+            memcpy(block + block_offset, data + copied, chunk);
+        else
+            memset(block + block_offset, fill, chunk); // 'data' NULL means fill the range with 'fill' character
+        journal_log(block + block_offset, chunk);
+        if (block_offset + chunk == BLOCK_SIZE && ATOMIC_LOAD(&dedup_enabled))
+            dedup_block(inode_ptr, offset >> BLOCK_SHIFT); // block is complete, file may share an equal one instead
+
+        copied += chunk;
+        offset += chunk;
+    }
+    return copied;
+}
+
+long long copy_from_blocks(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes)
+{
+    char *block = NULL;
+    long long copied = 0;
+    long long chunk;
+    long long block_offset;
+
+    while (copied < no_of_bytes)
+    {
+        block_offset = offset & (BLOCK_SIZE - 1);
+        chunk = BLOCK_SIZE - block_offset;
+        if (chunk > no_of_bytes - copied)
+            chunk = no_of_bytes - copied;
+
+        if ((block = get_file_block(inode_ptr, offset >> BLOCK_SHIFT, 0)) != NULL)
+            memcpy(buffer + copied, block + block_offset, chunk);
+        else
+            memset(buffer + copied, 0, chunk); // block not allocated, it contains zeros
+
+        copied += chunk;
+        offset += chunk;
+    }
+    return copied;
+}
+
+long long copy_to_file(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill)
+{
+    if (inode_ptr->compression)
+        return copy_to_units(inode_ptr, offset, data, no_of_bytes, fill);
+    return copy_to_blocks(inode_ptr, offset, data, no_of_bytes, fill);
+}
+
+long long copy_from_file(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes)
+{
+    if (offset >= inode_ptr->file_actual_size)
+        return 0; // nothing to read beyond end of file
+
+    if (no_of_bytes > inode_ptr->file_actual_size - offset)
+        no_of_bytes = inode_ptr->file_actual_size - offset; // if not sufficient bytes are present then read all the remaining bytes
+
+    if (inode_ptr->compression)
+        return copy_from_units(inode_ptr, offset, buffer, no_of_bytes);
+    return copy_from_blocks(inode_ptr, offset, buffer, no_of_bytes);
+}
+
+// -2 if sizes can not be used, a block pool larger than 16 TB is not reserved
+int validate_geometry(int max_inodes, int max_blocks, int block_size)
+{
+    if (max_inodes < 1 || max_inodes > (1 << 24) || max_blocks < 2 || max_blocks > (1 << 30))
+        return -2;
+    if (block_size < 512 || block_size > (1 << 20) || (block_size & (block_size - 1)) != 0)
+        return -2;
+    if ((long long)max_blocks * block_size > (1LL << 44))
+        return -2;
+#ifdef CVFS_FIXED_GEOMETRY
+    if (max_inodes != CVFS_MAX_INODES || max_blocks != CVFS_MAX_BLOCKS || block_size != CVFS_BLOCK_SIZE)
+        return -2;
+#endif
+    return 0;
+}
+
+void set_geometry(int max_inodes, int max_blocks, int block_size)
+{
+    long long slots = 2LL * max_inodes / INDEX_SHARDS + 64; // shards stay at most about half full
+
+    geometry.max_inodes = max_inodes;
+    geometry.max_blocks = max_blocks;
+    geometry.block_size = block_size;
+    geometry.block_shift = __builtin_ctz(block_size);
+    for (geometry.shard_size = 64; geometry.shard_size < slots; geometry.shard_size *= 2)
+        ;
+}
+
+int cvfs_configure(int max_inodes, int max_blocks, int block_size)
+{
+    if (inode_table != NULL)
+        return -1; // file system is already initialized
+
+    max_inodes = (max_inodes == 0) ? geometry.max_inodes : max_inodes;
+    max_blocks = (max_blocks == 0) ? geometry.max_blocks : max_blocks;
+    block_size = (block_size == 0) ? geometry.block_size : block_size;
+    if (validate_geometry(max_inodes, max_blocks, block_size) != 0)
+        return -2;
+
+    set_geometry(max_inodes, max_blocks, block_size);
+    return 0;
+}
+
+// returns -1 if memory allocation failed
+int initialize_tables()
+{
+    int counter;
+
+    free(ufdt_array); // geometry may differ from previous mount
+    free(filetable_array);
+    ufdt_array = (struct ufdt *)calloc(MAX_INODES, sizeof(struct ufdt));
+    filetable_array = (struct filetable *)calloc(MAX_INODES, sizeof(struct filetable));
+    if (ufdt_array == NULL || filetable_array == NULL)
+        return -1;
+
+    for (counter = 0; counter < MAX_INODES; counter++)
+        pthread_mutex_init(&(filetable_array[counter].offset_lock), NULL);
+    descriptor_hint = 0;
+    initialize_directories();
+    unit_cache_reset(); // blocks cached units came from belong to previous mount
+    if (dedup_reset() != 0)
+        return -1;
+    return 0;
+}
+
+// empty name index is set up in 'shards' and zero filled 'slots' of a shared memory segment, or in memory of this
+// process when 'slots' is NULL, returns -1 if memory allocation failed
+int initialize_index(struct index_shard *shards, struct index_entry *slots)
+{
+    int counter;
+
+    if (name_index == local_index)
+        free(index_slots); // geometry may differ from previous mount
+    index_slots = slots;
+    name_index = shards;
+    if (slots == NULL && (index_slots = (struct index_entry *)calloc((long long)INDEX_SHARDS * SHARD_SIZE, sizeof(struct index_entry))) == NULL)
+        return -1;
+
+    for (counter = 0; counter < INDEX_SHARDS; counter++)
+    {
+        init_rwlock(&(name_index[counter].lock));
+        name_index[counter].used = 0;
+        name_index[counter].deleted = 0;
+    }
+    return 0;
+}
+
+// state which was in a shared memory segment is kept in memory of this process again (segment was unmapped)
+void use_process_memory()
+{
+    process_shared = 0;
+    name_index = local_index;
+    index_slots = NULL;
+    block_shares = NULL;
+    shared_block_count = &local_shared_block_count;
+    inode_alloc_lock = &local_inode_alloc_lock;
+    block_alloc_lock = &local_block_alloc_lock;
+    share_unit_sequence(NULL);
+}
+
+void initialize_superblock()
+{
+    super_block->total_inodes = MAX_INODES;
+    super_block->free_inodes = MAX_INODES;
+    super_block->total_blocks = MAX_BLOCKS - 1; // block 0 is never used
+    super_block->free_blocks = MAX_BLOCKS - 1;
+    super_block->initialized_inodes = 0;
+    super_block->free_inode_list = -1;
+    super_block->initialized_blocks = 1;
+    super_block->free_block_count = 0;
+}
+
+// name index is not stored in image, it is built again from inodes when image is mounted
+void index_rebuild()
+{
+    int counter;
+    struct inode *inode_ptr;
+    unsigned int hash;
+
+    for (counter = 0; counter < super_block->initialized_inodes; counter++)
+    {
+        inode_ptr = &inode_table[counter];
+        if (inode_ptr->file_type == 0 || inode_ptr->link_count == 0)
+            continue;
+
+        hash = entry_hash(inode_ptr->parent_inode, inode_ptr->file_name);
+        shard_insert(get_shard(hash), hash, inode_ptr);
+        if (inode_ptr->parent_inode != 0)
+            ATOMIC_ADD(&(inode_table[inode_ptr->parent_inode - 1].entry_count), 1);
+    }
+}
+
+void count_owners(int *slots, int count)
+{
+    int counter;
+
+    for (counter = 0; counter < count; counter++)
+    {
+        if (slots[counter] != 0)
+            block_shares[slots[counter]]++;
+    }
+}
+
+// counts of shared blocks are not stored in image either, they are counted again from block tables of inodes
+// (must run before reset_inodes() releases blocks of removed files), returns -1 if memory allocation failed
+int shares_rebuild()
+{
+    int counter;
+    int slot;
+    int *table = NULL;
+    struct inode *inode_ptr;
+
+    free(block_shares);
+    if ((block_shares = (int *)calloc(MAX_BLOCKS, sizeof(int))) == NULL)
+        return -1;
+
+    for (counter = 0; counter < super_block->initialized_inodes; counter++)
+    {
+        inode_ptr = &inode_table[counter];
+        if (inode_ptr->file_type == 0)
+            continue;
+
+        count_owners(inode_ptr->direct_blocks, DIRECT_BLOCKS);
+        if (inode_ptr->indirect_block != 0)
+            count_owners((int *)block_address(inode_ptr->indirect_block), POINTERS_PER_BLOCK);
+        if (inode_ptr->double_indirect_block != 0)
+        {
+            table = (int *)block_address(inode_ptr->double_indirect_block);
+            for (slot = 0; slot < POINTERS_PER_BLOCK; slot++)
+            {
+                if (table[slot] != 0)
+                    count_owners((int *)block_address(table[slot]), POINTERS_PER_BLOCK);
+            }
+        }
+    }
+
+    *shared_block_count = 0;
+    for (counter = 1; counter < super_block->initialized_blocks; counter++)
+    {
+        if (block_shares[counter] > 0)
+            block_shares[counter]--; // first owner is not counted
+        *shared_block_count += block_shares[counter];
+    }
+    return 0;
+}
+
+int create_dilb()
+{
+    // only address space is reserved here, inodes are initialized one by one when they are needed (see get_free_inode())
+    inode_table = (struct inode *)aligned_alloc(CACHE_LINE, MAX_INODES * sizeof(struct inode));
+    if (inode_table == NULL)
+        return -1; // memory allocation failed
+
+    return 0;
+}
+
+int cvfs_init(void)
+{
+    set_geometry(geometry.max_inodes, geometry.max_blocks, geometry.block_size);
+    if (create_dilb() != 0 || create_block_pool() != 0 || initialize_tables() != 0 || initialize_index(local_index, NULL) != 0)
+        return -1; // memory allocation failed
+
+    initialize_superblock();
+    return 0;
+}
+
+struct inode *get_free_inode()
+{
+    struct inode *inode_ptr = NULL;
+
+    pthread_mutex_lock(inode_alloc_lock);
+    if (super_block->free_inode_list != -1) // reuse most recently released inode
+    {
+        inode_ptr = &inode_table[super_block->free_inode_list];
+        super_block->free_inode_list = inode_ptr->next_free_inode;
+    }
+    else if (super_block->initialized_inodes < MAX_INODES)
+    {
+        inode_ptr = &inode_table[super_block->initialized_inodes]; // first use of this inode, initialize it now
+        inode_ptr->inode_number = super_block->initialized_inodes + 1;
+        inode_ptr->file_size = 0;
+        inode_ptr->file_actual_size = 0;
+        inode_ptr->file_type = 0;
+        memset(inode_ptr->direct_blocks, 0, sizeof(inode_ptr->direct_blocks));
+        inode_ptr->indirect_block = 0;
+        inode_ptr->double_indirect_block = 0;
+        inode_ptr->link_count = 0;
+        inode_ptr->reference_count = 0;
+        inode_ptr->permission = 0;
+        inode_ptr->file_desc = -1;
+        inode_ptr->open_count = 0;
+        inode_ptr->parent_inode = 0;
+        inode_ptr->entry_count = 0;
+        inode_ptr->next_free_inode = -1;
+        inode_ptr->compression = 0;
+        init_rwlock(&(inode_ptr->lock));
+        ATOMIC_STORE(&(super_block->initialized_inodes), super_block->initialized_inodes + 1); // inode is visible to cvfs_next_file() from now
+    }
+
+    if (inode_ptr != NULL)
+    {
+        ATOMIC_ADD(&(super_block->free_inodes), -1); // decrementing the count of free inodes
+        journal_log(super_block, sizeof(struct superblock));
+        log_inode(inode_ptr);
+    }
+    pthread_mutex_unlock(inode_alloc_lock);
+
+    return inode_ptr; // NULL if every inode is in use
+}
+
+void release_inode(struct inode *inode_ptr)
+{
+    pthread_mutex_lock(inode_alloc_lock);
+    inode_ptr->next_free_inode = super_block->free_inode_list;
+    super_block->free_inode_list = inode_ptr->inode_number - 1;
+    ATOMIC_ADD(&(super_block->free_inodes), 1);
+    journal_log(super_block, sizeof(struct superblock));
+    log_inode(inode_ptr);
+    pthread_mutex_unlock(inode_alloc_lock);
+}
+
+// persistent part of inode (fields before reference_count are stored in image, the rest is rebuilt at mount)
+void log_inode(struct inode *inode_ptr)
+{
+    journal_log(inode_ptr, offsetof(struct inode, reference_count));
+}
+
+// data or size of file changed, next backup has to copy it again (called with inode write lock)
+void inode_changed(struct inode *inode_ptr)
+{
+    inode_ptr->change_generation++;
+    log_inode(inode_ptr);
+}
+
+void inode_put(struct inode *inode_ptr)
+{
+    if (ATOMIC_ADD(&(inode_ptr->reference_count), -1) != 0)
+        return;
+
+    // file name is removed and no file table or call is using the inode anymore
+    journal_begin();
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+    release_file_blocks(inode_ptr, 0); // giving data blocks back to block pool
+    inode_ptr->file_type = 0;          // most important (dependency in cvfs_next_file() and cvfs_backup())
+    inode_ptr->file_actual_size = 0;
+    inode_ptr->permission = 0;
+    ATOMIC_STORE(&(inode_ptr->file_desc), -1);
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    release_inode(inode_ptr); // inode can be given to next created file
+    journal_end();
+}
+
+void fill_stat(struct inode *inode_ptr, struct cvfs_stat *stat_buf)
+{
+    strcpy(stat_buf->file_name, inode_ptr->file_name);
+    stat_buf->inode_number = inode_ptr->inode_number;
+    stat_buf->file_size = inode_ptr->file_size;
+    stat_buf->file_actual_size = inode_ptr->file_actual_size;
+    stat_buf->file_type = inode_ptr->file_type;
+    stat_buf->link_count = inode_ptr->link_count;
+    stat_buf->reference_count = ATOMIC_LOAD(&(inode_ptr->reference_count));
+    stat_buf->permission = inode_ptr->permission;
+    stat_buf->compression = inode_ptr->compression;
+}
+
+// returns file table with an extra reference (release with put_filetable()), NULL if descriptor is not opened
+struct filetable *get_filetable(int fd)
+{
+    int count;
+    struct filetable *filetable_ptr = NULL;
+
+    if (fd < 0 || fd >= MAX_INODES)
+        return NULL; // file descriptor not valid
+
+    filetable_ptr = ATOMIC_LOAD(&(ufdt_array[fd].ptr_filetable));
+    if (filetable_ptr == NULL)
+        return NULL; // file is not opened
+
+    count = ATOMIC_LOAD(&(filetable_ptr->reference_count));
+    do
+    {
+        if (count == 0)
+            return NULL; // file was closed meanwhile
+    } while (!ATOMIC_CAS(&(filetable_ptr->reference_count), &count, count + 1));
+
+    return filetable_ptr;
+}
+
+int descriptor_points_at(int fd, struct inode *inode_ptr)
+{
+    struct filetable *filetable_ptr = ATOMIC_LOAD(&(ufdt_array[fd].ptr_filetable));
+
+    return (filetable_ptr != NULL) && (ATOMIC_LOAD(&(filetable_ptr->ptr_inode)) == inode_ptr);
+}
+
+// returns a descriptor of this process whose file table points at inode, -1 if there is none
+int find_file_desc(struct inode *inode_ptr)
+{
+    int counter;
+
+    for (counter = 0; counter < MAX_INODES; counter++)
+    {
+        if (descriptor_points_at(counter, inode_ptr))
+            return counter;
+    }
+    return -1;
+}
+
+void refresh_file_desc(struct inode *inode_ptr)
+{
+    ATOMIC_STORE(&(inode_ptr->file_desc), find_file_desc(inode_ptr)); // searching any other file table pointing at this inode
+}
+
+void put_filetable(struct filetable *filetable_ptr)
+{
+    int fd = filetable_ptr - filetable_array;
+    struct inode *inode_ptr = filetable_ptr->ptr_inode; // file table may be reused as soon as its count drops to 0
+
+    if (ATOMIC_ADD(&(filetable_ptr->reference_count), -1) != 0)
+        return;
+
+    // descriptor is closed and no call is using it, so file table is free now
+    if (fd < ATOMIC_LOAD(&descriptor_hint))
+        ATOMIC_STORE(&descriptor_hint, fd);
+
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+    inode_ptr->open_count--;
+    if (inode_ptr->file_desc == fd && inode_ptr->open_count == 0)
+        ATOMIC_STORE(&(inode_ptr->file_desc), -1);
+    else if (inode_ptr->file_desc == fd) // file is still opened with another descriptor
+        refresh_file_desc(inode_ptr);
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    inode_put(inode_ptr); // decrementing reference count of inode
+}
+
+int get_free_file_desc()
+{
+    int counter;
+    int expected;
+    int fd = ATOMIC_LOAD(&descriptor_hint);
+
+    for (counter = 0; counter < MAX_INODES; counter++, fd++)
+    {
+        if (fd >= MAX_INODES)
+            fd = 0; // descriptors below hint may have been closed meanwhile
+
+        expected = 0;
+        if ((ATOMIC_LOAD(&(ufdt_array[fd].ptr_filetable)) == NULL) && ATOMIC_CAS(&(filetable_array[fd].reference_count), &expected, 1))
+        {
+            ATOMIC_STORE(&descriptor_hint, fd + 1);
+            return fd; // file table is claimed, caller initializes it and then publishes it in UFDT
+        }
+    }
+    return -1; // every file descriptor is in use
+}
+
+int cvfs_close(int fd)
+{
+    struct filetable *filetable_ptr = NULL;
+
+    if (fd < 0 || fd >= MAX_INODES)
+        return -1; // file descriptor not valid
+
+    filetable_ptr = ATOMIC_LOAD(&(ufdt_array[fd].ptr_filetable));
+    if ((filetable_ptr == NULL) || !ATOMIC_CAS(&(ufdt_array[fd].ptr_filetable), &filetable_ptr, (struct filetable *)NULL))
+        return -1; // file already closed or file does not exists
+
+    put_filetable(filetable_ptr); // dropping the reference held by open descriptor
+    return 0;
+}
+
+void cvfs_close_all(void)
+{
+    int counter;
+
+    for (counter = 0; counter < MAX_INODES; counter++)
+        cvfs_close(counter);
+}
+
+int cvfs_get_fd(const char *file_name)
+{
+    int file_desc;
+    struct inode *inode_ptr = path_lookup(file_name);
+
+    if (inode_ptr == NULL)
+        return -1; // there is no such file
+
+    file_desc = ATOMIC_LOAD(&(inode_ptr->file_desc));
+    if (process_shared && (file_desc == -1 || !descriptor_points_at(file_desc, inode_ptr)))
+        file_desc = find_file_desc(inode_ptr); // inode of a shared segment may hold a descriptor of another process
+    inode_put(inode_ptr);
+
+    if (file_desc == -1)
+        return -2; // file is not opened
+
+    return file_desc; // returning file descriptor
+}
+
+int cvfs_stat(const char *file_name, struct cvfs_stat *stat_buf)
+{
+    struct inode *inode_ptr = path_lookup(file_name);
+
+    if (inode_ptr == NULL)
+        return -1; // there is no such file
+
+    pthread_rwlock_rdlock(&(inode_ptr->lock));
+    fill_stat(inode_ptr, stat_buf);
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    inode_put(inode_ptr);
+    return 0;
+}
+
+void cvfs_statfs(struct cvfs_statfs *statfs_buf)
+{
+    memset(statfs_buf, 0, sizeof(*statfs_buf));
+    statfs_buf->block_size = BLOCK_SIZE;
+    statfs_buf->total_inodes = super_block->total_inodes;
+    statfs_buf->free_inodes = ATOMIC_LOAD(&(super_block->free_inodes));
+    statfs_buf->total_blocks = super_block->total_blocks;
+    statfs_buf->free_blocks = ATOMIC_LOAD(&(super_block->free_blocks));
+    statfs_buf->referenced_blocks = statfs_buf->total_blocks - statfs_buf->free_blocks + ATOMIC_LOAD(shared_block_count);
+    statfs_buf->deduplicated_blocks = ATOMIC_LOAD(&dedup_merged);
+    tier_statfs(statfs_buf);
+}
+
+int cvfs_fstat(int fd, struct cvfs_stat *stat_buf)
+{
+    struct filetable *filetable_ptr = get_filetable(fd);
+
+    if (filetable_ptr == NULL)
+        return -1; // file is not opened
+
+    pthread_rwlock_rdlock(&(filetable_ptr->ptr_inode->lock));
+    fill_stat(filetable_ptr->ptr_inode, stat_buf);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+
+    put_filetable(filetable_ptr);
+    return 0;
+}
+
+int cvfs_next_file(int position, struct cvfs_stat *stat_buf)
+{
+    int found;
+    struct inode *inode_ptr = NULL;
+
+    for (; position < ATOMIC_LOAD(&(super_block->initialized_inodes)); position++)
+    {
+        inode_ptr = &inode_table[position];
+
+        pthread_rwlock_rdlock(&(inode_ptr->lock));
+        found = (inode_ptr->file_type != 0 && inode_ptr->link_count != 0); // file type is non zero means file exists
+        if (found)
+            fill_stat(inode_ptr, stat_buf);
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+
+        if (found)
+            return position;
+    }
+    return -1; // there are no more files
+}
+
+void drop_entry(int parent)
+{
+    if (parent != 0)
+        ATOMIC_ADD(&(inode_table[parent - 1].entry_count), -1); // directory has one file less
+}
+
+// creates 'name' in directory 'dir_ptr' (NULL for root), returns descriptor of new regular file (0 for new directory)
+// -1: directory was removed, -2: no free inode, -3: file already exists, -4: no free file descriptor
+int create_entry(struct inode *dir_ptr, const char *name, int file_type, int permission)
+{
+    int counter = -1;
+    int parent = (dir_ptr == NULL) ? 0 : dir_ptr->inode_number;
+    unsigned int hash;
+    struct inode *new_inode = NULL;
+    struct filetable *filetable_ptr = NULL;
+    struct index_shard *shard = NULL;
+
+    hash = entry_hash(parent, name);
+    shard = get_shard(hash);
+
+    pthread_rwlock_wrlock(&(shard->lock)); // no other file with same name can be created meanwhile
+    if (shard_find(shard, hash, parent, name) != NULL)
+    {
+        pthread_rwlock_unlock(&(shard->lock));
+        return -3; // file already exists
+    }
+
+    if (dir_ptr != NULL)
+    {
+        pthread_rwlock_wrlock(&(dir_ptr->lock)); // directory is either removed before or it is not empty anymore
+        if (dir_ptr->link_count == 0)
+        {
+            pthread_rwlock_unlock(&(dir_ptr->lock));
+            pthread_rwlock_unlock(&(shard->lock));
+            return -1; // directory was removed
+        }
+        ATOMIC_ADD(&(dir_ptr->entry_count), 1);
+        pthread_rwlock_unlock(&(dir_ptr->lock));
+    }
+
+    if ((new_inode = get_free_inode()) == NULL)
+    {
+        drop_entry(parent);
+        pthread_rwlock_unlock(&(shard->lock));
+        return -2; // there is no enough space
+    }
+
+    if (file_type == REGULAR && (counter = get_free_file_desc()) == -1)
+    {
+        release_inode(new_inode);
+        drop_entry(parent);
+        pthread_rwlock_unlock(&(shard->lock));
+        return -4; // there is no free file descriptor
+    }
+
+    // initializing new inode
+    pthread_rwlock_wrlock(&(new_inode->lock));
+    strcpy(new_inode->file_name, name);
+    new_inode->parent_inode = parent;
+    new_inode->file_desc = counter;
+    new_inode->open_count = (file_type == REGULAR) ? 1 : 0;
+    new_inode->entry_count = 0;
+    new_inode->file_actual_size = 0;
+    new_inode->file_size = 0; // blocks are allocated when data is written
+    new_inode->file_type = file_type;
+    new_inode->permission = permission;
+    new_inode->compression = (file_type == REGULAR) ? ATOMIC_LOAD(&compress_new_files) : 0;
+    new_inode->reference_count = (file_type == REGULAR) ? 2 : 1; // one for file name and one for file table
+    new_inode->link_count = 1;
+    new_inode->change_generation = 1;
+    new_inode->backup_generation = 0; // new file is always copied by next backup
+    log_inode(new_inode);
+    pthread_rwlock_unlock(&(new_inode->lock));
+
+    if (shard_insert(shard, hash, new_inode) == -1) // file can be searched by name from now
+    {
+        if (counter != -1)
+            ATOMIC_STORE(&(filetable_array[counter].reference_count), 0);
+        new_inode->file_type = 0;
+        release_inode(new_inode);
+        drop_entry(parent);
+        pthread_rwlock_unlock(&(shard->lock));
+        return -2; // there is no space in name index
+    }
+
+    if (file_type == REGULAR)
+    {
+        // initialize file table
+        filetable_ptr = &filetable_array[counter];
+        filetable_ptr->mode = permission;
+        filetable_ptr->read_offset = 0;
+        filetable_ptr->write_offset = 0;
+        ATOMIC_STORE(&(filetable_ptr->ptr_inode), new_inode);
+        ATOMIC_STORE(&(ufdt_array[counter].ptr_filetable), filetable_ptr);
+    }
+
+    pthread_rwlock_unlock(&(shard->lock));
+    return (file_type == REGULAR) ? counter : 0;
+}
+
+int cvfs_create(const char *file_name, int permission)
+{
+    long long start = perf_start();
+    int fd;
+    char name[MAX_FILE_NAME];
+    struct inode *dir_ptr = NULL;
+
+    if (file_name == NULL || permission <= 0 || permission > 3 || resolve_parent(file_name, &dir_ptr, name) != 0)
+        return perf_end(PERF_CREATE, start, -1); // incorrect parameters or no such directory
+
+    journal_begin();
+    fd = create_entry(dir_ptr, name, REGULAR, permission);
+    if (journal_end() != 0 && fd >= 0)
+    {
+        cvfs_close(fd);
+        fd = CVFS_JOURNAL_FAILED; // file is not durable
+    }
+
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    return perf_end(PERF_CREATE, start, fd);
+}
+
+// removes name of a file or of an empty directory, -1: no such file, -2: file is not of 'file_type', -3: directory is not empty
+int remove_entry(const char *path, int file_type)
+{
+    int parent;
+    int status = 0;
+    int link_count = 1;
+    unsigned int hash;
+    char name[MAX_FILE_NAME];
+    struct inode *dir_ptr = NULL;
+    struct inode *inode_ptr = NULL;
+    struct index_entry *entry = NULL;
+    struct index_shard *shard = NULL;
+
+    if (path == NULL || resolve_parent(path, &dir_ptr, name) != 0)
+        return -1; // there is no such directory
+    parent = (dir_ptr == NULL) ? 0 : dir_ptr->inode_number;
+
+    hash = entry_hash(parent, name);
+    shard = get_shard(hash);
+
+    journal_begin();
+    pthread_rwlock_wrlock(&(shard->lock));
+    entry = shard_find(shard, hash, parent, name);
+    inode_ptr = (entry == NULL) ? NULL : entry_inode(entry);
+    if (inode_ptr == NULL)
+        status = -1; // there is no such file
+    else if (inode_ptr->file_type != file_type)
+        status = -2; // file is not of 'file_type'
+    else
+    {
+        pthread_rwlock_wrlock(&(inode_ptr->lock)); // files are created in directory only while it holds this lock
+        if (file_type == DIRECTORY && ATOMIC_LOAD(&(inode_ptr->entry_count)) != 0)
+            status = -3; // directory is not empty
+        else
+        {
+            link_count = --(inode_ptr->link_count);
+            log_inode(inode_ptr);
+        }
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+    }
+
+    if (status == 0 && link_count == 0)
+        shard_remove(shard, entry); // file can not be found by name from now
+    pthread_rwlock_unlock(&(shard->lock));
+
+    if (status == 0 && link_count == 0)
+    {
+        if (file_type == DIRECTORY)
+            dcache_clear(); // cached paths may lead to removed directory
+        drop_entry(parent);
+        inode_put(inode_ptr); // dropping reference of file name, inode is freed when its last descriptor is closed
+    }
+
+    if (journal_end() != 0 && status == 0)
+        status = CVFS_JOURNAL_FAILED; // removal is not durable
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    return status;
+}
+
+int cvfs_unlink(const char *file_name)
+{
+    long long start = perf_start();
+
+    return perf_end(PERF_UNLINK, start, remove_entry(file_name, REGULAR));
+}
+
+int cvfs_rmdir(const char *path)
+{
+    return remove_entry(path, DIRECTORY);
+}
+
+int cvfs_clone(const char *source, const char *destination)
+{
+    long long start = perf_start();
+    int fd;
+    int status = 0;
+    int *source_slot = NULL;
+    int *slot = NULL;
+    long long block_index;
+    long long last_block;
+    char name[MAX_FILE_NAME];
+    struct inode *dir_ptr = NULL;
+    struct inode *clone_ptr = NULL;
+    struct inode *source_ptr = path_lookup(source);
+
+    if (source_ptr == NULL)
+        return perf_end(PERF_CLONE, start, -1); // there is no such file
+
+    if (source_ptr->file_type == DIRECTORY || destination == NULL || resolve_parent(destination, &dir_ptr, name) != 0)
+    {
+        status = (source_ptr->file_type == DIRECTORY) ? -2 : -3;
+        inode_put(source_ptr);
+        return perf_end(PERF_CLONE, start, status); // source is a directory or destination is incorrect
+    }
+
+    journal_begin();
+    fd = create_entry(dir_ptr, name, REGULAR, READ + WRITE);
+    if (fd == -1)
+        status = -3; // directory of destination was removed
+    else if (fd == -3)
+        status = -5; // destination already exists
+    else if (fd < 0)
+        status = -4; // there is no free inode or file descriptor
+    else
+    {
+        // clone is new and nobody waits for its lock while holding lock of source, so taking both can not deadlock
+        clone_ptr = filetable_array[fd].ptr_inode;
+        pthread_rwlock_rdlock(&(source_ptr->lock));
+        pthread_rwlock_wrlock(&(clone_ptr->lock));
+        clone_ptr->permission = source_ptr->permission;
+        clone_ptr->compression = source_ptr->compression; // units are shared as they are
+        clone_ptr->file_actual_size = source_ptr->file_actual_size; // also bounds release_file_blocks() if cloning fails
+
+        // only block numbers are copied, data blocks get one more owner and are copied when either file writes them
+        last_block = file_block_count(source_ptr);
+        for (block_index = 0; block_index < last_block; block_index++)
+        {
+            source_slot = get_block_slot(source_ptr, block_index, 0);
+            if (source_slot == NULL || *source_slot == 0)
+                continue; // hole stays a hole
+
+            if ((slot = get_block_slot(clone_ptr, block_index, 1)) == NULL)
+            {
+                status = -6; // there is no free block for indirect blocks of clone
+                break;
+            }
+            ATOMIC_ADD(&block_shares[*source_slot], 1);
+            *slot = *source_slot;
+            journal_log(slot, sizeof(int));
+            clone_ptr->file_size += BLOCK_SIZE;
+        }
+        ATOMIC_ADD(shared_block_count, clone_ptr->file_size / BLOCK_SIZE); // blocks shared so far, released again below on failure
+
+        if (status != 0)
+        {
+            release_file_blocks(clone_ptr, 0);
+            clone_ptr->file_actual_size = 0;
+        }
+        inode_changed(clone_ptr);
+        pthread_rwlock_unlock(&(clone_ptr->lock));
+        pthread_rwlock_unlock(&(source_ptr->lock));
+        cvfs_close(fd);
+    }
+    if (journal_end() != 0 && status == 0)
+        status = CVFS_JOURNAL_FAILED; // clone is not durable
+
+    if (status == -6)
+        remove_entry(destination, REGULAR);
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    inode_put(source_ptr);
+    return perf_end(PERF_CLONE, start, status);
+}
+
+long long write_at(struct filetable *filetable_ptr, const void *buffer, long long count, long long offset)
+{
+    long long written;
+    struct inode *inode_ptr = filetable_ptr->ptr_inode; // for efficiency
+
+    if ((filetable_ptr->mode & WRITE) == 0)
+        return -3; // don't have permission to write
+
+    if (inode_ptr->file_type != REGULAR)
+        return -4; // file is not a regular file
+
+    if (count < 0 || offset < 0)
+        return -5; // nothing can be written there
+
+    written = copy_to_file(inode_ptr, offset, (const char *)buffer, count, 0); // write data into file blocks
+
+    if (written == 0 && count > 0)
+        return -5; // there is no space
+
+    if (offset + written > inode_ptr->file_actual_size) // adjusting file actual size
+        inode_ptr->file_actual_size = offset + written;
+    inode_changed(inode_ptr);
+
+    return written;
+}
+
+long long cvfs_write(int fd, const void *buffer, long long count)
+{
+    long long start = perf_start();
+    long long written;
+    struct filetable *filetable_ptr = get_filetable(fd);
+
+    if (filetable_ptr == NULL)
+        return perf_end(PERF_WRITE, start, -1); // file is not opened
+
+    journal_begin();
+    pthread_mutex_lock(&(filetable_ptr->offset_lock));
+    pthread_rwlock_wrlock(&(filetable_ptr->ptr_inode->lock));
+
+    written = write_at(filetable_ptr, buffer, count, filetable_ptr->write_offset);
+    if (written > 0)
+        filetable_ptr->write_offset += written; // adjusting write offset from file table
+
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+    pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+
+    put_filetable(filetable_ptr);
+    if (journal_end() != 0 && written >= 0)
+        written = CVFS_JOURNAL_FAILED; // data is not durable
+    return perf_end(PERF_WRITE, start, written);
+}
+
+long long cvfs_pwrite(int fd, const void *buffer, long long count, long long offset)
+{
+    long long start = perf_start();
+    long long written;
+    struct filetable *filetable_ptr = get_filetable(fd);
+
+    if (filetable_ptr == NULL)
+        return perf_end(PERF_WRITE, start, -1); // file is not opened
+
+    journal_begin();
+    pthread_rwlock_wrlock(&(filetable_ptr->ptr_inode->lock));
+    written = write_at(filetable_ptr, buffer, count, offset);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+
+    put_filetable(filetable_ptr);
+    if (journal_end() != 0 && written >= 0)
+        written = CVFS_JOURNAL_FAILED; // data is not durable
+    return perf_end(PERF_WRITE, start, written);
+}
+
+long long iov_total(const struct cvfs_iovec *iov, int iov_count)
+{
+    int counter;
+    long long total = 0;
+
+    if (iov == NULL || iov_count < 1 || iov_count > CVFS_IOV_MAX)
+        return -2; // invalid vector
+
+    for (counter = 0; counter < iov_count; counter++)
+    {
+        if (iov[counter].length < 0)
+            return -2;
+        total += iov[counter].length;
+    }
+    return total;
+}
+
+// writes gathered bytes, 0 if all of them were written
+int flush_gathered(struct filetable *filetable_ptr, const char *buffer, long long *gathered, long long offset, long long *written)
+{
+    long long result = write_at(filetable_ptr, buffer, *gathered, offset + *written);
+
+    if (result > 0)
+        *written += result;
+    if (result == *gathered)
+        result = 0;
+    else if (result >= 0)
+        result = -5; // there is no more space
+    *gathered = 0;
+    return (int)result;
+}
+
+// buffers of a compressed file are gathered up to end of a unit, so a unit is packed once and not once per buffer
+long long writev_units(struct filetable *filetable_ptr, const struct cvfs_iovec *iov, int iov_count, long long offset)
+{
+    int counter;
+    int status = 0;
+    long long done;
+    long long chunk;
+    long long gathered = 0;
+    long long written = 0;
+    char *buffer = (char *)malloc(UNIT_SIZE);
+
+    if (buffer == NULL)
+        return -5; // nothing can be written
+
+    for (counter = 0; counter < iov_count && status == 0; counter++)
+    {
+        for (done = 0; done < iov[counter].length && status == 0; done += chunk)
+        {
+            chunk = UNIT_SIZE - ((offset + written + gathered) & (UNIT_SIZE - 1)); // room left in current unit
+            if (chunk > iov[counter].length - done)
+                chunk = iov[counter].length - done;
+            memcpy(buffer + gathered, (const char *)iov[counter].base + done, chunk);
+            gathered += chunk;
+
+            if (((offset + written + gathered) & (UNIT_SIZE - 1)) == 0)
+                status = flush_gathered(filetable_ptr, buffer, &gathered, offset, &written);
+        }
+    }
+    if (status == 0 && gathered > 0)
+        status = flush_gathered(filetable_ptr, buffer, &gathered, offset, &written);
+    free(buffer);
+
+    return (written == 0 && status < 0) ? status : written;
+}
+
+// caller holds write lock of inode
+long long writev_at(struct filetable *filetable_ptr, const struct cvfs_iovec *iov, int iov_count, long long offset)
+{
+    int counter;
+    long long written = 0;
+    long long result;
+
+    if (filetable_ptr->ptr_inode->compression && iov_count > 1 && (filetable_ptr->mode & WRITE) != 0)
+        return writev_units(filetable_ptr, iov, iov_count, offset);
+
+    for (counter = 0; counter < iov_count; counter++)
+    {
+        result = write_at(filetable_ptr, iov[counter].base, iov[counter].length, offset + written);
+        if (result < 0)
+            return (written == 0) ? result : written; // error is reported only if nothing was written
+        written += result;
+        if (result < iov[counter].length)
+            break; // there is no more space
+    }
+    return written;
+}
+
+long long cvfs_writev(int fd, const struct cvfs_iovec *iov, int iov_count)
+{
+    long long start = perf_start();
+    long long written;
+    struct filetable *filetable_ptr;
+
+    if (iov_total(iov, iov_count) < 0)
+        return perf_end(PERF_WRITE, start, -2); // invalid vector
+    if ((filetable_ptr = get_filetable(fd)) == NULL)
+        return perf_end(PERF_WRITE, start, -1); // file is not opened
+
+    journal_begin();
+    pthread_mutex_lock(&(filetable_ptr->offset_lock));
+    pthread_rwlock_wrlock(&(filetable_ptr->ptr_inode->lock));
+
+    written = writev_at(filetable_ptr, iov, iov_count, filetable_ptr->write_offset);
+    if (written > 0)
+        filetable_ptr->write_offset += written;
+
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+    pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+
+    put_filetable(filetable_ptr);
+    if (journal_end() != 0 && written >= 0)
+        written = CVFS_JOURNAL_FAILED; // data is not durable
+    return perf_end(PERF_WRITE, start, written);
+}
+
+long long cvfs_pwritev(int fd, const struct cvfs_iovec *iov, int iov_count, long long offset)
+{
+    long long start = perf_start();
+    long long written;
+    struct filetable *filetable_ptr;
+
+    if (iov_total(iov, iov_count) < 0)
+        return perf_end(PERF_WRITE, start, -2); // invalid vector
+    if ((filetable_ptr = get_filetable(fd)) == NULL)
+        return perf_end(PERF_WRITE, start, -1); // file is not opened
+
+    journal_begin();
+    pthread_rwlock_wrlock(&(filetable_ptr->ptr_inode->lock));
+    written = writev_at(filetable_ptr, iov, iov_count, offset);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+
+    put_filetable(filetable_ptr);
+    if (journal_end() != 0 && written >= 0)
+        written = CVFS_JOURNAL_FAILED; // data is not durable
+    return perf_end(PERF_WRITE, start, written);
+}
+
+int cvfs_truncate(const char *file_name, long long size)
+{
+    long long start = perf_start();
+    int status = 0;
+    char *block = NULL;
+    struct inode *inode_ptr = path_lookup(file_name);
+    struct filetable *filetable_ptr = NULL;
+
+    if (inode_ptr == NULL)
+        return perf_end(PERF_TRUNCATE, start, -1); // there is no such file
+
+    if (inode_ptr->file_type == DIRECTORY)
+    {
+        inode_put(inode_ptr);
+        return perf_end(PERF_TRUNCATE, start, -3); // directory has no data
+    }
+
+    if (size < 0 || size > MAX_FILE_BLOCKS * BLOCK_SIZE)
+    {
+        inode_put(inode_ptr);
+        return perf_end(PERF_TRUNCATE, start, -2); // invalid size
+    }
+
+    journal_begin();
+    filetable_ptr = get_filetable(ATOMIC_LOAD(&(inode_ptr->file_desc))); // offsets of this file table are adjusted below
+    if (filetable_ptr != NULL && filetable_ptr->ptr_inode != inode_ptr)
+    {
+        put_filetable(filetable_ptr); // descriptor was reused for another file meanwhile
+        filetable_ptr = NULL;
+    }
+
+    if (filetable_ptr != NULL)
+        pthread_mutex_lock(&(filetable_ptr->offset_lock)); // offset lock is always taken before inode lock
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+
+    if (size > inode_ptr->file_actual_size)
+        inode_ptr->file_actual_size = size; // file grows by a hole (data beyond end of file is always zero)
+    else if (inode_ptr->compression)
+    {
+        // last unit is compressed again without data beyond new end
+        if (truncate_units(inode_ptr, size) == 0)
+            inode_ptr->file_actual_size = size;
+        else
+            status = -4; // there is no free block for last unit
+    }
+    else
+    {
+        release_file_blocks(inode_ptr, (size + BLOCK_SIZE - 1) / BLOCK_SIZE); // truncating data w.r.t 'size'
+        if ((size % BLOCK_SIZE != 0) && get_file_block(inode_ptr, size / BLOCK_SIZE, 0) != NULL &&
+            (block = get_file_block(inode_ptr, size / BLOCK_SIZE, 1)) != NULL) // only an existing block is cleared
+        {
+            memset(block + size % BLOCK_SIZE, 0, BLOCK_SIZE - size % BLOCK_SIZE); // clearing tail of last block
+            journal_log(block + size % BLOCK_SIZE, BLOCK_SIZE - size % BLOCK_SIZE);
+        }
+        inode_ptr->file_actual_size = size; // adjusting actual size of file
+    }
+
+    if (status == 0 && filetable_ptr != NULL) // if file is open
+    {
+        if (filetable_ptr->write_offset > size) // if write offset is greater than the given 'size'
+            filetable_ptr->write_offset = size; // adjust write offset from file table
+        if (filetable_ptr->read_offset > size)  // if read offset is greater than the given 'size'
+            filetable_ptr->read_offset = size;  // adjust read offset from file table
+    }
+    inode_changed(inode_ptr);
+
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+    if (filetable_ptr != NULL)
+    {
+        pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+        put_filetable(filetable_ptr);
+    }
+
+    inode_put(inode_ptr);
+    if (journal_end() != 0 && status == 0)
+        status = CVFS_JOURNAL_FAILED; // new size is not durable
+    return perf_end(PERF_TRUNCATE, start, status);
+}
+
+int cvfs_open(const char *file_name, int mode)
+{
+    long long start = perf_start();
+    int counter;
+    struct inode *inode_ptr = path_lookup(file_name);
+    struct filetable *filetable_ptr = NULL;
+
+    if (inode_ptr == NULL)
+        return perf_end(PERF_OPEN, start, -1); // there is no such file
+
+    if (inode_ptr->file_type == DIRECTORY)
+    {
+        inode_put(inode_ptr);
+        return perf_end(PERF_OPEN, start, -5); // directories are not opened
+    }
+
+    if (mode < 1 || mode > 7)
+    {
+        inode_put(inode_ptr);
+        return perf_end(PERF_OPEN, start, -2); // invalid opening mode
+    }
+
+    if (((inode_ptr->permission == READ) && (mode == WRITE || mode == (READ + WRITE) || mode == (WRITE + APPEND) || mode == (READ + WRITE + APPEND))) || ((inode_ptr->permission == WRITE) && (mode == READ || mode == (READ + WRITE) || mode == (READ + APPEND) || (READ + WRITE + APPEND))))
+    {
+        // checking if the permissions are
+        inode_put(inode_ptr);
+        return perf_end(PERF_OPEN, start, -3); // don't have permissions to open
+    }
+
+    if ((counter = get_free_file_desc()) == -1)
+    {
+        inode_put(inode_ptr);
+        return perf_end(PERF_OPEN, start, -4); // there is no free file descriptor
+    }
+
+    filetable_ptr = &filetable_array[counter];
+    filetable_ptr->read_offset = 0;       // set read offset to 0
+    filetable_ptr->mode = mode;           // set file opening mode in file table
+    ATOMIC_STORE(&(filetable_ptr->ptr_inode), inode_ptr); // reference taken by lookup now belongs to file table
+
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+    if (mode == READ + APPEND || mode == APPEND || mode == WRITE + APPEND || mode == READ + WRITE + APPEND) // if append opned in append mode
+        filetable_ptr->write_offset = inode_ptr->file_actual_size;                                          // then set write offset to end of the file
+    else
+        filetable_ptr->write_offset = 0; // else set write offset to 0
+
+    ATOMIC_STORE(&(ufdt_array[counter].ptr_filetable), filetable_ptr);
+
+    inode_ptr->open_count++;
+    if (inode_ptr->file_desc == -1) // name based shell commands use this descriptor
+        ATOMIC_STORE(&(inode_ptr->file_desc), counter);
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    return perf_end(PERF_OPEN, start, counter);
+}
+
+long long read_at(struct filetable *filetable_ptr, void *buffer, long long count, long long offset)
+{
+    if ((filetable_ptr->mode & READ) == 0)
+        return -3; // don't have pemission to read
+
+    if (count <= 0 || offset < 0)
+        return 0; // nothing to read
+
+    return copy_from_file(filetable_ptr->ptr_inode, offset, (char *)buffer, count);
+}
+
+long long cvfs_read(int fd, void *buffer, long long count)
+{
+    long long start = perf_start();
+    long long read_bytes;
+    struct filetable *filetable_ptr = get_filetable(fd);
+
+    if (filetable_ptr == NULL)
+        return perf_end(PERF_READ, start, -1); // file is not opened
+
+    pthread_mutex_lock(&(filetable_ptr->offset_lock));
+    pthread_rwlock_rdlock(&(filetable_ptr->ptr_inode->lock));
+
+    read_bytes = read_at(filetable_ptr, buffer, count, filetable_ptr->read_offset);
+    if (read_bytes > 0)
+        filetable_ptr->read_offset += read_bytes; // update the read offset of file
+
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+    pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+
+    put_filetable(filetable_ptr);
+    return perf_end(PERF_READ, start, read_bytes);
+}
+
+long long cvfs_pread(int fd, void *buffer, long long count, long long offset)
+{
+    long long start = perf_start();
+    long long read_bytes;
+    struct filetable *filetable_ptr = get_filetable(fd);
+
+    if (filetable_ptr == NULL)
+        return perf_end(PERF_READ, start, -1); // file is not opened
+
+    pthread_rwlock_rdlock(&(filetable_ptr->ptr_inode->lock));
+    read_bytes = read_at(filetable_ptr, buffer, count, offset);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+
+    put_filetable(filetable_ptr);
+    return perf_end(PERF_READ, start, read_bytes);
+}
+
+// caller holds read lock of inode
+long long readv_at(struct filetable *filetable_ptr, const struct cvfs_iovec *iov, int iov_count, long long offset)
+{
+    int counter;
+    long long read_bytes = 0;
+    long long result;
+
+    for (counter = 0; counter < iov_count; counter++)
+    {
+        result = read_at(filetable_ptr, iov[counter].base, iov[counter].length, offset + read_bytes);
+        if (result < 0)
+            return result; // don't have permission to read
+        read_bytes += result;
+        if (result < iov[counter].length)
+            break; // end of file
+    }
+    return read_bytes;
+}
+
+long long cvfs_readv(int fd, const struct cvfs_iovec *iov, int iov_count)
+{
+    long long start = perf_start();
+    long long read_bytes;
+    struct filetable *filetable_ptr;
+
+    if (iov_total(iov, iov_count) < 0)
+        return perf_end(PERF_READ, start, -2); // invalid vector
+    if ((filetable_ptr = get_filetable(fd)) == NULL)
+        return perf_end(PERF_READ, start, -1); // file is not opened
+
+    pthread_mutex_lock(&(filetable_ptr->offset_lock));
+    pthread_rwlock_rdlock(&(filetable_ptr->ptr_inode->lock));
+
+    read_bytes = readv_at(filetable_ptr, iov, iov_count, filetable_ptr->read_offset);
+    if (read_bytes > 0)
+        filetable_ptr->read_offset += read_bytes;
+
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+    pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+
+    put_filetable(filetable_ptr);
+    return perf_end(PERF_READ, start, read_bytes);
+}
+
+long long cvfs_preadv(int fd, const struct cvfs_iovec *iov, int iov_count, long long offset)
+{
+    long long start = perf_start();
+    long long read_bytes;
+    struct filetable *filetable_ptr;
+
+    if (iov_total(iov, iov_count) < 0)
+        return perf_end(PERF_READ, start, -2); // invalid vector
+    if ((filetable_ptr = get_filetable(fd)) == NULL)
+        return perf_end(PERF_READ, start, -1); // file is not opened
+
+    pthread_rwlock_rdlock(&(filetable_ptr->ptr_inode->lock));
+    read_bytes = readv_at(filetable_ptr, iov, iov_count, offset);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+
+    put_filetable(filetable_ptr);
+    return perf_end(PERF_READ, start, read_bytes);
+}
+
+// new offset for 'whence', caller holds offset lock and read or write lock of inode
+long long seek_target(struct filetable *filetable_ptr, long long offset, int whence)
+{
+    struct inode *inode_ptr = filetable_ptr->ptr_inode;
+
+    if (whence == SEEK_CUR) // from current read offset
+        offset += filetable_ptr->read_offset;
+    else if (whence == SEEK_END) // from end of file
+        offset += inode_ptr->file_actual_size;
+    else if (whence == SEEK_DATA || whence == SEEK_HOLE)
+    {
+        if (offset < 0 || offset >= inode_ptr->file_actual_size)
+            return (offset < 0) ? -3 : -4; // there is nothing at or after end of file
+        offset = seek_extent(inode_ptr, offset, whence == SEEK_DATA);
+        if (offset == inode_ptr->file_actual_size && whence == SEEK_DATA)
+            return -4; // rest of file is a hole
+    }
+    else if (whence != SEEK_SET)
+        return -3; // invalid argument
+
+    if (offset < 0 || offset > MAX_FILE_BLOCKS * BLOCK_SIZE)
+        return -3; // invalid argument
+    return offset;
+}
+
+long long cvfs_lseek(int fd, long long offset, int whence)
+{
+    long long start = perf_start();
+    long long target;
+    int extends;
+    struct filetable *filetable_ptr = get_filetable(fd);
+    struct inode *inode_ptr;
+
+    if (filetable_ptr == NULL)
+        return perf_end(PERF_LSEEK, start, -1); // file is not opened
+    inode_ptr = filetable_ptr->ptr_inode;
+
+    // a seek within file only reads size, so it does not hold back readers of the file
+    pthread_mutex_lock(&(filetable_ptr->offset_lock));
+    pthread_rwlock_rdlock(&(inode_ptr->lock));
+    target = seek_target(filetable_ptr, offset, whence);
+    extends = (target > inode_ptr->file_actual_size);
+    if (target >= 0 && !extends)
+        filetable_ptr->read_offset = filetable_ptr->write_offset = target; // set read & write offset
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+    pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+
+    if (extends)
+    {
+        // file grows by a hole, transaction comes before offset lock, so offset is found again with write lock
+        journal_begin();
+        pthread_mutex_lock(&(filetable_ptr->offset_lock));
+        pthread_rwlock_wrlock(&(inode_ptr->lock));
+        target = seek_target(filetable_ptr, offset, whence);
+        if (target > inode_ptr->file_actual_size) // blocks are allocated when it is written
+        {
+            inode_ptr->file_actual_size = target;
+            inode_changed(inode_ptr);
+        }
+        if (target >= 0)
+            filetable_ptr->read_offset = filetable_ptr->write_offset = target;
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        pthread_mutex_unlock(&(filetable_ptr->offset_lock));
+        if (journal_end() != 0 && target >= 0)
+            target = CVFS_JOURNAL_FAILED; // new size is not durable
+    }
+
+    put_filetable(filetable_ptr);
+    return perf_end(PERF_LSEEK, start, target);
+}
@@ -0,0 +1,314 @@
+#ifndef CVFS_H
+#define CVFS_H
+
+// read, write, append (permissions of file and opening modes)
+#define READ 1
+#define WRITE 2
+#define APPEND 4
+
+// file type
+#define REGULAR 1
+#define DIRECTORY 2
+
+// lseek
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+#define SEEK_DATA 3 // next offset holding data
+#define SEEK_HOLE 4 // next offset in a hole (end of file is one)
+
+#ifndef MAX_FILE_NAME
+#define MAX_FILE_NAME 50 // including terminating '\0' (programs using the library must be built with the same value)
+#endif
+#define MAX_PATH_LENGTH 1024 // including terminating '\0'
+#define MAX_PATTERN_LENGTH 256 // longest pattern of cvfs_grep()
+
+struct cvfs_stat
+{
+    char file_name[MAX_FILE_NAME];
+    int inode_number;
+    long long file_size;        // bytes of blocks allocated to file
+    long long file_actual_size; // actual size of file
+    int file_type;
+    int link_count;
+    int reference_count;
+    int permission;
+    int compression;            // 1 if data is kept compressed (file_size is then smaller than actual size)
+};
+
+struct cvfs_statfs
+{
+    int block_size;
+    int total_inodes;
+    int free_inodes;
+    long long total_blocks;
+    long long free_blocks;
+    long long referenced_blocks;  // blocks files refer to, a block shared by clones or dedup counts once per file
+    long long deduplicated_blocks; // written blocks which were replaced by an equal block since mount
+    long long budget_blocks;       // most blocks kept in memory (0 if there is no memory budget)
+    long long resident_blocks;     // blocks in memory
+    long long block_hits;          // accesses of blocks which were in memory (counted only with a memory budget)
+    long long block_misses;        // accesses of blocks which were paged back in from backing file
+    long long evicted_blocks;      // blocks written to backing file and dropped from memory
+};
+
+// Every function returns a negative value on failure, the meaning of each value is given above the function.
+
+// sizes file system made by next cvfs_init() or cvfs_mount() of a new image (an existing image keeps its own sizes),
+// 0 keeps current value, there are as many file descriptors as inodes, 'block_size' is a power of 2 from 512 to 1048576
+// -1: file system is already initialized or mounted, -2: invalid sizes (or sizes differ from a fixed geometry build)
+int cvfs_configure(int max_inodes, int max_blocks, int block_size);
+
+int cvfs_init(void); // -1: memory allocation failed or backing file can not be created
+
+// must be called before cvfs_init(), data blocks beyond 'budget_bytes' are kept in backing file 'backing_path' on host
+// (removed once it is open) instead of memory, blocks not used recently are evicted first (0 disables budget)
+// -1: file system is already initialized or mounted, -2: invalid budget or path
+int cvfs_set_memory_budget(long long budget_bytes, const char *backing_path);
+
+// file system is kept in image file on host instead of memory, image is created when it does not exist
+// (use instead of cvfs_init()), -1: image or journal can not be opened or mapped, -2: file is not an image of this file system
+int cvfs_mount(const char *image_path);
+int cvfs_unmount(void);    // closes all files and writes image, -1: no image is mounted, -2: image could not be written
+int cvfs_checkpoint(void); // writes changed pages of image to disk, -1: no image is mounted, -2: image could not be written
+
+// writes image every 'seconds' seconds in background (0 disables), -1: no image is mounted, -2: invalid interval
+int cvfs_set_checkpoint_interval(int seconds);
+
+// must be called before cvfs_mount(), changes are first committed to '<image>.journal' and replayed from it after a crash,
+// a commit waits at most 'commit_latency_ms' for other commits to share its disk flush (-1 disables journal)
+// -1: image is already mounted, -2: invalid latency
+int cvfs_set_journal(int commit_latency_ms);
+
+// returned by calls which change files when journal could not be written, their changes stay in memory but are lost
+// at unmount or crash (every later change fails the same way)
+#define CVFS_JOURNAL_FAILED -10
+
+// file system is kept in POSIX shared memory segment 'segment_name' ("/name"), which other processes mount at the same
+// time to read and write the same files (use instead of cvfs_init()), segment is created when it does not exist,
+// descriptors and current directory belong to the process, cvfs_unmount() leaves segment to other processes
+// (a process which dies while it is in a call may leave locks of segment held), deduplication is turned off
+// -1: segment can not be opened or mapped, -2: segment is not a file system of this build, -3: journal is enabled
+int cvfs_mount_shared(const char *segment_name);
+int cvfs_remove_shared(const char *segment_name); // segment goes away once no process has it mounted, -1: no such segment
+
+// Names of files are paths, absolute ("/dir/file") or relative to current directory ("file", "../dir/file"),
+// every directory on the path must exist. A path is at most MAX_PATH_LENGTH and each name in it MAX_FILE_NAME bytes.
+
+// returns file descriptor, -1: incorrect parameters or no such directory, -2: no free inode, -3: file already exists,
+// -4: no free file descriptor
+int cvfs_create(const char *file_name, int permission);
+
+// returns file descriptor, -1: no such file, -2: invalid mode, -3: permission denied, -4: no free file descriptor,
+// -5: file is a directory
+int cvfs_open(const char *file_name, int mode);
+
+int cvfs_close(int fd); // -1: file is not opened
+void cvfs_close_all(void);
+
+// returns number of bytes copied into 'buffer' (0 at end of file), -1: file is not opened, -3: permission denied
+long long cvfs_read(int fd, void *buffer, long long count);
+long long cvfs_pread(int fd, void *buffer, long long count, long long offset); // does not change file offset
+
+// returns number of bytes written, -1: file is not opened, -3: permission denied, -4: not a regular file, -5: no space
+long long cvfs_write(int fd, const void *buffer, long long count);
+long long cvfs_pwrite(int fd, const void *buffer, long long count, long long offset); // does not change file offset
+
+#define CVFS_IOV_MAX 1024 // most buffers of one vectored call
+
+struct cvfs_iovec
+{
+    void *base;
+    long long length;
+};
+
+// buffers are filled / written one after another as one read or write (another writer never comes in between),
+// transfer stops at first short buffer, returns number of bytes like cvfs_read() / cvfs_write() and
+// -2: 'iov' is NULL or 'iov_count' is not 1 to CVFS_IOV_MAX
+long long cvfs_readv(int fd, const struct cvfs_iovec *iov, int iov_count);
+long long cvfs_writev(int fd, const struct cvfs_iovec *iov, int iov_count);
+long long cvfs_preadv(int fd, const struct cvfs_iovec *iov, int iov_count, long long offset);  // does not change file offset
+long long cvfs_pwritev(int fd, const struct cvfs_iovec *iov, int iov_count, long long offset); // does not change file offset
+
+// returns new offset, -1: file is not opened, -3: invalid argument, -4: offset is at or beyond end of file
+// (SEEK_DATA/SEEK_HOLE) or there is no data after it (SEEK_DATA); offset beyond end of file extends file by a hole
+long long cvfs_lseek(int fd, long long offset, int whence);
+
+// -1: no such file, -2: invalid size, -3: file is a directory, -4: no free block for last unit of compressed file
+int cvfs_truncate(const char *file_name, long long size);
+int cvfs_unlink(const char *file_name);                   // -1: no such file, -2: file is a directory
+
+// creates 'destination' sharing data blocks of 'source' (reflink copy), a shared block is copied when either file writes it
+// -1: no such file, -2: source is a directory, -3: incorrect destination or no such directory, -4: no free inode or
+// file descriptor, -5: destination already exists, -6: no free block for block tables of clone
+int cvfs_clone(const char *source, const char *destination);
+
+int cvfs_mkdir(const char *path);  // -1: incorrect path or no such directory, -2: no free inode, -3: file already exists
+int cvfs_rmdir(const char *path);  // -1: no such directory, -2: not a directory, -3: directory is not empty
+int cvfs_chdir(const char *path);  // changes directory of relative paths, -1: no such directory
+int cvfs_getcwd(char *path, int size); // -1: 'path' is too small
+
+int cvfs_stat(const char *file_name, struct cvfs_stat *stat_buf); // -1: no such file
+int cvfs_fstat(int fd, struct cvfs_stat *stat_buf);               // -1: file is not opened
+void cvfs_statfs(struct cvfs_statfs *statfs_buf);                 // counters of whole file system
+
+// returns descriptor used by name based shell commands, -1: no such file, -2: file is not opened
+int cvfs_get_fd(const char *file_name);
+
+// returns position of first existing file at or after 'position' (-1 if there are no more files)
+int cvfs_next_file(int position, struct cvfs_stat *stat_buf);
+
+// same as cvfs_next_file() for files of one directory, -2: no such directory
+int cvfs_next_entry(const char *path, int position, struct cvfs_stat *stat_buf);
+
+// files created from now on keep their data compressed, in units of 16 blocks which are compressed on their own
+void cvfs_set_compression(int enable);
+
+// compresses data of an existing file or stores it uncompressed again, -1: no such file, -2: file is a directory,
+// -3: no free block
+int cvfs_compress(const char *file_name, int enable);
+
+// from now on every block a write fills is compared with blocks written before, and a file shares an equal block
+// instead of keeping its own copy (blocks written before are not compared), -1: memory allocation failed,
+// -2: file system is in a shared memory segment
+int cvfs_set_dedup(int enable);
+
+struct cvfs_backup_summary
+{
+    int files_copied;
+    int files_skipped;        // not changed since last backup
+    int files_failed;
+    long long bytes_written;
+    double elapsed_seconds;
+};
+
+// copies files into current directory of host using several threads, 'full' 0 copies only files changed since
+// last backup (or whose copy is missing), returns number of files which failed, 'summary' may be NULL
+int cvfs_backup(int full, struct cvfs_backup_summary *summary);
+
+// writes every file into one archive on host, -1: archive can not be written
+int cvfs_backup_archive(const char *archive_path, struct cvfs_backup_summary *summary);
+
+// creates every file of archive (replacing files with same name), returns number of files which failed,
+// -1: archive can not be opened, -2: file is not an archive
+int cvfs_restore_archive(const char *archive_path, struct cvfs_backup_summary *summary);
+
+struct cvfs_grep_summary
+{
+    int files_scanned;
+    int files_matched;
+    int files_failed;         // no such file, not a regular file or no read permission
+    long long matches;
+    long long bytes_scanned;  // bytes of data searched (holes are not searched)
+    double elapsed_seconds;
+};
+
+// searches 'file_names' (every regular file if NULL) for 'pattern' using several threads, 'match' is called for every
+// match with path of file and offset of match (one call at a time, from any of the threads), 'match' and 'summary'
+// may be NULL, returns number of files which contain pattern, -1: pattern is empty or longer than MAX_PATTERN_LENGTH
+int cvfs_grep(const char *pattern, char *file_names[], int file_count, void (*match)(const char *path, long long offset, void *argument),
+              void *argument, struct cvfs_grep_summary *summary);
+
+// instructions searches use, 0: scalar, 1: SSE2, 2: AVX2, -1: best the processor has (the default),
+// returns level which is used (never more than the processor has)
+int cvfs_set_grep_simd(int level);
+
+// Views give read-only access to data of a file in place, without copying it into a buffer. Bytes of a view are
+// those the file held when it was opened: later writes give the file new blocks and blocks removed from the file
+// are kept until view is closed (until then they count like a clone in referenced_blocks and are not free).
+struct cvfs_extent
+{
+    const char *data;
+    long long length;
+};
+
+struct cvfs_view
+{
+    long long offset;                   // offset in file of first byte
+    long long length;                   // bytes in view, less than asked for at end of file
+    int extent_count;
+    struct cvfs_extent *extents;        // contiguous pieces of view in order, holes read as zeros
+    int *pinned;                        // used by cvfs_view_close()
+    int pinned_count;
+    char *copy;
+};
+
+// maps up to 'length' bytes at 'offset' (data of a compressed file is decompressed into memory owned by view),
+// view must be closed before file system is unmounted
+// -1: file is not opened, -2: invalid arguments, -3: don't have permission to read, -4: memory allocation failed
+int cvfs_view_open(int fd, long long offset, long long length, struct cvfs_view *view);
+void cvfs_view_close(struct cvfs_view *view);
+
+// Asynchronous calls: requests are queued in a ring and run by its worker threads, their results are reaped later
+// in order of completion. Any thread may submit and reap. Buffers must stay valid until request is reaped.
+#define CVFS_RING_READ 1  // cvfs_pread() of 'count' bytes at 'offset' into 'buffer'
+#define CVFS_RING_WRITE 2 // cvfs_pwrite() of 'count' bytes at 'offset' from 'buffer'
+#define CVFS_RING_FSYNC 3 // writes image like cvfs_checkpoint() (0 when file system is only in memory), -1: file is not opened
+#define CVFS_RING_STAT 4  // cvfs_fstat() into 'buffer' (a struct cvfs_stat)
+
+struct cvfs_ring_request
+{
+    int op;                  // CVFS_RING_*
+    int fd;
+    long long offset;
+    void *buffer;
+    long long count;
+    unsigned long long user_data; // given back with completion
+};
+
+struct cvfs_ring_completion
+{
+    long long result;        // what the call returned
+    unsigned long long user_data;
+};
+
+struct cvfs_ring;
+
+// ring holding up to 'entries' requests which are not reaped yet (power of 2 up to 65536), run by 'workers' threads
+// (1 to 64), NULL: invalid sizes or memory allocation failed
+struct cvfs_ring *cvfs_ring_create(int entries, int workers);
+
+// queues requests in order, returns how many were queued (fewer than 'count' when ring is full, reap first),
+// -1: invalid ring or request (nothing is queued)
+int cvfs_ring_submit(struct cvfs_ring *ring, const struct cvfs_ring_request *requests, int count);
+
+// copies up to 'count' completions, waiting until at least 'wait_for' arrived or nothing more is in flight,
+// returns number copied, -1: invalid ring
+int cvfs_ring_reap(struct cvfs_ring *ring, struct cvfs_ring_completion *completions, int count, int wait_for);
+
+void cvfs_ring_destroy(struct cvfs_ring *ring); // runs requests still queued, completions not reaped are dropped
+
+#define CVFS_PERF_ERROR_CODES 8 // error codes -1 to -7 are counted separately (-7 includes every lower code)
+
+// counters of one operation since start of program or last cvfs_perf_reset(), latencies are in nanoseconds
+// and exact to about 6% (reads include cvfs_pread() and cvfs_view_open(), writes include cvfs_pwrite(), bytes of backup are bytes written
+// and bytes of restore are bytes restored)
+struct cvfs_perf_op
+{
+    const char *name;
+    long long calls;
+    long long bytes;                         // bytes moved by successful calls
+    long long error_calls;                   // calls which returned a negative value
+    long long errors[CVFS_PERF_ERROR_CODES]; // errors[n] is number of calls which returned -n
+    double mean_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+};
+
+// fills at most 'max_ops' entries of 'ops', returns number of entries filled
+int cvfs_perf_snapshot(struct cvfs_perf_op *ops, int max_ops);
+void cvfs_perf_reset(void);
+void cvfs_perf_enable(int enable); // counting is enabled at start
+
+// serves file system to other processes on a Unix domain socket (protocol and client library are in cvfs_client.h),
+// returns 0 after cvfs_server_stop(), -1: socket can not be created, -2: event loop can not be set up
+int cvfs_serve(const char *socket_path);
+void cvfs_server_stop(void); // may be called from a signal handler
+
+// writes counters as JSON into file on host ('path' NULL writes to standard output), -1: file can not be written
+int cvfs_perf_json(const char *path);
+
+#endif
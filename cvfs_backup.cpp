@@ -0,0 +1,695 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cvfs_internal.h"
+
+#define MAX_BACKUP_WORKERS 16
+
+struct backup_job
+{
+    int full;                  // 1: copy every file, 0: only files changed since last backup
+    int next_inode;            // next inode to be claimed by a worker (atomic)
+    int files_copied;          // atomic counters of summary
+    int files_skipped;
+    int files_failed;
+    long long bytes_written;
+};
+
+double backup_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int host_permission(int permission)
+{
+    if (permission == READ)
+        return S_IRUSR;
+    if (permission == WRITE)
+        return S_IWUSR;
+    return S_IRWXU;
+}
+
+// creates directories of 'path' which do not exist on host yet ("a/b/file" creates "a" and "a/b")
+void make_host_directories(char *path)
+{
+    char *slash;
+
+    for (slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        if (mkdir(path, 0755) == -1 && errno != EEXIST)
+            perror("ERROR");
+        *slash = '/';
+    }
+}
+
+int open_host_file(const char *file_name, int permission)
+{
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, host_permission(permission));
+
+    if (fd == -1 && errno == EACCES && unlink(file_name) == 0)
+        fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, host_permission(permission)); // copy of read only file from earlier backup
+    return fd;
+}
+
+// data of compressed file is decompressed one unit at a time, units holding only zeros stay holes on host
+long long copy_units_to_host(struct inode *inode_ptr, int fd)
+{
+    long long offset;
+    long long length;
+    long long written = 0;
+    char *buffer = (char *)malloc(UNIT_SIZE);
+
+    if (buffer == NULL)
+        return -1;
+
+    // units which are holes are not even decompressed
+    for (offset = seek_extent(inode_ptr, 0, 1); offset < inode_ptr->file_actual_size; offset = seek_extent(inode_ptr, offset + UNIT_SIZE, 1))
+    {
+        length = copy_from_file(inode_ptr, offset, buffer, UNIT_SIZE);
+        if (length <= 0 || block_is_zero(buffer, length))
+            continue;
+        if (pwrite(fd, buffer, length, offset) != length)
+        {
+            free(buffer);
+            return -1;
+        }
+        written += length;
+    }
+    free(buffer);
+
+    if (ftruncate(fd, inode_ptr->file_actual_size) == -1)
+        return -1;
+    return written;
+}
+
+// writes data of file straight from its blocks, runs of consecutive blocks need one pwrite(), holes stay holes on host
+long long copy_to_host(struct inode *inode_ptr, int fd)
+{
+    long long block_index;
+    long long run_start = 0;
+    long long run_length = 0;
+    long long last_block = (inode_ptr->file_actual_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    long long length;
+    long long written = 0;
+    long long next_data;
+    char *run = NULL;
+    char *block;
+
+    if (inode_ptr->compression)
+        return copy_units_to_host(inode_ptr, fd);
+
+    for (block_index = 0; block_index <= last_block; block_index++)
+    {
+        block = (block_index < last_block) ? get_file_block(inode_ptr, block_index, 0) : NULL;
+        if (block != NULL && run != NULL && block == run + run_length)
+        {
+            run_length += BLOCK_SIZE; // next block follows previous one in block pool
+            continue;
+        }
+
+        if (run != NULL)
+        {
+            length = run_length;
+            if (run_start + length > inode_ptr->file_actual_size)
+                length = inode_ptr->file_actual_size - run_start;
+            if (pwrite(fd, run, length, run_start) != length)
+                return -1;
+            written += length;
+        }
+
+        run = block;
+        run_start = block_index * BLOCK_SIZE;
+        run_length = BLOCK_SIZE;
+
+        if (block == NULL && block_index < last_block)
+        {
+            // hole is skipped in one step instead of looking up each of its blocks
+            next_data = seek_extent(inode_ptr, block_index * BLOCK_SIZE, 1);
+            block_index = (next_data < inode_ptr->file_actual_size) ? next_data / BLOCK_SIZE - 1 : last_block - 1;
+        }
+    }
+
+    if (ftruncate(fd, inode_ptr->file_actual_size) == -1) // size of file including trailing hole
+        return -1;
+    return written;
+}
+
+int backup_inode(struct backup_job *job, struct inode *inode_ptr)
+{
+    int fd;
+    long long generation;
+    long long written = 0;
+    char path[MAX_PATH_LENGTH];
+
+    pthread_rwlock_rdlock(&(inode_ptr->lock));
+    if (inode_ptr->file_type == 0 || inode_ptr->link_count == 0)
+    {
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        return 0; // inode is not used by any file
+    }
+
+    if (inode_path(inode_ptr, path, sizeof(path)) == -1)
+    {
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        ATOMIC_ADD(&(job->files_failed), 1);
+        return -1;
+    }
+
+    if (inode_ptr->file_type == DIRECTORY)
+    {
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        make_host_directories(path);
+        if (mkdir(path, 0755) == -1 && errno != EEXIST)
+            perror("ERROR");
+        return 0; // directories are not counted as files
+    }
+
+    generation = inode_ptr->change_generation;
+    if (!job->full && generation == inode_ptr->backup_generation && access(path, F_OK) == 0)
+    {
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        ATOMIC_ADD(&(job->files_skipped), 1);
+        return 0; // not changed since last backup
+    }
+
+    make_host_directories(path); // directory of file may be copied by another worker at same time
+    fd = open_host_file(path, inode_ptr->permission);
+    if (fd != -1)
+    {
+        written = copy_to_host(inode_ptr, fd);
+        close(fd);
+    }
+    if (fd == -1 || written == -1)
+        perror("ERROR");
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    if (fd == -1 || written == -1)
+    {
+        ATOMIC_ADD(&(job->files_failed), 1);
+        return -1;
+    }
+    ATOMIC_ADD(&(job->files_copied), 1);
+    ATOMIC_ADD(&(job->bytes_written), written);
+
+    // copy is only current if file did not change after read lock was released
+    journal_begin();
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+    if (inode_ptr->change_generation == generation && inode_ptr->file_type != 0)
+    {
+        inode_ptr->backup_generation = generation;
+        log_inode(inode_ptr);
+    }
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+    if (journal_end() != 0)
+    {
+        ATOMIC_ADD(&(job->files_copied), -1); // file would be skipped by next backup although its mark was lost
+        ATOMIC_ADD(&(job->files_failed), 1);
+        return -1;
+    }
+    return 0;
+}
+
+void *backup_worker(void *argument)
+{
+    struct backup_job *job = (struct backup_job *)argument;
+    int index;
+
+    // inodes are claimed one at a time, so a few large files do not leave other workers idle
+    while ((index = ATOMIC_ADD(&(job->next_inode), 1) - 1) < ATOMIC_LOAD(&(super_block->initialized_inodes)))
+        backup_inode(job, &inode_table[index]);
+    return NULL;
+}
+
+int cvfs_backup(int full, struct cvfs_backup_summary *summary)
+{
+    int counter;
+    int workers;
+    int started = 0;
+    long long perf_timer = perf_start();
+    double start = backup_clock();
+    struct backup_job job;
+    pthread_t threads[MAX_BACKUP_WORKERS];
+
+    memset(&job, 0, sizeof(job));
+    job.full = full;
+
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > MAX_BACKUP_WORKERS)
+        workers = MAX_BACKUP_WORKERS;
+    if (workers > MAX_INODES - super_block->free_inodes)
+        workers = MAX_INODES - super_block->free_inodes; // no more workers than files
+
+    for (counter = 1; counter < workers; counter++)
+    {
+        if (pthread_create(&threads[started], NULL, backup_worker, &job) == 0)
+            started++;
+    }
+    backup_worker(&job); // calling thread is a worker as well
+
+    for (counter = 0; counter < started; counter++)
+        pthread_join(threads[counter], NULL);
+
+    if (summary != NULL)
+    {
+        summary->files_copied = job.files_copied;
+        summary->files_skipped = job.files_skipped;
+        summary->files_failed = job.files_failed;
+        summary->bytes_written = job.bytes_written;
+        summary->elapsed_seconds = backup_clock() - start;
+    }
+    perf_end(PERF_BACKUP, perf_timer, job.files_failed > 0 ? -1 : job.bytes_written); // -1 in counters: some files failed
+    return job.files_failed;
+}
+
+#define ARCHIVE_MAGIC "CVFSARC"
+#define ARCHIVE_VERSION 2 // 2: entries carry path and type of file, version 1 archives are still restored
+#define ARCHIVE_BUFFER (1024 * 1024) // archive is written and read in pieces of this size
+
+// archive: archive_header | data of every file one after another | archive_entry and path for every file | archive_trailer
+struct archive_header
+{
+    char magic[8]; // ARCHIVE_MAGIC
+    int version;   // ARCHIVE_VERSION
+    int reserved;
+};
+
+struct archive_entry
+{
+    int file_type;     // REGULAR or DIRECTORY
+    int permission;
+    int path_length;   // bytes of path relative to root directory which follow entry, entry and path are padded to 8 bytes
+    int reserved;
+    long long size;    // bytes of data
+    long long offset;  // position of data in archive
+};
+
+// entry of version 1 archive, files were only kept in one directory then
+struct archive_entry_v1
+{
+    char file_name[MAX_FILE_NAME];
+    int permission;
+    long long size;
+    long long offset;
+};
+
+// entry of either version as it is restored
+struct archive_file
+{
+    char path[MAX_PATH_LENGTH]; // absolute path
+    int file_type;
+    int permission;
+    long long size;
+    long long offset;
+};
+
+struct archive_trailer
+{
+    char magic[8];          // ARCHIVE_MAGIC, archive is recognized from its end
+    int version;
+    int entry_count;
+    long long index_offset; // position of first archive_entry
+};
+
+struct archive_writer
+{
+    int fd;
+    char *buffer;     // ARCHIVE_BUFFER bytes
+    long long length; // bytes waiting in buffer
+    long long offset; // bytes of archive so far (including buffer)
+    int failed;
+};
+
+struct archive_index
+{
+    char *data;         // entries and paths, written after data of every file
+    long long length;
+    long long capacity;
+};
+
+void archive_flush(struct archive_writer *writer)
+{
+    if (!writer->failed && writer->length > 0 && write(writer->fd, writer->buffer, writer->length) != writer->length)
+        writer->failed = 1;
+    writer->length = 0;
+}
+
+void archive_append(struct archive_writer *writer, const char *data, long long length)
+{
+    long long chunk;
+
+    writer->offset += length;
+    while (length > 0)
+    {
+        if (writer->length == ARCHIVE_BUFFER)
+            archive_flush(writer);
+
+        chunk = ARCHIVE_BUFFER - writer->length;
+        if (chunk > length)
+            chunk = length;
+
+        if (data != NULL)
+            memcpy(writer->buffer + writer->length, data, chunk);
+        else
+            memset(writer->buffer + writer->length, 0, chunk); // hole of file
+        writer->length += chunk;
+        length -= chunk;
+        if (data != NULL)
+            data += chunk;
+    }
+}
+
+// adds entry of 'inode_ptr' to index, -1 if path is too long or index can not grow
+int index_append(struct archive_index *index, struct inode *inode_ptr, long long offset)
+{
+    int length;
+    char path[MAX_PATH_LENGTH];
+    char *grown;
+    struct archive_entry *entry;
+
+    if (inode_path(inode_ptr, path, sizeof(path)) == -1)
+        return -1;
+    length = strlen(path);
+
+    if (index->length + (long long)sizeof(struct archive_entry) + MAX_PATH_LENGTH > index->capacity)
+    {
+        grown = (char *)realloc(index->data, index->capacity * 2 + sizeof(struct archive_entry) + MAX_PATH_LENGTH);
+        if (grown == NULL)
+            return -1;
+        index->data = grown;
+        index->capacity = index->capacity * 2 + sizeof(struct archive_entry) + MAX_PATH_LENGTH;
+    }
+
+    entry = (struct archive_entry *)(index->data + index->length);
+    memset(entry, 0, sizeof(*entry));
+    entry->file_type = inode_ptr->file_type;
+    entry->permission = inode_ptr->permission;
+    entry->path_length = length;
+    entry->size = (inode_ptr->file_type == DIRECTORY) ? 0 : inode_ptr->file_actual_size;
+    entry->offset = offset;
+    memcpy(entry + 1, path, length);
+    index->length += (sizeof(struct archive_entry) + length + 7) & ~7LL;
+    return 0;
+}
+
+int cvfs_backup_archive(const char *archive_path, struct cvfs_backup_summary *summary)
+{
+    int counter;
+    int entry_count = 0;
+    int file_count = 0;
+    long long block_index;
+    long long chunk;
+    long long perf_timer = perf_start();
+    double start = backup_clock();
+    char *unit = (char *)malloc(UNIT_SIZE); // decompressed data of compressed files
+    struct inode *inode_ptr;
+    struct archive_header header;
+    struct archive_trailer trailer;
+    struct archive_index index;
+    struct archive_writer writer;
+
+    memset(&index, 0, sizeof(index));
+    writer.buffer = (char *)malloc(ARCHIVE_BUFFER);
+    writer.fd = (archive_path == NULL) ? -1 : open(archive_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer.buffer == NULL || unit == NULL || writer.fd == -1)
+    {
+        if (writer.fd != -1)
+            close(writer.fd);
+        free(writer.buffer);
+        free(unit);
+        return perf_end(PERF_BACKUP, perf_timer, -1); // archive can not be created
+    }
+    writer.length = 0;
+    writer.offset = 0;
+    writer.failed = 0;
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, ARCHIVE_MAGIC);
+    header.version = ARCHIVE_VERSION;
+    archive_append(&writer, (char *)&header, sizeof(header));
+
+    for (counter = 0; counter < ATOMIC_LOAD(&(super_block->initialized_inodes)); counter++)
+    {
+        inode_ptr = &inode_table[counter];
+        pthread_rwlock_rdlock(&(inode_ptr->lock));
+        if (inode_ptr->file_type != 0 && inode_ptr->link_count != 0)
+        {
+            if (index_append(&index, inode_ptr, writer.offset) == -1)
+                writer.failed = 1;
+            entry_count++;
+            if (inode_ptr->file_type == DIRECTORY)
+            {
+                pthread_rwlock_unlock(&(inode_ptr->lock));
+                continue;
+            }
+            file_count++;
+
+            for (block_index = 0; inode_ptr->compression && block_index * UNIT_SIZE < inode_ptr->file_actual_size; block_index++)
+            {
+                chunk = copy_from_file(inode_ptr, block_index * UNIT_SIZE, unit, UNIT_SIZE);
+                archive_append(&writer, unit, chunk);
+            }
+            for (block_index = 0; !inode_ptr->compression && block_index * BLOCK_SIZE < inode_ptr->file_actual_size; block_index++)
+            {
+                chunk = inode_ptr->file_actual_size - block_index * BLOCK_SIZE;
+                if (chunk > BLOCK_SIZE)
+                    chunk = BLOCK_SIZE;
+                archive_append(&writer, get_file_block(inode_ptr, block_index, 0), chunk);
+            }
+        }
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+    }
+
+    memset(&trailer, 0, sizeof(trailer));
+    strcpy(trailer.magic, ARCHIVE_MAGIC);
+    trailer.version = ARCHIVE_VERSION;
+    trailer.entry_count = entry_count;
+    trailer.index_offset = writer.offset;
+    archive_append(&writer, index.data, index.length);
+    archive_append(&writer, (char *)&trailer, sizeof(trailer));
+    archive_flush(&writer);
+
+    if (close(writer.fd) == -1)
+        writer.failed = 1;
+
+    if (summary != NULL)
+    {
+        summary->files_copied = writer.failed ? 0 : file_count;
+        summary->files_skipped = 0;
+        summary->files_failed = writer.failed ? file_count : 0;
+        summary->bytes_written = writer.offset;
+        summary->elapsed_seconds = backup_clock() - start;
+    }
+
+    free(index.data);
+    free(writer.buffer);
+    free(unit);
+    perf_end(PERF_BACKUP, perf_timer, writer.failed ? -1 : writer.offset);
+    return writer.failed ? -1 : 0;
+}
+
+// creates directories on 'path' which do not exist yet ("/a/b/file" creates "/a" and "/a/b")
+void make_directories(char *path)
+{
+    char *slash;
+
+    for (slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        cvfs_mkdir(path); // fails harmlessly when directory exists
+        *slash = '/';
+    }
+}
+
+// creates file from archive entry, a file with same path is replaced
+long long restore_file(struct archive_file *entry, const char *data)
+{
+    int fd;
+    int zero;
+    int status;
+    long long offset;
+    long long end;
+    long long chunk;
+    long long written = 0;
+    struct filetable *filetable_ptr;
+
+    struct cvfs_stat stat_buf;
+
+    make_directories(entry->path);
+    if (entry->file_type == DIRECTORY)
+    {
+        if (cvfs_mkdir(entry->path) != 0 && (cvfs_stat(entry->path, &stat_buf) != 0 || stat_buf.file_type != DIRECTORY))
+            return -1;
+        return 0;
+    }
+
+    cvfs_unlink(entry->path);
+    fd = cvfs_create(entry->path, READ + WRITE);
+    if (fd < 0)
+        return -1;
+
+    // blocks of zeros are skipped so that holes stay holes, last block is always written to set size of file
+    for (offset = 0; offset < entry->size; offset = end)
+    {
+        zero = 0;
+        for (end = offset; end < entry->size && end - offset < ARCHIVE_BUFFER; end += chunk)
+        {
+            chunk = (entry->size - end < BLOCK_SIZE) ? entry->size - end : BLOCK_SIZE;
+            if (end + chunk < entry->size && block_is_zero(data + end, chunk))
+            {
+                zero = 1;
+                break;
+            }
+        }
+
+        if (end > offset && cvfs_pwrite(fd, data + offset, end - offset, offset) != end - offset)
+        {
+            cvfs_close(fd);
+            return -1;
+        }
+        written += end - offset;
+        if (zero)
+            end += BLOCK_SIZE;
+    }
+
+    // file was created writable so that data could be written, now it gets permission from archive
+    filetable_ptr = ufdt_array[fd].ptr_filetable;
+    journal_begin();
+    pthread_rwlock_wrlock(&(filetable_ptr->ptr_inode->lock));
+    filetable_ptr->ptr_inode->permission = entry->permission;
+    log_inode(filetable_ptr->ptr_inode);
+    pthread_rwlock_unlock(&(filetable_ptr->ptr_inode->lock));
+    status = journal_end();
+
+    cvfs_close(fd);
+    return (status != 0) ? -1 : written; // permission is not durable
+}
+
+// reads entry at '*position' of index and moves '*position' to next entry, -1 if entry is damaged
+int read_entry(const char *data, struct archive_trailer *trailer, long long index_end, long long *position, struct archive_file *file)
+{
+    struct archive_entry entry;
+    struct archive_entry_v1 entry_v1;
+
+    if (trailer->version == 1)
+    {
+        if (*position + (long long)sizeof(entry_v1) > index_end)
+            return -1;
+        memcpy(&entry_v1, data + *position, sizeof(entry_v1));
+        *position += sizeof(entry_v1);
+        if (memchr(entry_v1.file_name, '\0', MAX_FILE_NAME) == NULL)
+            return -1;
+
+        snprintf(file->path, sizeof(file->path), "/%s", entry_v1.file_name);
+        file->file_type = REGULAR;
+        file->permission = entry_v1.permission;
+        file->size = entry_v1.size;
+        file->offset = entry_v1.offset;
+    }
+    else
+    {
+        if (*position + (long long)sizeof(entry) > index_end)
+            return -1;
+        memcpy(&entry, data + *position, sizeof(entry));
+        if (entry.path_length <= 0 || entry.path_length >= MAX_PATH_LENGTH - 1 ||
+            *position + (long long)sizeof(entry) + entry.path_length > index_end)
+            return -1;
+
+        file->path[0] = '/';
+        memcpy(file->path + 1, data + *position + sizeof(entry), entry.path_length);
+        file->path[entry.path_length + 1] = '\0';
+        *position += (sizeof(entry) + entry.path_length + 7) & ~7LL;
+        if (memchr(file->path, '\0', entry.path_length + 1) != NULL)
+            return -1;
+
+        file->file_type = entry.file_type;
+        file->permission = entry.permission;
+        file->size = entry.size;
+        file->offset = entry.offset;
+    }
+
+    if (file->size < 0 || file->offset < 0 || file->offset + file->size > trailer->index_offset)
+        return -1;
+    return 0;
+}
+
+int cvfs_restore_archive(const char *archive_path, struct cvfs_backup_summary *summary)
+{
+    int fd;
+    int counter;
+    long long written;
+    long long position;
+    long long index_end;
+    long long perf_timer = perf_start();
+    double start = backup_clock();
+    struct stat file_info;
+    struct archive_trailer trailer;
+    struct archive_file file;
+    struct cvfs_backup_summary result;
+    char *data;
+
+    fd = (archive_path == NULL) ? -1 : open(archive_path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &file_info) == -1)
+    {
+        if (fd != -1)
+            close(fd);
+        return perf_end(PERF_RESTORE, perf_timer, -1); // archive can not be opened
+    }
+
+    if (file_info.st_size < (long long)(sizeof(struct archive_header) + sizeof(trailer)) ||
+        (data = (char *)mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return perf_end(PERF_RESTORE, perf_timer, -2);
+    }
+    close(fd);
+    madvise(data, file_info.st_size, MADV_SEQUENTIAL); // archive is read once from start to end
+
+    memcpy(&trailer, data + file_info.st_size - sizeof(trailer), sizeof(trailer));
+    index_end = file_info.st_size - sizeof(trailer);
+    if (strcmp(trailer.magic, ARCHIVE_MAGIC) != 0 || trailer.version < 1 || trailer.version > ARCHIVE_VERSION || trailer.entry_count < 0 ||
+        trailer.index_offset < (long long)sizeof(struct archive_header) || trailer.index_offset > index_end ||
+        (trailer.version == 1 && trailer.index_offset + (long long)trailer.entry_count * (long long)sizeof(struct archive_entry_v1) != index_end))
+    {
+        munmap(data, file_info.st_size);
+        return perf_end(PERF_RESTORE, perf_timer, -2); // not an archive
+    }
+
+    memset(&result, 0, sizeof(result));
+    position = trailer.index_offset;
+    for (counter = 0; counter < trailer.entry_count; counter++)
+    {
+        if (read_entry(data, &trailer, index_end, &position, &file) == -1)
+        {
+            result.files_failed += trailer.entry_count - counter; // rest of index can not be read
+            break;
+        }
+        if ((written = restore_file(&file, data + file.offset)) == -1)
+        {
+            result.files_failed++;
+            continue;
+        }
+        if (file.file_type != DIRECTORY)
+        {
+            result.files_copied++;
+            result.bytes_written += written;
+        }
+    }
+    munmap(data, file_info.st_size);
+
+    result.elapsed_seconds = backup_clock() - start;
+    if (summary != NULL)
+        *summary = result;
+    perf_end(PERF_RESTORE, perf_timer, result.files_failed > 0 ? -1 : result.bytes_written); // -1 in counters: some files failed
+    return result.files_failed;
+}
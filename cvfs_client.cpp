@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cvfs_client.h"
+
+// Calls of a batch are sent in windows: requests are sent until about CLIENT_WINDOW bytes of requests and expected
+// responses are in flight, then their responses are read. Server never holds back more than a window of responses,
+// so neither side waits for the other while both have data to send.
+
+#define CLIENT_WINDOW (4 * 1024 * 1024)
+#define CLIENT_BUFFER (64 * 1024) // requests and small data are gathered in a buffer, larger data is sent from caller
+
+struct cvfs_client
+{
+    int socket;
+    long long buffered;      // bytes in buffer
+    char buffer[CLIENT_BUFFER];
+};
+
+struct cvfs_client *cvfs_connect(const char *socket_path)
+{
+    struct cvfs_client *client;
+    struct sockaddr_un address;
+
+    if (socket_path == NULL || strlen(socket_path) >= sizeof(address.sun_path))
+        return NULL;
+    if ((client = (struct cvfs_client *)malloc(sizeof(struct cvfs_client))) == NULL)
+        return NULL;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+
+    client->buffered = 0;
+    client->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (client->socket == -1 || connect(client->socket, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        if (client->socket != -1)
+            close(client->socket);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+void cvfs_disconnect(struct cvfs_client *client)
+{
+    if (client == NULL)
+        return;
+    close(client->socket);
+    free(client);
+}
+
+int send_all(int socket, const char *data, long long length)
+{
+    long long sent;
+
+    while (length > 0)
+    {
+        sent = send(socket, data, length, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+int receive_all(int socket, char *data, long long length)
+{
+    long long received;
+
+    while (length > 0)
+    {
+        received = recv(socket, data, length, 0);
+        if (received == -1 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return -1;
+        data += received;
+        length -= received;
+    }
+    return 0;
+}
+
+int flush_requests(struct cvfs_client *client)
+{
+    long long length = client->buffered;
+
+    client->buffered = 0;
+    return send_all(client->socket, client->buffer, length);
+}
+
+// small pieces are gathered, a large one is sent on its own after what was gathered before it
+int queue_bytes(struct cvfs_client *client, const void *data, long long length)
+{
+    if (length == 0)
+        return 0;
+    if (client->buffered + length > CLIENT_BUFFER && flush_requests(client) != 0)
+        return -1;
+    if (length > CLIENT_BUFFER)
+        return send_all(client->socket, (const char *)data, length);
+    memcpy(client->buffer + client->buffered, data, length);
+    client->buffered += length;
+    return 0;
+}
+
+int names_file(int op)
+{
+    return op == CVFS_OP_CREATE || op == CVFS_OP_OPEN || op == CVFS_OP_STAT || op == CVFS_OP_UNLINK || op == CVFS_OP_TRUNCATE;
+}
+
+// bytes following request of 'call'
+long long request_data_length(struct cvfs_call *call)
+{
+    if (names_file(call->op))
+        return (call->name != NULL) ? strlen(call->name) : 0;
+    if (call->op != CVFS_OP_WRITE && call->op != CVFS_OP_PWRITE)
+        return 0;
+    if (call->count < 0)
+        return 0;
+    return (call->count > CVFS_WIRE_MAX_DATA) ? CVFS_WIRE_MAX_DATA : call->count; // longer writes are short
+}
+
+// most bytes following response of 'call'
+long long response_data_length(struct cvfs_call *call)
+{
+    if (call->op == CVFS_OP_STAT || call->op == CVFS_OP_FSTAT)
+        return sizeof(struct cvfs_stat);
+    if (call->op != CVFS_OP_READ && call->op != CVFS_OP_PREAD)
+        return 0;
+    if (call->count < 0)
+        return 0;
+    return (call->count > CVFS_WIRE_MAX_DATA) ? CVFS_WIRE_MAX_DATA : call->count;
+}
+
+int send_call(struct cvfs_client *client, struct cvfs_call *call)
+{
+    struct cvfs_request request;
+
+    memset(&request, 0, sizeof(request));
+    request.op = call->op;
+    request.fd = call->fd;
+    request.argument = call->argument;
+    request.length = (int)request_data_length(call);
+    request.offset = (call->op == CVFS_OP_READ) ? call->count : call->offset;
+    request.count = call->count;
+
+    if (queue_bytes(client, &request, sizeof(request)) != 0)
+        return -1;
+    return queue_bytes(client, names_file(call->op) ? (const void *)call->name : call->buffer, request.length);
+}
+
+int receive_response(struct cvfs_client *client, struct cvfs_call *call)
+{
+    struct cvfs_response response;
+
+    if (receive_all(client->socket, (char *)&response, sizeof(response)) != 0 || response.length < 0)
+        return -1;
+    if (response.length > response_data_length(call))
+        return -1; // server sent more than was asked for
+    if (receive_all(client->socket, (char *)call->buffer, response.length) != 0)
+        return -1;
+    call->result = response.result;
+    return 0;
+}
+
+int cvfs_client_batch(struct cvfs_client *client, struct cvfs_call *calls, int count)
+{
+    int sent = 0;
+    int answered = 0;
+    int failed = 0;
+    long long window;
+    long long size;
+
+    while (answered < count)
+    {
+        for (window = 0; sent < count; sent++)
+        {
+            size = sizeof(struct cvfs_request) + request_data_length(&calls[sent]) +
+                   sizeof(struct cvfs_response) + response_data_length(&calls[sent]);
+            if (sent > answered && window + size > CLIENT_WINDOW)
+                break; // window is full, a single call is always sent
+            if ((failed = send_call(client, &calls[sent])) != 0)
+                break;
+            window += size;
+        }
+        if (failed || flush_requests(client) != 0)
+            break;
+
+        while (answered < sent && receive_response(client, &calls[answered]) == 0)
+            answered++;
+        if (answered < sent)
+            break;
+    }
+
+    if (answered == count)
+        return 0;
+    for (; answered < count; answered++)
+        calls[answered].result = CVFS_DISCONNECTED;
+    return -1;
+}
+
+long long single_call(struct cvfs_client *client, int op, int fd, int argument, long long offset, const char *name, void *buffer, long long count)
+{
+    struct cvfs_call call;
+
+    call.op = op;
+    call.fd = fd;
+    call.argument = argument;
+    call.offset = offset;
+    call.name = name;
+    call.buffer = buffer;
+    call.count = count;
+    cvfs_client_batch(client, &call, 1);
+    return call.result;
+}
+
+int cvfs_client_create(struct cvfs_client *client, const char *file_name, int permission)
+{
+    return (int)single_call(client, CVFS_OP_CREATE, -1, permission, 0, file_name, NULL, 0);
+}
+
+int cvfs_client_open(struct cvfs_client *client, const char *file_name, int mode)
+{
+    return (int)single_call(client, CVFS_OP_OPEN, -1, mode, 0, file_name, NULL, 0);
+}
+
+int cvfs_client_close(struct cvfs_client *client, int fd)
+{
+    return (int)single_call(client, CVFS_OP_CLOSE, fd, 0, 0, NULL, NULL, 0);
+}
+
+long long cvfs_client_read(struct cvfs_client *client, int fd, void *buffer, long long count)
+{
+    return single_call(client, CVFS_OP_READ, fd, 0, 0, NULL, buffer, count);
+}
+
+long long cvfs_client_pread(struct cvfs_client *client, int fd, void *buffer, long long count, long long offset)
+{
+    return single_call(client, CVFS_OP_PREAD, fd, 0, offset, NULL, buffer, count);
+}
+
+long long cvfs_client_write(struct cvfs_client *client, int fd, const void *buffer, long long count)
+{
+    return single_call(client, CVFS_OP_WRITE, fd, 0, 0, NULL, (void *)buffer, count);
+}
+
+long long cvfs_client_pwrite(struct cvfs_client *client, int fd, const void *buffer, long long count, long long offset)
+{
+    return single_call(client, CVFS_OP_PWRITE, fd, 0, offset, NULL, (void *)buffer, count);
+}
+
+long long cvfs_client_lseek(struct cvfs_client *client, int fd, long long offset, int whence)
+{
+    return single_call(client, CVFS_OP_LSEEK, fd, whence, offset, NULL, NULL, 0);
+}
+
+int cvfs_client_stat(struct cvfs_client *client, const char *file_name, struct cvfs_stat *stat_buf)
+{
+    return (int)single_call(client, CVFS_OP_STAT, -1, 0, 0, file_name, stat_buf, 0);
+}
+
+int cvfs_client_fstat(struct cvfs_client *client, int fd, struct cvfs_stat *stat_buf)
+{
+    return (int)single_call(client, CVFS_OP_FSTAT, fd, 0, 0, NULL, stat_buf, 0);
+}
+
+int cvfs_client_unlink(struct cvfs_client *client, const char *file_name)
+{
+    return (int)single_call(client, CVFS_OP_UNLINK, -1, 0, 0, file_name, NULL, 0);
+}
+
+int cvfs_client_truncate(struct cvfs_client *client, const char *file_name, long long size)
+{
+    return (int)single_call(client, CVFS_OP_TRUNCATE, -1, 0, size, file_name, NULL, 0);
+}
@@ -0,0 +1,83 @@
+#ifndef CVFS_CLIENT_H
+#define CVFS_CLIENT_H
+
+#include "cvfs.h"
+
+// Protocol of cvfs_serve() on a Unix domain stream socket (byte order of host): a request is a struct cvfs_request
+// followed by 'length' bytes (file name without '\0', or data to be written), a response is a struct cvfs_response
+// followed by 'length' bytes (data read, or a struct cvfs_stat). Requests may be sent without waiting for responses
+// (pipelining), responses come back in order of requests. Descriptors belong to the connection which opened them
+// and are closed when it is closed. A request the server can not parse closes the connection.
+
+#define CVFS_OP_CREATE 1    // name, argument: permission
+#define CVFS_OP_OPEN 2      // name, argument: mode
+#define CVFS_OP_CLOSE 3     // fd
+#define CVFS_OP_READ 4      // fd, offset: count
+#define CVFS_OP_PREAD 5     // fd, offset, count
+#define CVFS_OP_WRITE 6     // fd, data
+#define CVFS_OP_PWRITE 7    // fd, offset, data
+#define CVFS_OP_LSEEK 8     // fd, offset, argument: whence
+#define CVFS_OP_STAT 9      // name, response holds struct cvfs_stat
+#define CVFS_OP_FSTAT 10    // fd, response holds struct cvfs_stat
+#define CVFS_OP_UNLINK 11   // name
+#define CVFS_OP_TRUNCATE 12 // name, offset: size
+
+#define CVFS_WIRE_MAX_DATA (16 * 1024 * 1024) // most bytes after one request or response (longer reads are short)
+
+struct cvfs_request
+{
+    int op;           // CVFS_OP_*
+    int fd;
+    int argument;     // permission, mode or whence
+    int length;       // bytes following request
+    long long offset; // offset, size of truncate or count of read
+    long long count;  // count of pread
+};
+
+struct cvfs_response
+{
+    long long result; // what the call of cvfs.h returned
+    int length;       // bytes following response
+    int padding;
+};
+
+#define CVFS_DISCONNECTED -99 // result of calls when connection to server failed
+
+struct cvfs_client;
+
+// NULL if server can not be reached
+struct cvfs_client *cvfs_connect(const char *socket_path);
+void cvfs_disconnect(struct cvfs_client *client); // server closes descriptors of connection
+
+// one call of a batch, 'result' is filled with what the call of cvfs.h returns (or CVFS_DISCONNECTED)
+struct cvfs_call
+{
+    int op;           // CVFS_OP_*
+    int fd;
+    int argument;
+    long long offset;
+    const char *name;
+    void *buffer;     // data to be written, room for data read or struct cvfs_stat
+    long long count;  // bytes to be written or read
+    long long result;
+};
+
+// sends calls without waiting for each response (a few MB are in flight at a time), returns 0 when every call
+// got its response, -1: connection failed
+int cvfs_client_batch(struct cvfs_client *client, struct cvfs_call *calls, int count);
+
+// same return values as calls of cvfs.h with same names, and CVFS_DISCONNECTED
+int cvfs_client_create(struct cvfs_client *client, const char *file_name, int permission);
+int cvfs_client_open(struct cvfs_client *client, const char *file_name, int mode);
+int cvfs_client_close(struct cvfs_client *client, int fd);
+long long cvfs_client_read(struct cvfs_client *client, int fd, void *buffer, long long count);
+long long cvfs_client_pread(struct cvfs_client *client, int fd, void *buffer, long long count, long long offset);
+long long cvfs_client_write(struct cvfs_client *client, int fd, const void *buffer, long long count);
+long long cvfs_client_pwrite(struct cvfs_client *client, int fd, const void *buffer, long long count, long long offset);
+long long cvfs_client_lseek(struct cvfs_client *client, int fd, long long offset, int whence);
+int cvfs_client_stat(struct cvfs_client *client, const char *file_name, struct cvfs_stat *stat_buf);
+int cvfs_client_fstat(struct cvfs_client *client, int fd, struct cvfs_stat *stat_buf);
+int cvfs_client_unlink(struct cvfs_client *client, const char *file_name);
+int cvfs_client_truncate(struct cvfs_client *client, const char *file_name, long long size);
+
+#endif
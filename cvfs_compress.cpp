@@ -0,0 +1,667 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cvfs_internal.h"
+
+// Compressed files keep their data in units of UNIT_BLOCKS blocks, every unit is compressed on its own:
+//   hole    first and last block of unit are not allocated, unit reads as zeros
+//   packed  unit_header and compressed data in first blocks of unit, last block is never allocated
+//   raw     data did not compress, it is stored as in an uncompressed file and last block is always allocated
+// so the kind of a unit is known from its block table alone.
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5   // stream always ends with literals (format of LZ4 blocks)
+#define LZ_MATCH_LIMIT 12    // no match starts this close to end of input
+#define LZ_MAX_OFFSET 65535
+#define LZ_COPY 16           // short literals and matches are copied as this many bytes when there is room (one vector move)
+
+#define UNIT_HOLE 0
+#define UNIT_PACKED 1
+#define UNIT_RAW 2
+
+struct unit_header
+{
+    long long sequence; // number of this version of unit, decompressed units are cached by it
+    int length;         // bytes of data in unit, rest of unit reads as zeros
+    int packed_length;  // bytes of compressed data following header
+};
+
+struct unit_cache_slot
+{
+    pthread_rwlock_t lock;
+    int block;          // first block of cached unit (0 if slot is empty)
+    long long sequence;
+    char *data;         // UNIT_SIZE bytes of decompressed unit (allocated on first use)
+};
+
+struct unit_buffers
+{
+    char *plain;        // one decompressed unit
+    char *packed;       // one compressed unit with its header
+    long long capacity; // bytes of each buffer
+};
+
+struct unit_cache_slot unit_cache[UNIT_CACHE_SLOTS];
+pthread_once_t unit_cache_once = PTHREAD_ONCE_INIT;
+long long local_unit_sequence = 0;
+long long *unit_sequence = &local_unit_sequence; // next sequence number (atomic), at least wall clock time of last mount so numbers
+                                                 // are not reused after a remount (in shared segment when it is mounted)
+int compress_new_files = 0;      // files created from now on are compressed
+pthread_key_t unit_buffers_key;  // frees buffers of a thread when it exits
+__thread struct unit_buffers *thread_buffers = NULL;
+
+unsigned int read32(const char *data)
+{
+    unsigned int value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+unsigned long long read64(const char *data)
+{
+    unsigned long long value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+unsigned int lz_hash(unsigned int sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// writes length which did not fit into 4 bits of token as bytes of 255 and a remainder
+char *lz_put_length(char *out, int length)
+{
+    while (length >= 255)
+    {
+        *out++ = (char)255;
+        length -= 255;
+    }
+    *out++ = (char)length;
+    return out;
+}
+
+// compresses 'length' bytes of 'source' in format of LZ4 blocks, returns compressed length, 0 if it does not fit into 'capacity'
+int lz_compress(const char *source, int length, char *dest, int capacity)
+{
+    int table[1 << LZ_HASH_BITS];
+    int position = 0;
+    int anchor = 0;
+    int reference;
+    int match_length;
+    int literals;
+    unsigned int hash;
+    char *out = dest;
+    char *out_end = dest + capacity;
+    char *token;
+
+    memset(table, -1, sizeof(table));
+    while (position < length - LZ_MATCH_LIMIT)
+    {
+        hash = lz_hash(read32(source + position));
+        reference = table[hash];
+        table[hash] = position;
+
+        if (reference < 0 || position - reference > LZ_MAX_OFFSET || read32(source + reference) != read32(source + position))
+        {
+            position += 1 + ((position - anchor) >> 6); // steps grow on data which does not compress
+            continue;
+        }
+
+        match_length = LZ_MIN_MATCH;
+        while (position + match_length + 8 <= length - LZ_LAST_LITERALS && read64(source + reference + match_length) == read64(source + position + match_length))
+            match_length += 8; // 8 bytes at a time, the byte which differs is found below
+        while (position + match_length < length - LZ_LAST_LITERALS && source[reference + match_length] == source[position + match_length])
+            match_length++;
+
+        literals = position - anchor;
+        if (out + 1 + literals + literals / 255 + 2 + (match_length - LZ_MIN_MATCH) / 255 + 1 > out_end)
+            return 0;
+
+        token = out++;
+        *token = (char)(((literals < 15 ? literals : 15) << 4) | (match_length - LZ_MIN_MATCH < 15 ? match_length - LZ_MIN_MATCH : 15));
+        if (literals >= 15)
+            out = lz_put_length(out, literals - 15);
+        memcpy(out, source + anchor, literals);
+        out += literals;
+
+        *out++ = (char)((position - reference) & 0xff);
+        *out++ = (char)((position - reference) >> 8);
+        if (match_length - LZ_MIN_MATCH >= 15)
+            out = lz_put_length(out, match_length - LZ_MIN_MATCH - 15);
+
+        position += match_length;
+        anchor = position;
+    }
+
+    literals = length - anchor;
+    if (out + 1 + literals + literals / 255 + 1 > out_end)
+        return 0;
+    token = out++;
+    *token = (char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15)
+        out = lz_put_length(out, literals - 15);
+    memcpy(out, source + anchor, literals);
+    out += literals;
+
+    return out - dest;
+}
+
+// returns number of bytes written into 'dest', -1 if compressed data is damaged
+int lz_decompress(const char *source, int length, char *dest, int capacity)
+{
+    const unsigned char *in = (const unsigned char *)source;
+    const unsigned char *in_end = in + length;
+    char *out = dest;
+    char *out_end = dest + capacity;
+    char *match;
+    int token;
+    int literals;
+    int match_length;
+    int offset;
+    int counter;
+
+    while (in < in_end)
+    {
+        token = *in++;
+        literals = token >> 4;
+        if (literals == 15)
+        {
+            do
+            {
+                if (in == in_end)
+                    return -1;
+                literals += *in;
+            } while (*in++ == 255);
+        }
+        if (literals > in_end - in || literals > out_end - out)
+            return -1;
+        if (literals <= LZ_COPY && in_end - in >= LZ_COPY && out_end - out >= LZ_COPY)
+            memcpy(out, in, LZ_COPY); // bytes beyond literals are overwritten by what follows
+        else
+            memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        if (in == in_end)
+            break; // last literals
+
+        if (in_end - in < 2)
+            return -1;
+        offset = in[0] | (in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out - dest)
+            return -1;
+
+        match_length = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15)
+        {
+            do
+            {
+                if (in == in_end)
+                    return -1;
+                match_length += *in;
+            } while (*in++ == 255);
+        }
+        if (match_length > out_end - out)
+            return -1;
+
+        match = out - offset;
+        if (match_length <= LZ_COPY && offset >= LZ_COPY && out_end - out >= LZ_COPY)
+            memcpy(out, match, LZ_COPY);
+        else if (offset >= match_length)
+            memcpy(out, match, match_length);
+        else
+        {
+            for (counter = 0; counter < match_length; counter++)
+                out[counter] = match[counter]; // match overlaps bytes it produces (repeated pattern)
+        }
+        out += match_length;
+    }
+    return out - dest;
+}
+
+void free_unit_buffers(void *buffers)
+{
+    free(((struct unit_buffers *)buffers)->plain);
+    free(((struct unit_buffers *)buffers)->packed);
+    free(buffers);
+}
+
+void create_unit_buffers_key()
+{
+    pthread_key_create(&unit_buffers_key, free_unit_buffers);
+}
+
+// buffers of calling thread, NULL if memory allocation failed
+struct unit_buffers *get_unit_buffers()
+{
+    struct unit_buffers *buffers = thread_buffers;
+
+    pthread_once(&unit_cache_once, create_unit_buffers_key);
+    if (buffers == NULL)
+    {
+        if ((buffers = (struct unit_buffers *)calloc(1, sizeof(struct unit_buffers))) == NULL)
+            return NULL;
+        pthread_setspecific(unit_buffers_key, buffers);
+        thread_buffers = buffers;
+    }
+
+    if (buffers->capacity < UNIT_SIZE) // geometry of a new mount may have bigger units
+    {
+        free(buffers->plain);
+        free(buffers->packed);
+        buffers->plain = (char *)malloc(UNIT_SIZE);
+        buffers->packed = (char *)malloc(UNIT_SIZE);
+        buffers->capacity = (buffers->plain != NULL && buffers->packed != NULL) ? UNIT_SIZE : 0;
+        if (buffers->capacity == 0)
+            return NULL;
+    }
+    return buffers;
+}
+
+void unit_cache_reset()
+{
+    int counter;
+    long long sequence;
+    struct timespec ts;
+
+    for (counter = 0; counter < UNIT_CACHE_SLOTS; counter++)
+    {
+        pthread_rwlock_init(&(unit_cache[counter].lock), NULL);
+        unit_cache[counter].block = 0;
+        unit_cache[counter].sequence = 0;
+        free(unit_cache[counter].data); // size of units may differ from previous mount
+        unit_cache[counter].data = NULL;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    sequence = ATOMIC_LOAD(unit_sequence);
+    while (sequence < ts.tv_sec * 1000000000LL + ts.tv_nsec && !ATOMIC_CAS(unit_sequence, &sequence, ts.tv_sec * 1000000000LL + ts.tv_nsec))
+        ; // other processes of a shared segment may already be past it
+}
+
+// units of every process mounting a shared segment are numbered from one counter in segment ('sequence'),
+// NULL numbers them from a counter of this process again
+void share_unit_sequence(long long *sequence)
+{
+    unit_sequence = (sequence == NULL) ? &local_unit_sequence : sequence;
+}
+
+int unit_slot_block(struct inode *inode_ptr, long long block_index)
+{
+    int *slot = get_block_slot(inode_ptr, block_index, 0);
+
+    return (slot == NULL) ? 0 : *slot;
+}
+
+int unit_state(struct inode *inode_ptr, long long unit)
+{
+    if (unit_slot_block(inode_ptr, unit * UNIT_BLOCKS + UNIT_BLOCKS - 1) != 0)
+        return UNIT_RAW;
+    if (unit_slot_block(inode_ptr, unit * UNIT_BLOCKS) != 0)
+        return UNIT_PACKED;
+    return UNIT_HOLE;
+}
+
+int unit_is_hole(struct inode *inode_ptr, long long unit)
+{
+    return unit_state(inode_ptr, unit) == UNIT_HOLE;
+}
+
+// decompresses packed unit into 'plain' (UNIT_SIZE bytes), -1 if unit is damaged
+int unpack_unit(struct inode *inode_ptr, long long unit, char *plain, char *scratch)
+{
+    int counter;
+    int count;
+    int blocks[UNIT_BLOCKS];
+    int contiguous = 1;
+    long long stored;
+    const char *packed;
+    struct unit_header header;
+
+    blocks[0] = unit_slot_block(inode_ptr, unit * UNIT_BLOCKS);
+    memcpy(&header, block_address(blocks[0]), sizeof(header));
+    stored = sizeof(header) + (long long)header.packed_length;
+    if (header.length < 0 || header.length > UNIT_SIZE || header.packed_length < 0 || stored > (long long)(UNIT_BLOCKS - 1) * BLOCK_SIZE)
+        return -1;
+
+    count = (stored + BLOCK_SIZE - 1) >> BLOCK_SHIFT;
+    for (counter = 1; counter < count; counter++)
+    {
+        if ((blocks[counter] = unit_slot_block(inode_ptr, unit * UNIT_BLOCKS + counter)) == 0)
+            return -1;
+        if (blocks[counter] != blocks[0] + counter)
+            contiguous = 0;
+    }
+
+    // compressed data is read in place when its blocks follow each other in block pool, otherwise it is gathered first
+    packed = block_address(blocks[0]);
+    if (!contiguous)
+    {
+        for (counter = 0; counter < count; counter++)
+            memcpy(scratch + ((long long)counter << BLOCK_SHIFT), block_address(blocks[counter]), BLOCK_SIZE);
+        packed = scratch;
+    }
+
+    if (lz_decompress(packed + sizeof(header), header.packed_length, plain, header.length) != header.length)
+        return -1;
+    memset(plain + header.length, 0, UNIT_SIZE - header.length);
+    return 0;
+}
+
+// copies 'count' bytes at 'offset' of a packed unit into 'buffer' through cache of decompressed units
+void read_packed(struct inode *inode_ptr, long long unit, long long offset, char *buffer, long long count)
+{
+    int first = unit_slot_block(inode_ptr, unit * UNIT_BLOCKS);
+    long long sequence;
+    struct unit_cache_slot *slot;
+    struct unit_buffers *buffers;
+
+    memcpy(&sequence, block_address(first), sizeof(sequence));
+    slot = &unit_cache[(((unsigned long long)sequence * 0x9e3779b97f4a7c15ULL) >> 32) & (UNIT_CACHE_SLOTS - 1)];
+
+    pthread_rwlock_rdlock(&(slot->lock));
+    if (slot->block == first && slot->sequence == sequence)
+    {
+        memcpy(buffer, slot->data + offset, count);
+        pthread_rwlock_unlock(&(slot->lock));
+        return;
+    }
+    pthread_rwlock_unlock(&(slot->lock));
+
+    pthread_rwlock_wrlock(&(slot->lock));
+    if (slot->block != first || slot->sequence != sequence)
+    {
+        slot->block = 0;
+        if (slot->data == NULL)
+            slot->data = (char *)malloc(UNIT_SIZE);
+        buffers = get_unit_buffers();
+        if (slot->data != NULL && buffers != NULL && unpack_unit(inode_ptr, unit, slot->data, buffers->packed) == 0)
+        {
+            slot->block = first;
+            slot->sequence = sequence;
+        }
+    }
+
+    if (slot->block == first)
+        memcpy(buffer, slot->data + offset, count);
+    else
+        memset(buffer, 0, count); // unit is damaged or there is no memory
+    pthread_rwlock_unlock(&(slot->lock));
+}
+
+// reads whole unit into 'plain' (UNIT_SIZE bytes), returns bytes of data in unit
+long long load_unit(struct inode *inode_ptr, long long unit, char *plain)
+{
+    int state = unit_state(inode_ptr, unit);
+    struct unit_header header;
+
+    if (state == UNIT_HOLE)
+    {
+        memset(plain, 0, UNIT_SIZE);
+        return 0;
+    }
+    if (state == UNIT_RAW)
+    {
+        copy_from_blocks(inode_ptr, unit << UNIT_SHIFT, plain, UNIT_SIZE);
+        return UNIT_SIZE;
+    }
+
+    memcpy(&header, block_address(unit_slot_block(inode_ptr, unit * UNIT_BLOCKS)), sizeof(header));
+    read_packed(inode_ptr, unit, 0, plain, UNIT_SIZE);
+    return header.length;
+}
+
+// replaces unit with 'length' bytes of 'plain' (rest of 'plain' up to UNIT_SIZE must be zero), -1: no free block
+int store_unit(struct inode *inode_ptr, long long unit, const char *plain, long long length, char *packed)
+{
+    int counter;
+    int old_block;
+    int blocks[UNIT_BLOCKS];
+    int *slots[UNIT_BLOCKS];
+    long long piece;
+    long long stored = 0;
+    struct unit_header header;
+
+    memset(blocks, 0, sizeof(blocks));
+    while (length > 0 && plain[length - 1] == 0)
+        length--; // trailing zeros read back as zeros anyway
+
+    if (length > 0)
+    {
+        stored = lz_compress(plain, length, packed + sizeof(header), (UNIT_BLOCKS - 1) * BLOCK_SIZE - sizeof(header));
+        if (stored > 0)
+        {
+            header.sequence = ATOMIC_ADD(unit_sequence, 1);
+            header.length = length;
+            header.packed_length = stored;
+            memcpy(packed, &header, sizeof(header));
+            stored += sizeof(header);
+        }
+    }
+
+    // slots (and indirect blocks holding them) are made ready first, so that running out of blocks leaves unit as it was
+    for (counter = 0; counter < UNIT_BLOCKS; counter++)
+    {
+        slots[counter] = get_block_slot(inode_ptr, unit * UNIT_BLOCKS + counter, length > 0);
+        if (length > 0 && slots[counter] == NULL)
+            return -1;
+    }
+
+    for (counter = 0; counter < UNIT_BLOCKS && length > 0; counter++)
+    {
+        if (stored > 0 ? (long long)counter * BLOCK_SIZE >= stored
+                       : (counter != UNIT_BLOCKS - 1 && block_is_zero(plain + ((long long)counter << BLOCK_SHIFT), BLOCK_SIZE)))
+            continue; // packed unit ends here or raw block holds only zeros (last block of raw unit always exists)
+
+        if ((blocks[counter] = alloc_block()) == 0)
+        {
+            while (counter-- > 0)
+            {
+                if (blocks[counter] != 0)
+                    release_block(blocks[counter]);
+            }
+            return -1;
+        }
+
+        piece = BLOCK_SIZE;
+        if (stored > 0 && stored - (long long)counter * BLOCK_SIZE < piece)
+            piece = stored - (long long)counter * BLOCK_SIZE;
+        memcpy(block_address(blocks[counter]), ((stored > 0) ? packed : plain) + ((long long)counter << BLOCK_SHIFT), piece);
+        journal_log(block_address(blocks[counter]), piece);
+    }
+
+    for (counter = 0; counter < UNIT_BLOCKS; counter++)
+    {
+        if (slots[counter] == NULL)
+            continue; // no indirect block, so there is no old block either
+        old_block = *slots[counter];
+        if (old_block == blocks[counter])
+            continue;
+
+        *slots[counter] = blocks[counter];
+        journal_log(slots[counter], sizeof(int));
+        if (old_block != 0)
+        {
+            put_block(old_block);
+            inode_ptr->file_size -= BLOCK_SIZE;
+        }
+        if (blocks[counter] != 0)
+            inode_ptr->file_size += BLOCK_SIZE;
+    }
+    return 0;
+}
+
+long long copy_to_units(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill)
+{
+    long long copied = 0;
+    long long chunk;
+    long long unit;
+    long long unit_offset;
+    long long length;
+    struct unit_buffers *buffers = get_unit_buffers();
+
+    if (buffers == NULL)
+        return 0;
+
+    while (copied < no_of_bytes)
+    {
+        unit = offset >> UNIT_SHIFT;
+        if ((unit + 1) * UNIT_BLOCKS > MAX_FILE_BLOCKS)
+            break; // maximum file size reached
+
+        unit_offset = offset & (UNIT_SIZE - 1);
+        chunk = UNIT_SIZE - unit_offset;
+        if (chunk > no_of_bytes - copied)
+            chunk = no_of_bytes - copied;
+
+        if (unit_state(inode_ptr, unit) == UNIT_RAW)
+        {
+            // data which did not compress is written in place, like in an uncompressed file
+            if (copy_to_blocks(inode_ptr, offset, (data != NULL) ? data + copied : NULL, chunk, fill) != chunk)
+                break;
+        }
+        else
+        {
+            length = load_unit(inode_ptr, unit, buffers->plain);
+            if (data != NULL)
+                memcpy(buffers->plain + unit_offset, data + copied, chunk);
+            else
+                memset(buffers->plain + unit_offset, fill, chunk);
+            if (unit_offset + chunk > length)
+                length = unit_offset + chunk;
+
+            if (store_unit(inode_ptr, unit, buffers->plain, length, buffers->packed) != 0)
+                break; // there is no free block
+        }
+
+        copied += chunk;
+        offset += chunk;
+    }
+    return copied;
+}
+
+long long copy_from_units(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes)
+{
+    long long copied = 0;
+    long long chunk;
+    long long unit;
+    long long unit_offset;
+    int state;
+
+    while (copied < no_of_bytes)
+    {
+        unit = offset >> UNIT_SHIFT;
+        unit_offset = offset & (UNIT_SIZE - 1);
+        chunk = UNIT_SIZE - unit_offset;
+        if (chunk > no_of_bytes - copied)
+            chunk = no_of_bytes - copied;
+
+        state = unit_state(inode_ptr, unit);
+        if (state == UNIT_PACKED)
+            read_packed(inode_ptr, unit, unit_offset, buffer + copied, chunk);
+        else if (state == UNIT_RAW)
+            copy_from_blocks(inode_ptr, offset, buffer + copied, chunk);
+        else
+            memset(buffer + copied, 0, chunk);
+
+        copied += chunk;
+        offset += chunk;
+    }
+    return copied;
+}
+
+// cuts compressed file to 'size' bytes (called before file_actual_size is changed), -1: no free block for last unit
+int truncate_units(struct inode *inode_ptr, long long size)
+{
+    long long unit = size >> UNIT_SHIFT;
+    long long length;
+    struct unit_buffers *buffers;
+
+    if ((size & (UNIT_SIZE - 1)) != 0 && unit_state(inode_ptr, unit) != UNIT_HOLE)
+    {
+        if ((buffers = get_unit_buffers()) == NULL)
+            return -1;
+        length = load_unit(inode_ptr, unit, buffers->plain);
+        memset(buffers->plain + (size & (UNIT_SIZE - 1)), 0, UNIT_SIZE - (size & (UNIT_SIZE - 1)));
+        if (length > (size & (UNIT_SIZE - 1)))
+            length = size & (UNIT_SIZE - 1);
+        if (store_unit(inode_ptr, unit, buffers->plain, length, buffers->packed) != 0)
+            return -1;
+    }
+    release_file_blocks(inode_ptr, (unit + ((size & (UNIT_SIZE - 1)) != 0)) * UNIT_BLOCKS);
+    return 0;
+}
+
+void cvfs_set_compression(int enable)
+{
+    ATOMIC_STORE(&compress_new_files, enable ? 1 : 0);
+}
+
+int cvfs_compress(const char *file_name, int enable)
+{
+    int status = 0;
+    long long offset;
+    long long chunk;
+    char *buffer = NULL;
+    struct inode copy;
+    struct inode *inode_ptr = path_lookup(file_name);
+
+    if (inode_ptr == NULL)
+        return -1; // there is no such file
+    if (inode_ptr->file_type == DIRECTORY)
+    {
+        inode_put(inode_ptr);
+        return -2;
+    }
+
+    enable = enable ? 1 : 0;
+    journal_begin();
+    pthread_rwlock_wrlock(&(inode_ptr->lock));
+    if (inode_ptr->compression != enable && (buffer = (char *)malloc(UNIT_SIZE)) == NULL)
+        status = -3;
+    else if (inode_ptr->compression != enable)
+    {
+        // data is written again into a scratch inode in new form, then its block tables replace those of the file
+        memset(&copy, 0, sizeof(copy));
+        copy.file_actual_size = inode_ptr->file_actual_size;
+        copy.compression = enable;
+
+        for (offset = 0; offset < inode_ptr->file_actual_size && status == 0; offset += chunk)
+        {
+            chunk = inode_ptr->file_actual_size - offset;
+            if (chunk > UNIT_SIZE)
+                chunk = UNIT_SIZE;
+            copy_from_file(inode_ptr, offset, buffer, chunk);
+            if (!block_is_zero(buffer, chunk) && copy_to_file(&copy, offset, buffer, chunk, 0) != chunk)
+                status = -3; // there is no free block
+        }
+
+        if (status != 0)
+            release_file_blocks(&copy, 0);
+        else
+        {
+            release_file_blocks(inode_ptr, 0);
+            memcpy(inode_ptr->direct_blocks, copy.direct_blocks, sizeof(copy.direct_blocks));
+            inode_ptr->indirect_block = copy.indirect_block;
+            inode_ptr->double_indirect_block = copy.double_indirect_block;
+            inode_ptr->file_size = copy.file_size;
+            inode_ptr->compression = enable;
+            inode_changed(inode_ptr);
+        }
+    }
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+    if (journal_end() != 0 && status == 0)
+        status = CVFS_JOURNAL_FAILED; // new form of data is not durable
+
+    free(buffer);
+    inode_put(inode_ptr);
+    return status;
+}
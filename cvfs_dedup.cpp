@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cvfs_internal.h"
+
+// Blocks with equal content are stored once: when a write fills a block, its digest is looked up in an index of
+// blocks written before, and if one of them holds the same bytes the file shares it instead (like a clone does,
+// see block_shares). Index and digests are kept only in memory, blocks written before a remount are not found.
+//
+// A block can only be found while its digest is set. Digest is cleared before a block is written in place or
+// released, always under lock of its bucket, so nobody starts sharing a block which is about to change.
+
+#define DEDUP_WAYS 4        // blocks per bucket, a full bucket forgets one of them
+#define DEDUP_LOCKS 256     // buckets are locked in stripes (power of 2)
+
+struct alignas(CACHE_LINE) dedup_lock
+{
+    pthread_mutex_t lock;
+};
+
+unsigned long long *block_digests = NULL; // block_digests[n]: digest block 'n' is indexed by (0 if it is not indexed)
+int *dedup_table = NULL;                  // DEDUP_WAYS block numbers per bucket (0 for an empty way)
+long long dedup_buckets = 0;              // number of buckets (power of 2)
+int dedup_enabled = 0;                    // full blocks are looked up in index when they are written
+long long dedup_merged = 0;               // blocks found in index since file system was mounted (atomic)
+struct dedup_lock dedup_locks[DEDUP_LOCKS];
+pthread_mutex_t dedup_setup_lock = PTHREAD_MUTEX_INITIALIZER; // protects allocation of index
+
+unsigned long long read_word(const char *data)
+{
+    unsigned long long value;
+
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+// 4 independent lanes of multiply and shift, equal digests are confirmed with memcmp() anyway
+unsigned long long block_digest(const char *data)
+{
+    unsigned long long lanes[4] = {1, 2, 3, 4};
+    unsigned long long digest;
+    long long position;
+    int lane;
+
+    for (position = 0; position < BLOCK_SIZE; position += 4 * sizeof(long long))
+    {
+        for (lane = 0; lane < 4; lane++)
+        {
+            lanes[lane] = (lanes[lane] ^ read_word(data + position + lane * sizeof(long long))) * 0x9e3779b97f4a7c15ULL;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    digest = lanes[0] ^ (lanes[1] * 0xff51afd7ed558ccdULL) ^ (lanes[2] * 0xc4ceb9fe1a85ec53ULL) ^ (lanes[3] * 0x94d049bb133111ebULL);
+    digest ^= digest >> 32;
+    return digest | 1; // 0 means not indexed
+}
+
+pthread_mutex_t *bucket_lock(unsigned long long digest)
+{
+    return &(dedup_locks[digest & (dedup_buckets - 1) & (DEDUP_LOCKS - 1)].lock);
+}
+
+int *bucket_ways(unsigned long long digest)
+{
+    return &dedup_table[(digest & (dedup_buckets - 1)) * DEDUP_WAYS];
+}
+
+// way holds no block or a block which was forgotten (and maybe indexed again in another bucket)
+int way_is_free(int candidate, unsigned long long stored, unsigned long long digest)
+{
+    return candidate == 0 || stored == 0 || ((stored ^ digest) & (dedup_buckets - 1)) != 0;
+}
+
+// caller holds dedup_setup_lock, -1 if memory allocation failed
+int dedup_allocate()
+{
+    long long buckets;
+    unsigned long long *digests = (unsigned long long *)calloc(MAX_BLOCKS, sizeof(unsigned long long));
+
+    for (buckets = 64; buckets * DEDUP_WAYS < 2LL * MAX_BLOCKS; buckets *= 2)
+        ;
+    dedup_table = (int *)calloc(buckets * DEDUP_WAYS, sizeof(int));
+    if (digests == NULL || dedup_table == NULL)
+    {
+        free(digests);
+        free(dedup_table);
+        dedup_table = NULL;
+        return -1;
+    }
+    dedup_buckets = buckets;
+    ATOMIC_STORE(&block_digests, digests); // writers may already run when dedup is enabled, table is ready before they see it
+    return 0;
+}
+
+// blocks of previous mount are forgotten, index is allocated again for current geometry if dedup is enabled
+int dedup_reset()
+{
+    int counter;
+    int status = 0;
+
+    pthread_mutex_lock(&dedup_setup_lock);
+    for (counter = 0; counter < DEDUP_LOCKS; counter++)
+        pthread_mutex_init(&(dedup_locks[counter].lock), NULL);
+    free(block_digests);
+    free(dedup_table);
+    block_digests = NULL;
+    dedup_table = NULL;
+    ATOMIC_STORE(&dedup_merged, 0);
+    if (ATOMIC_LOAD(&dedup_enabled))
+        status = dedup_allocate();
+    pthread_mutex_unlock(&dedup_setup_lock);
+    return status;
+}
+
+int cvfs_set_dedup(int enable)
+{
+    int status = 0;
+
+    if (enable && process_shared)
+        return -2; // index is in memory of one process, other processes would write indexed blocks without removing them
+
+    pthread_mutex_lock(&dedup_setup_lock);
+    if (enable && block_digests == NULL)
+        status = dedup_allocate();
+    if (status == 0)
+        ATOMIC_STORE(&dedup_enabled, enable ? 1 : 0);
+    pthread_mutex_unlock(&dedup_setup_lock);
+    return status;
+}
+
+// removes block from index before it is written in place or released, returns 1 if it was indexed
+int dedup_forget(int block)
+{
+    unsigned long long digest;
+    unsigned long long *digests = ATOMIC_LOAD(&block_digests);
+    pthread_mutex_t *lock;
+
+    if (digests == NULL || (digest = ATOMIC_LOAD(&digests[block])) == 0)
+        return 0; // only owner of block sets its digest, so it can not become indexed meanwhile
+
+    lock = bucket_lock(digest);
+    pthread_mutex_lock(lock);
+    ATOMIC_STORE(&digests[block], 0); // entry in bucket is stale from now and is reused
+    pthread_mutex_unlock(lock);
+    return 1;
+}
+
+// called when a write filled block 'block_index' of file, the file then shares an equal block if one is indexed
+void dedup_block(struct inode *inode_ptr, long long block_index)
+{
+    int counter;
+    int candidate;
+    int found = 0;
+    int victim = -1;
+    int block;
+    int *ways;
+    int *slot = get_block_slot(inode_ptr, block_index, 0);
+    unsigned long long digest;
+    unsigned long long stored;
+    pthread_mutex_t *lock;
+
+    if (slot == NULL || (block = *slot) == 0)
+        return;
+
+    digest = block_digest(block_address(block));
+    lock = bucket_lock(digest);
+    ways = bucket_ways(digest);
+
+    pthread_mutex_lock(lock);
+    for (counter = 0; counter < DEDUP_WAYS && found == 0; counter++)
+    {
+        candidate = ways[counter];
+        stored = (candidate == 0) ? 0 : ATOMIC_LOAD(&block_digests[candidate]);
+        if (way_is_free(candidate, stored, digest) || candidate == block)
+        {
+            if (victim == -1)
+                victim = counter;
+            continue;
+        }
+        if (stored == digest && memcmp(block_address(candidate), block_address(block), BLOCK_SIZE) == 0)
+        {
+            ATOMIC_ADD(&block_shares[candidate], 1); // candidate can not be released while its bucket is locked
+            ATOMIC_ADD(shared_block_count, 1);
+            found = candidate;
+        }
+    }
+
+    if (found == 0)
+    {
+        if (victim == -1)
+        {
+            victim = (digest >> 32) % DEDUP_WAYS; // bucket is full, one of its blocks is forgotten
+            ATOMIC_STORE(&block_digests[ways[victim]], 0);
+        }
+        ways[victim] = block;
+        ATOMIC_STORE(&block_digests[block], digest);
+    }
+    pthread_mutex_unlock(lock);
+
+    if (found != 0)
+    {
+        *slot = found;
+        journal_log(slot, sizeof(int));
+        put_block(block); // block was written only by this file, so it is released
+        ATOMIC_ADD(&dedup_merged, 1);
+    }
+}
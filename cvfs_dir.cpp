@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cvfs_internal.h"
+
+struct dcache_entry
+{
+    unsigned int hash;          // hash of path (0 if slot is empty)
+    struct inode *ptr_inode;    // directory the path leads to
+    char path[DCACHE_PATH];     // absolute path without trailing '/'
+};
+
+struct alignas(CACHE_LINE) dcache_shard
+{
+    pthread_rwlock_t lock;
+    struct dcache_entry slots[DCACHE_SLOTS];
+};
+
+struct dcache_shard dcache[DCACHE_SHARDS];
+int dcache_epoch = 0;   // incremented whenever a directory is removed, paths resolved before are not cached then
+
+char cwd_path[MAX_PATH_LENGTH] = "";  // absolute path of current directory ("" for root directory)
+int cwd_is_root = 1;                  // plain names are looked up in root directory without reading cwd_path (atomic)
+pthread_rwlock_t cwd_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void initialize_directories()
+{
+    int counter;
+
+    for (counter = 0; counter < DCACHE_SHARDS; counter++)
+    {
+        pthread_rwlock_init(&(dcache[counter].lock), NULL);
+        memset(dcache[counter].slots, 0, sizeof(dcache[counter].slots));
+    }
+
+    pthread_rwlock_wrlock(&cwd_lock);
+    cwd_path[0] = '\0';
+    ATOMIC_STORE(&cwd_is_root, 1);
+    pthread_rwlock_unlock(&cwd_lock);
+}
+
+unsigned int path_hash(const char *path)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+
+    while (*path != '\0')
+    {
+        hash ^= (unsigned char)*path++;
+        hash *= 16777619u;
+    }
+    return (hash == 0) ? 1 : hash; // 0 marks an empty slot
+}
+
+struct dcache_entry *dcache_slot(unsigned int hash)
+{
+    return &(dcache[(hash >> 24) & (DCACHE_SHARDS - 1)].slots[hash & (DCACHE_SLOTS - 1)]);
+}
+
+// returns directory with an extra reference, NULL if path is not cached
+struct inode *dcache_lookup(const char *path)
+{
+    unsigned int hash = path_hash(path);
+    struct dcache_shard *shard = &dcache[(hash >> 24) & (DCACHE_SHARDS - 1)];
+    struct dcache_entry *entry = dcache_slot(hash);
+    struct inode *inode_ptr = NULL;
+
+    if (process_shared)
+        return NULL; // another process may remove a cached directory without clearing cache of this one
+
+    pthread_rwlock_rdlock(&(shard->lock));
+    if (entry->hash == hash && !strcmp(entry->path, path))
+    {
+        inode_ptr = entry->ptr_inode;
+        inode_get(inode_ptr); // directory is not freed before dcache_clear() removed it from cache
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+
+    return inode_ptr;
+}
+
+// 'epoch' is dcache_epoch from before the path was resolved
+void dcache_insert(const char *path, struct inode *inode_ptr, int epoch)
+{
+    unsigned int hash = path_hash(path);
+    struct dcache_shard *shard = &dcache[(hash >> 24) & (DCACHE_SHARDS - 1)];
+    struct dcache_entry *entry = dcache_slot(hash);
+
+    if (strlen(path) >= DCACHE_PATH || process_shared)
+        return;
+
+    pthread_rwlock_wrlock(&(shard->lock));
+    if (ATOMIC_LOAD(&dcache_epoch) == epoch) // directory on the path may have been removed meanwhile
+    {
+        entry->hash = hash;
+        entry->ptr_inode = inode_ptr;
+        strcpy(entry->path, path);
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+}
+
+// called after a directory was removed from name index and before it is freed
+void dcache_clear()
+{
+    int counter;
+
+    ATOMIC_ADD(&dcache_epoch, 1);
+    for (counter = 0; counter < DCACHE_SHARDS; counter++)
+    {
+        pthread_rwlock_wrlock(&(dcache[counter].lock));
+        memset(dcache[counter].slots, 0, sizeof(dcache[counter].slots));
+        pthread_rwlock_unlock(&(dcache[counter].lock));
+    }
+}
+
+// writes absolute form of 'path' into 'absolute' ("/a/b", "" for root directory) without ".", ".." and repeated '/',
+// returns its length, -1 if path is empty or too long
+int normalize_path(const char *path, char *absolute)
+{
+    int length = 0;
+    int component_length;
+    char joined[2 * MAX_PATH_LENGTH];
+    char *component;
+    char *save = NULL;
+
+    if (path == NULL || path[0] == '\0' || strlen(path) >= MAX_PATH_LENGTH)
+        return -1;
+
+    if (path[0] == '/')
+        strcpy(joined, path);
+    else
+    {
+        pthread_rwlock_rdlock(&cwd_lock);
+        snprintf(joined, sizeof(joined), "%s/%s", cwd_path, path);
+        pthread_rwlock_unlock(&cwd_lock);
+    }
+
+    absolute[0] = '\0';
+    for (component = strtok_r(joined, "/", &save); component != NULL; component = strtok_r(NULL, "/", &save))
+    {
+        if (!strcmp(component, "."))
+            continue;
+
+        if (!strcmp(component, "..")) // parent of root directory is root directory
+        {
+            while (length > 0 && absolute[--length] != '/')
+                ;
+            absolute[length] = '\0';
+            continue;
+        }
+
+        component_length = strlen(component);
+        if (length + 1 + component_length >= MAX_PATH_LENGTH)
+            return -1;
+        absolute[length++] = '/';
+        strcpy(absolute + length, component);
+        length += component_length;
+    }
+    return length;
+}
+
+// returns directory at absolute path 'path' ("" is not accepted) with an extra reference, NULL if there is no such directory
+struct inode *find_directory(const char *path)
+{
+    int epoch;
+    char walk[MAX_PATH_LENGTH];
+    char *component;
+    char *save = NULL;
+    struct inode *dir_ptr = NULL;
+    struct inode *next = NULL;
+
+    if ((dir_ptr = dcache_lookup(path)) != NULL)
+        return dir_ptr;
+
+    // every name on the path is one lookup in name index
+    epoch = ATOMIC_LOAD(&dcache_epoch);
+    strcpy(walk, path);
+    for (component = strtok_r(walk, "/", &save); component != NULL; component = strtok_r(NULL, "/", &save))
+    {
+        next = index_lookup((dir_ptr == NULL) ? 0 : dir_ptr->inode_number, component);
+        if (dir_ptr != NULL)
+            inode_put(dir_ptr);
+        dir_ptr = next;
+
+        if (dir_ptr == NULL || dir_ptr->file_type != DIRECTORY)
+        {
+            if (dir_ptr != NULL)
+                inode_put(dir_ptr);
+            return NULL; // there is no such directory
+        }
+    }
+
+    dcache_insert(path, dir_ptr, epoch);
+    return dir_ptr;
+}
+
+// finds directory holding last name of 'path' and copies that name into 'name' (MAX_FILE_NAME bytes)
+// directory is returned with an extra reference in 'dir_ptr' (NULL for root directory)
+// returns -1 if there is no such directory, -2 if path is invalid
+int resolve_parent(const char *path, struct inode **dir_ptr, char *name)
+{
+    int length;
+    char absolute[MAX_PATH_LENGTH];
+    char *last;
+
+    *dir_ptr = NULL;
+    if (path == NULL)
+        return -2;
+
+    // plain name while current directory is root directory, this is the common case and needs no path handling
+    if (ATOMIC_LOAD(&cwd_is_root) && strchr(path, '/') == NULL && strcmp(path, ".") != 0 && strcmp(path, "..") != 0)
+    {
+        length = strlen(path);
+        if (length == 0 || length >= MAX_FILE_NAME)
+            return -2;
+        strcpy(name, path);
+        return 0;
+    }
+
+    if (normalize_path(path, absolute) <= 0)
+        return -2; // path is invalid or it is root directory itself
+
+    last = strrchr(absolute, '/');
+    if (strlen(last + 1) >= MAX_FILE_NAME)
+        return -2;
+    strcpy(name, last + 1);
+    *last = '\0';
+
+    if (absolute[0] == '\0')
+        return 0; // file is in root directory
+
+    if ((*dir_ptr = find_directory(absolute)) == NULL)
+        return -1;
+    return 0;
+}
+
+// returns inode of 'path' with an extra reference (release with inode_put()), NULL if there is no such file
+struct inode *path_lookup(const char *path)
+{
+    char name[MAX_FILE_NAME];
+    struct inode *dir_ptr = NULL;
+    struct inode *inode_ptr = NULL;
+
+    if (resolve_parent(path, &dir_ptr, name) != 0)
+        return NULL;
+
+    inode_ptr = index_lookup((dir_ptr == NULL) ? 0 : dir_ptr->inode_number, name);
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    return inode_ptr;
+}
+
+// writes path of file relative to root directory ("a/b/file") into 'path', -1 if it does not fit
+// (names of directories do not change and a directory holding a file can not be removed, so no lock is needed)
+int inode_path(struct inode *inode_ptr, char *path, int size)
+{
+    int length = 0;
+    int position;
+    int name_length;
+    struct inode *current;
+
+    for (current = inode_ptr; ; current = &inode_table[current->parent_inode - 1])
+    {
+        length += strlen(current->file_name) + 1;
+        if (current->parent_inode == 0)
+            break;
+    }
+    if (length > size)
+        return -1;
+
+    position = length - 1;
+    path[position] = '\0';
+    for (current = inode_ptr; ; current = &inode_table[current->parent_inode - 1])
+    {
+        name_length = strlen(current->file_name);
+        position -= name_length;
+        memcpy(path + position, current->file_name, name_length);
+        if (current->parent_inode == 0)
+            break;
+        path[--position] = '/';
+    }
+    return 0;
+}
+
+int cvfs_mkdir(const char *path)
+{
+    int status;
+    char name[MAX_FILE_NAME];
+    struct inode *dir_ptr = NULL;
+
+    if (resolve_parent(path, &dir_ptr, name) != 0)
+        return -1; // incorrect path or no such directory
+
+    journal_begin();
+    status = create_entry(dir_ptr, name, DIRECTORY, READ + WRITE);
+    if (journal_end() != 0 && status == 0)
+        status = CVFS_JOURNAL_FAILED; // directory is not durable
+
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    return status;
+}
+
+int cvfs_chdir(const char *path)
+{
+    char absolute[MAX_PATH_LENGTH];
+    struct inode *dir_ptr = NULL;
+
+    if (normalize_path(path, absolute) == -1)
+        return -1;
+
+    if (absolute[0] != '\0')
+    {
+        if ((dir_ptr = find_directory(absolute)) == NULL)
+            return -1; // there is no such directory
+        inode_put(dir_ptr);
+    }
+
+    pthread_rwlock_wrlock(&cwd_lock);
+    strcpy(cwd_path, absolute);
+    ATOMIC_STORE(&cwd_is_root, absolute[0] == '\0');
+    pthread_rwlock_unlock(&cwd_lock);
+    return 0;
+}
+
+int cvfs_getcwd(char *path, int size)
+{
+    int status = -1;
+
+    pthread_rwlock_rdlock(&cwd_lock);
+    if (snprintf(path, size, "%s", (cwd_path[0] == '\0') ? "/" : cwd_path) < size)
+        status = 0;
+    pthread_rwlock_unlock(&cwd_lock);
+    return status;
+}
+
+int cvfs_next_entry(const char *path, int position, struct cvfs_stat *stat_buf)
+{
+    int found = 0;
+    int parent = 0;
+    char absolute[MAX_PATH_LENGTH];
+    struct inode *dir_ptr = NULL;
+    struct inode *inode_ptr = NULL;
+
+    if (normalize_path(path, absolute) == -1)
+        return -2;
+
+    if (absolute[0] != '\0')
+    {
+        if ((dir_ptr = find_directory(absolute)) == NULL)
+            return -2; // there is no such directory
+        parent = dir_ptr->inode_number;
+    }
+
+    for (; position < ATOMIC_LOAD(&(super_block->initialized_inodes)); position++)
+    {
+        inode_ptr = &inode_table[position];
+
+        pthread_rwlock_rdlock(&(inode_ptr->lock));
+        found = (inode_ptr->file_type != 0 && inode_ptr->link_count != 0 && inode_ptr->parent_inode == parent);
+        if (found)
+            fill_stat(inode_ptr, stat_buf);
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+
+        if (found)
+            break;
+    }
+
+    if (dir_ptr != NULL)
+        inode_put(dir_ptr);
+    return found ? position : -1;
+}
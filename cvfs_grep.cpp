@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GREP_X86 1
+#endif
+
+#include "cvfs_internal.h"
+
+// Files are scanned where their data lies: runs of consecutive blocks are searched in block pool without copying,
+// compressed files are decompressed one unit at a time. Holes are skipped, a pattern is a C string and can not
+// match zeros. Last bytes of a run are kept, so a match which crosses into next run is still found.
+//
+// Search compares first and last byte of pattern at 16 (SSE2) or 32 (AVX2) positions at once and only positions
+// where both are equal are compared with memcmp(), so a scan mostly costs two vector compares per 16/32 bytes.
+
+#define MAX_GREP_WORKERS 16
+#define GREP_SCALAR 0
+#define GREP_SSE2 1
+#define GREP_AVX2 2
+
+struct grep_job
+{
+    const char *pattern;
+    int pattern_length;
+    char **file_names;         // files to be scanned, NULL scans every regular file
+    int file_count;
+    int next;                  // next file or inode to be claimed by a worker (atomic)
+    void (*match)(const char *path, long long offset, void *argument);
+    void *argument;
+    pthread_mutex_t match_lock; // calls of 'match' are serialized
+    int files_scanned;         // atomic counters of summary
+    int files_matched;
+    int files_failed;
+    long long matches;
+    long long bytes_scanned;
+};
+
+// state of one file while it is scanned
+struct grep_scan
+{
+    struct grep_job *job;
+    const char *path;
+    long long matches;
+    long long carry_offset;    // file offset following carried bytes (-1 if nothing is carried)
+    int carry_length;
+    char carry[2 * MAX_PATTERN_LENGTH]; // last bytes of previous run, then first bytes of next one
+};
+
+int grep_level = -1; // GREP_* used by searches, -1 until it is chosen for this processor
+
+double grep_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int grep_best_level()
+{
+#ifdef GREP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return GREP_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return GREP_SSE2;
+#endif
+    return GREP_SCALAR;
+}
+
+int cvfs_set_grep_simd(int level)
+{
+    int best = grep_best_level();
+
+    if (level < 0 || level > best)
+        level = best; // processor does not have requested instructions
+    ATOMIC_STORE(&grep_level, level);
+    return level;
+}
+
+// first position at or after 'from' where pattern starts, -1 if there is none
+long long search_scalar(const char *data, long long length, long long from, const char *pattern, int pattern_length)
+{
+    const char *found;
+
+    while (from + pattern_length <= length)
+    {
+        found = (const char *)memchr(data + from, pattern[0], length - pattern_length + 1 - from);
+        if (found == NULL)
+            return -1;
+        from = found - data;
+        if (memcmp(found + 1, pattern + 1, pattern_length - 1) == 0)
+            return from;
+        from++;
+    }
+    return -1;
+}
+
+#ifdef GREP_X86
+__attribute__((target("sse2")))
+long long search_sse2(const char *data, long long length, long long from, const char *pattern, int pattern_length)
+{
+    __m128i first = _mm_set1_epi8(pattern[0]);
+    __m128i last = _mm_set1_epi8(pattern[pattern_length - 1]);
+    unsigned int mask;
+    int bit;
+
+    for (; from + pattern_length - 1 + 16 <= length; from += 16)
+    {
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)(data + from))),
+                                               _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(data + from + pattern_length - 1)))));
+        while (mask != 0)
+        {
+            bit = __builtin_ctz(mask);
+            if (memcmp(data + from + bit + 1, pattern + 1, pattern_length - 2 > 0 ? pattern_length - 2 : 0) == 0)
+                return from + bit;
+            mask &= mask - 1;
+        }
+    }
+    return search_scalar(data, length, from, pattern, pattern_length); // last positions do not fill a vector
+}
+
+__attribute__((target("avx2")))
+long long search_avx2(const char *data, long long length, long long from, const char *pattern, int pattern_length)
+{
+    __m256i first = _mm256_set1_epi8(pattern[0]);
+    __m256i last = _mm256_set1_epi8(pattern[pattern_length - 1]);
+    unsigned int mask;
+    int bit;
+
+    for (; from + pattern_length - 1 + 32 <= length; from += 32)
+    {
+        mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *)(data + from))),
+                                                     _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i *)(data + from + pattern_length - 1)))));
+        while (mask != 0)
+        {
+            bit = __builtin_ctz(mask);
+            if (memcmp(data + from + bit + 1, pattern + 1, pattern_length - 2 > 0 ? pattern_length - 2 : 0) == 0)
+                return from + bit;
+            mask &= mask - 1;
+        }
+    }
+    return search_sse2(data, length, from, pattern, pattern_length);
+}
+#endif
+
+long long search_pattern(const char *data, long long length, long long from, const char *pattern, int pattern_length)
+{
+    int level = ATOMIC_LOAD(&grep_level);
+
+    if (level == -1)
+        level = cvfs_set_grep_simd(-1);
+#ifdef GREP_X86
+    if (level == GREP_AVX2)
+        return search_avx2(data, length, from, pattern, pattern_length);
+    if (level == GREP_SSE2)
+        return search_sse2(data, length, from, pattern, pattern_length);
+#endif
+    return search_scalar(data, length, from, pattern, pattern_length);
+}
+
+void report_match(struct grep_scan *scan, long long offset)
+{
+    struct grep_job *job = scan->job;
+
+    scan->matches++;
+    if (job->match == NULL)
+        return;
+    pthread_mutex_lock(&(job->match_lock));
+    job->match(scan->path, offset, job->argument);
+    pthread_mutex_unlock(&(job->match_lock));
+}
+
+// searches 'length' bytes of file at 'offset', runs are never shorter than a pattern except at end of file
+void scan_run(struct grep_scan *scan, const char *data, long long length, long long offset)
+{
+    int pattern_length = scan->job->pattern_length;
+    int joined = (length < pattern_length - 1) ? (int)length : pattern_length - 1;
+    long long position;
+
+    if (scan->carry_offset == offset && scan->carry_length > 0)
+    {
+        // matches starting in carried bytes end in this run (carry is shorter than pattern)
+        memcpy(scan->carry + scan->carry_length, data, joined);
+        for (position = 0; (position = search_pattern(scan->carry, scan->carry_length + joined, position, scan->job->pattern, pattern_length)) != -1 &&
+                           position < scan->carry_length;
+             position++)
+            report_match(scan, offset - scan->carry_length + position);
+    }
+
+    for (position = 0; (position = search_pattern(data, length, position, scan->job->pattern, pattern_length)) != -1; position++)
+        report_match(scan, offset + position);
+
+    memcpy(scan->carry, data + length - joined, joined);
+    scan->carry_length = joined;
+    scan->carry_offset = offset + length;
+}
+
+// caller holds read lock of inode, returns bytes scanned or -1 if memory allocation failed
+long long scan_units(struct grep_scan *scan, struct inode *inode_ptr)
+{
+    long long offset;
+    long long length;
+    long long scanned = 0;
+    char *buffer = (char *)malloc(UNIT_SIZE);
+
+    if (buffer == NULL)
+        return -1;
+
+    for (offset = seek_extent(inode_ptr, 0, 1); offset < inode_ptr->file_actual_size; offset = seek_extent(inode_ptr, offset + UNIT_SIZE, 1))
+    {
+        length = copy_from_file(inode_ptr, offset, buffer, UNIT_SIZE);
+        if (length <= 0)
+            break;
+        scan_run(scan, buffer, length, offset);
+        scanned += length;
+    }
+    free(buffer);
+    return scanned;
+}
+
+// caller holds read lock of inode, returns bytes scanned or -1 if memory allocation failed
+long long scan_file(struct grep_scan *scan, struct inode *inode_ptr)
+{
+    long long block_index;
+    long long run_start = 0;
+    long long run_length = 0;
+    long long last_block = (inode_ptr->file_actual_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    long long next_data;
+    long long scanned = 0;
+    char *run = NULL;
+    char *block;
+
+    if (inode_ptr->compression)
+        return scan_units(scan, inode_ptr);
+
+    // same walk as copy_to_host(), runs of consecutive blocks are searched in one piece
+    for (block_index = 0; block_index <= last_block; block_index++)
+    {
+        block = (block_index < last_block) ? get_file_block(inode_ptr, block_index, 0) : NULL;
+        if (block != NULL && run != NULL && block == run + run_length)
+        {
+            run_length += BLOCK_SIZE;
+            continue;
+        }
+
+        if (run != NULL)
+        {
+            if (run_start + run_length > inode_ptr->file_actual_size)
+                run_length = inode_ptr->file_actual_size - run_start;
+            scan_run(scan, run, run_length, run_start);
+            scanned += run_length;
+        }
+
+        run = block;
+        run_start = block_index * BLOCK_SIZE;
+        run_length = BLOCK_SIZE;
+
+        if (block == NULL && block_index < last_block)
+        {
+            next_data = seek_extent(inode_ptr, block_index * BLOCK_SIZE, 1);
+            block_index = (next_data < inode_ptr->file_actual_size) ? next_data / BLOCK_SIZE - 1 : last_block - 1;
+        }
+    }
+    return scanned;
+}
+
+// 'path' names file in reports, inode is referenced by caller
+void grep_inode(struct grep_job *job, struct inode *inode_ptr, const char *path)
+{
+    long long scanned;
+    struct grep_scan scan;
+
+    scan.job = job;
+    scan.path = path;
+    scan.matches = 0;
+    scan.carry_offset = -1;
+    scan.carry_length = 0;
+
+    pthread_rwlock_rdlock(&(inode_ptr->lock));
+    if (inode_ptr->file_type != REGULAR || (inode_ptr->permission & READ) == 0)
+        scanned = -1; // directories and files which can not be read are not scanned
+    else
+        scanned = scan_file(&scan, inode_ptr);
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+
+    if (scanned == -1)
+    {
+        ATOMIC_ADD(&(job->files_failed), 1);
+        return;
+    }
+    ATOMIC_ADD(&(job->files_scanned), 1);
+    ATOMIC_ADD(&(job->bytes_scanned), scanned);
+    if (scan.matches > 0)
+    {
+        ATOMIC_ADD(&(job->files_matched), 1);
+        ATOMIC_ADD(&(job->matches), scan.matches);
+    }
+}
+
+void *grep_worker(void *argument)
+{
+    struct grep_job *job = (struct grep_job *)argument;
+    struct inode *inode_ptr;
+    char path[MAX_PATH_LENGTH];
+    int index;
+
+    if (job->file_names != NULL)
+    {
+        while ((index = ATOMIC_ADD(&(job->next), 1) - 1) < job->file_count)
+        {
+            if ((inode_ptr = path_lookup(job->file_names[index])) == NULL)
+            {
+                ATOMIC_ADD(&(job->files_failed), 1); // there is no such file
+                continue;
+            }
+            grep_inode(job, inode_ptr, job->file_names[index]);
+            inode_put(inode_ptr);
+        }
+        return NULL;
+    }
+
+    // every regular file, inodes are claimed one at a time like backup does
+    while ((index = ATOMIC_ADD(&(job->next), 1) - 1) < ATOMIC_LOAD(&(super_block->initialized_inodes)))
+    {
+        inode_ptr = &inode_table[index];
+        pthread_rwlock_rdlock(&(inode_ptr->lock));
+        if (inode_ptr->file_type != REGULAR || inode_ptr->link_count == 0 || inode_path(inode_ptr, path, sizeof(path)) == -1)
+        {
+            pthread_rwlock_unlock(&(inode_ptr->lock));
+            continue;
+        }
+        inode_get(inode_ptr); // file name holds a reference while link count is not 0, so inode can not be freed now
+        pthread_rwlock_unlock(&(inode_ptr->lock));
+        grep_inode(job, inode_ptr, path);
+        inode_put(inode_ptr);
+    }
+    return NULL;
+}
+
+int cvfs_grep(const char *pattern, char *file_names[], int file_count, void (*match)(const char *path, long long offset, void *argument),
+              void *argument, struct cvfs_grep_summary *summary)
+{
+    int counter;
+    int workers;
+    int started = 0;
+    long long perf_timer = perf_start();
+    double start = grep_clock();
+    struct grep_job job;
+    pthread_t threads[MAX_GREP_WORKERS];
+
+    if (pattern == NULL || pattern[0] == '\0' || strlen(pattern) > MAX_PATTERN_LENGTH)
+        return perf_end(PERF_GREP, perf_timer, -1);
+
+    memset(&job, 0, sizeof(job));
+    job.pattern = pattern;
+    job.pattern_length = strlen(pattern);
+    job.file_names = file_names;
+    job.file_count = (file_names == NULL) ? 0 : file_count;
+    job.match = match;
+    job.argument = argument;
+    pthread_mutex_init(&(job.match_lock), NULL);
+
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > MAX_GREP_WORKERS)
+        workers = MAX_GREP_WORKERS;
+    if (workers > ((file_names != NULL) ? file_count : ATOMIC_LOAD(&(super_block->initialized_inodes))))
+        workers = (file_names != NULL) ? file_count : ATOMIC_LOAD(&(super_block->initialized_inodes)); // no more workers than inodes
+
+    for (counter = 1; counter < workers; counter++)
+    {
+        if (pthread_create(&threads[started], NULL, grep_worker, &job) == 0)
+            started++;
+    }
+    grep_worker(&job); // calling thread is a worker as well
+
+    for (counter = 0; counter < started; counter++)
+        pthread_join(threads[counter], NULL);
+    pthread_mutex_destroy(&(job.match_lock));
+
+    if (summary != NULL)
+    {
+        summary->files_scanned = job.files_scanned;
+        summary->files_matched = job.files_matched;
+        summary->files_failed = job.files_failed;
+        summary->matches = job.matches;
+        summary->bytes_scanned = job.bytes_scanned;
+        summary->elapsed_seconds = grep_clock() - start;
+    }
+    perf_end(PERF_GREP, perf_timer, job.bytes_scanned);
+    return job.files_matched;
+}
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "cvfs_internal.h"
+
+#define IMAGE_MAGIC "CVFSIMG"
+#define IMAGE_VERSION 2 // 2: inodes know their directory
+
+// layout of image file: header | inode table | free block stack | data blocks (every part starts on a block boundary)
+struct image_header
+{
+    char magic[8];                    // IMAGE_MAGIC
+    int version;                      // IMAGE_VERSION
+    int block_size;                   // geometry the image was formatted with, it is used whenever image is mounted
+    int max_inodes;
+    int max_blocks;
+    int inode_size;                   // sizeof(struct inode), changes when inode layout changes
+    long long inode_table_offset;     // byte offset of inode table
+    long long free_block_stack_offset; // byte offset of free block stack
+    long long data_offset;            // byte offset of block 0
+    long long image_size;             // size of whole image file
+    struct superblock super_block;    // counters and free lists of file system
+};
+
+// a shared memory segment (see cvfs_mount_shared()) is an image followed by state which processes using the image
+// must share, and which a process keeps in its own memory otherwise: shared area | index slots | block shares
+struct shared_area
+{
+    pthread_mutex_t inode_alloc_lock;  // process shared, like every lock in segment
+    pthread_mutex_t block_alloc_lock;
+    long long shared_block_count;
+    long long unit_sequence;           // compressed units of every process are numbered from here
+    struct index_shard name_index[INDEX_SHARDS];
+};
+
+struct image
+{
+    int fd;                     // descriptor of image file on host (-1 if nothing is mounted)
+    char *base;                 // start of mapping
+    long long size;             // length of mapping
+    int journal_latency;        // commit latency bound of journal in milliseconds (-1 means image is not journaled)
+    int checkpoint_interval;    // seconds between automatic checkpoints (0 means disabled)
+    int flusher_running;        // 1 while checkpoint thread exists
+    pthread_t flusher;          // checkpoint thread
+    pthread_mutex_t lock;       // protects checkpoint_interval and flusher_running
+    pthread_cond_t wakeup;      // signaled when interval changes or image is unmounted
+};
+
+struct image mounted_image = {-1, NULL, 0, -1, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+long long align_to_block(long long offset)
+{
+    return (offset + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+void fill_header(struct image_header *header)
+{
+    memset(header, 0, sizeof(*header));
+    strcpy(header->magic, IMAGE_MAGIC);
+    header->version = IMAGE_VERSION;
+    header->block_size = BLOCK_SIZE;
+    header->max_inodes = MAX_INODES;
+    header->max_blocks = MAX_BLOCKS;
+    header->inode_size = sizeof(struct inode);
+    header->inode_table_offset = align_to_block(sizeof(struct image_header));
+    header->free_block_stack_offset = header->inode_table_offset + align_to_block((long long)MAX_INODES * sizeof(struct inode));
+    header->data_offset = header->free_block_stack_offset + align_to_block((long long)MAX_BLOCKS * sizeof(int));
+    header->image_size = header->data_offset + (long long)MAX_BLOCKS * BLOCK_SIZE;
+}
+
+// offsets of image must be the ones its geometry gives, otherwise they mean something else
+int header_matches(struct image_header *header)
+{
+    struct image_header expected;
+
+    fill_header(&expected);
+    return strcmp(header->magic, IMAGE_MAGIC) == 0 &&
+           header->version == expected.version &&
+           header->block_size == expected.block_size &&
+           header->max_inodes == expected.max_inodes &&
+           header->max_blocks == expected.max_blocks &&
+           header->inode_size == expected.inode_size &&
+           header->inode_table_offset == expected.inode_table_offset &&
+           header->free_block_stack_offset == expected.free_block_stack_offset &&
+           header->data_offset == expected.data_offset &&
+           header->image_size == expected.image_size;
+}
+
+// locks, open counts and descriptors do not survive a restart, so they are reset for every inode in image
+void reset_inodes()
+{
+    int counter;
+    struct inode *inode_ptr;
+
+    for (counter = 0; counter < super_block->initialized_inodes; counter++)
+    {
+        inode_ptr = &inode_table[counter];
+        init_rwlock(&(inode_ptr->lock));
+        inode_ptr->file_desc = -1;
+        inode_ptr->open_count = 0;
+        inode_ptr->entry_count = 0; // counted again when name index is rebuilt
+        inode_ptr->reference_count = inode_ptr->link_count; // only the file name refers to inode now
+
+        if (inode_ptr->file_type != 0 && inode_ptr->link_count == 0)
+        {
+            // file was removed while it was still opened, last close never happened
+            journal_begin();
+            release_file_blocks(inode_ptr, 0);
+            inode_ptr->file_type = 0;
+            inode_ptr->file_actual_size = 0;
+            inode_ptr->permission = 0;
+            release_inode(inode_ptr);
+            journal_end();
+        }
+    }
+}
+
+int cvfs_set_journal(int commit_latency_ms)
+{
+    if (mounted_image.fd != -1)
+        return -1; // journal can not be changed while image is mounted
+    if (commit_latency_ms < -1)
+        return -2;
+
+    mounted_image.journal_latency = commit_latency_ms;
+    return 0;
+}
+
+int cvfs_mount(const char *image_path)
+{
+    int fd;
+    int status;
+    struct stat file_info;
+    struct image_header header;
+    char journal_path[4096];
+    char *base;
+
+    if (image_path == NULL || mounted_image.fd != -1)
+        return -1;
+
+    fd = open(image_path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || fstat(fd, &file_info) == -1)
+    {
+        if (fd != -1)
+            close(fd);
+        return -1; // image can not be opened
+    }
+
+    if (file_info.st_size != 0)
+    {
+        // existing image keeps geometry it was formatted with
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+            header.inode_size != sizeof(struct inode) || validate_geometry(header.max_inodes, header.max_blocks, header.block_size) != 0)
+        {
+            close(fd);
+            return -2; // not an image of this file system
+        }
+        set_geometry(header.max_inodes, header.max_blocks, header.block_size);
+    }
+    else
+        set_geometry(geometry.max_inodes, geometry.max_blocks, geometry.block_size);
+
+    fill_header(&header);
+    if (file_info.st_size == 0)
+    {
+        // new image, only header is written, rest of file stays a hole until blocks are used
+        super_block = &(header.super_block);
+        initialize_superblock();
+        if (ftruncate(fd, header.image_size) == -1 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header) || fdatasync(fd) == -1)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else if (file_info.st_size != header.image_size)
+    {
+        close(fd);
+        return -2; // not an image of this file system
+    }
+
+    if (mounted_image.journal_latency >= 0)
+    {
+        // image is brought up to date before it is mapped, changes are only written to journal afterwards
+        snprintf(journal_path, sizeof(journal_path), "%s.journal", image_path);
+        status = journal_open(journal_path, fd, header.image_size, mounted_image.journal_latency);
+        if (status < 0)
+        {
+            close(fd);
+            return status;
+        }
+        base = (char *)mmap(NULL, header.image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+    }
+    else
+        base = (char *)mmap(NULL, header.image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (!header_matches((struct image_header *)base))
+    {
+        munmap(base, header.image_size);
+        close(fd);
+        return -2;
+    }
+
+    // nothing below touches data blocks (only block tables of files are read), so mounting does not depend on size of image
+    super_block = &(((struct image_header *)base)->super_block);
+    inode_table = (struct inode *)(base + header.inode_table_offset);
+    free_block_stack = (int *)(base + header.free_block_stack_offset);
+    block_pool = base + header.data_offset;
+
+    if (initialize_tables() != 0 || shares_rebuild() != 0 || (mounted_image.journal_latency >= 0 && journal_start(base) != 0))
+    {
+        munmap(base, header.image_size);
+        close(fd);
+        return -1;
+    }
+    reset_inodes();
+    if (initialize_index(name_index, NULL) != 0)
+    {
+        munmap(base, header.image_size);
+        close(fd);
+        return -1;
+    }
+    index_rebuild();
+
+    mounted_image.fd = fd;
+    mounted_image.base = base;
+    mounted_image.size = header.image_size;
+    return 0;
+}
+
+long long index_slots_offset(struct image_header *header)
+{
+    return header->image_size + align_to_block(sizeof(struct shared_area));
+}
+
+long long block_shares_offset(struct image_header *header)
+{
+    return index_slots_offset(header) + align_to_block((long long)INDEX_SHARDS * SHARD_SIZE * sizeof(struct index_entry));
+}
+
+long long segment_size(struct image_header *header)
+{
+    return block_shares_offset(header) + align_to_block((long long)MAX_BLOCKS * sizeof(int));
+}
+
+// file system state of this process points into mapping at 'base' from now on
+void map_segment(char *base, int created)
+{
+    struct image_header *header = (struct image_header *)base;
+    struct shared_area *area = (struct shared_area *)(base + header->image_size);
+
+    super_block = &(header->super_block);
+    inode_table = (struct inode *)(base + header->inode_table_offset);
+    free_block_stack = (int *)(base + header->free_block_stack_offset);
+    block_pool = base + header->data_offset;
+    block_shares = (int *)(base + block_shares_offset(header));
+    shared_block_count = &(area->shared_block_count);
+    inode_alloc_lock = &(area->inode_alloc_lock);
+    block_alloc_lock = &(area->block_alloc_lock);
+    process_shared = 1;
+    share_unit_sequence(&(area->unit_sequence));
+
+    if (created)
+    {
+        // rest of a new segment is zero filled, which is an empty file system
+        initialize_superblock();
+        init_mutex(inode_alloc_lock);
+        init_mutex(block_alloc_lock);
+        initialize_index(area->name_index, (struct index_entry *)(base + index_slots_offset(header)));
+    }
+    else
+    {
+        name_index = area->name_index;
+        index_slots = (struct index_entry *)(base + index_slots_offset(header));
+    }
+}
+
+void unmap_segment(char *base, long long size)
+{
+    munmap(base, size);
+    inode_table = NULL;
+    free_block_stack = NULL;
+    block_pool = NULL;
+    use_process_memory();
+}
+
+int cvfs_mount_shared(const char *segment_name)
+{
+    int fd;
+    int created;
+    struct stat file_info;
+    struct image_header header;
+    char *base;
+
+    if (segment_name == NULL || mounted_image.fd != -1)
+        return -1;
+    if (mounted_image.journal_latency >= 0)
+        return -3; // processes write segment directly, nothing could be committed to a journal first
+
+    // processes mount one at a time, so none of them sees a segment which is still being initialized
+    fd = shm_open(segment_name, O_RDWR | O_CREAT, 0600);
+    if (fd == -1 || flock(fd, LOCK_EX) == -1 || fstat(fd, &file_info) == -1)
+    {
+        if (fd != -1)
+            close(fd);
+        return -1; // segment can not be opened
+    }
+
+    created = (file_info.st_size == 0);
+    if (!created)
+    {
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+            header.inode_size != sizeof(struct inode) || validate_geometry(header.max_inodes, header.max_blocks, header.block_size) != 0)
+        {
+            close(fd);
+            return -2; // not a segment of this file system
+        }
+        set_geometry(header.max_inodes, header.max_blocks, header.block_size);
+    }
+    else
+        set_geometry(geometry.max_inodes, geometry.max_blocks, geometry.block_size);
+
+    fill_header(&header);
+    if (created ? ftruncate(fd, segment_size(&header)) == -1 : file_info.st_size != segment_size(&header))
+    {
+        close(fd);
+        return created ? -1 : -2;
+    }
+
+    base = (char *)mmap(NULL, segment_size(&header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (created)
+        memcpy(base, &header, sizeof(header));
+    else if (!header_matches((struct image_header *)base))
+    {
+        munmap(base, segment_size(&header));
+        close(fd);
+        return -2;
+    }
+
+    cvfs_set_dedup(0); // see cvfs_set_dedup()
+    map_segment(base, created);
+    if (initialize_tables() != 0)
+    {
+        unmap_segment(base, segment_size(&header));
+        close(fd);
+        return -1;
+    }
+
+    flock(fd, LOCK_UN);
+    mounted_image.fd = fd;
+    mounted_image.base = base;
+    mounted_image.size = segment_size(&header);
+    return 0;
+}
+
+int cvfs_remove_shared(const char *segment_name)
+{
+    if (segment_name == NULL || shm_unlink(segment_name) == -1)
+        return -1;
+    return 0;
+}
+
+int cvfs_checkpoint(void)
+{
+    if (mounted_image.fd == -1 || process_shared)
+        return -1; // no image is mounted (a shared segment is only in memory)
+
+    if (mounted_image.journal_latency >= 0)
+        return journal_checkpoint();
+
+    if (msync(mounted_image.base, mounted_image.size, MS_SYNC) == -1)
+        return -2; // image could not be written
+
+    return 0;
+}
+
+void *checkpoint_worker(void *argument)
+{
+    struct timespec deadline;
+
+    (void)argument;
+    pthread_mutex_lock(&(mounted_image.lock));
+    while (mounted_image.checkpoint_interval > 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += mounted_image.checkpoint_interval;
+
+        if (pthread_cond_timedwait(&(mounted_image.wakeup), &(mounted_image.lock), &deadline) != 0 && mounted_image.checkpoint_interval > 0)
+        {
+            pthread_mutex_unlock(&(mounted_image.lock));
+            cvfs_checkpoint();
+            pthread_mutex_lock(&(mounted_image.lock));
+        }
+    }
+    pthread_mutex_unlock(&(mounted_image.lock));
+    return NULL;
+}
+
+void stop_checkpoint_worker()
+{
+    int running;
+
+    pthread_mutex_lock(&(mounted_image.lock));
+    mounted_image.checkpoint_interval = 0;
+    running = mounted_image.flusher_running;
+    mounted_image.flusher_running = 0;
+    pthread_cond_signal(&(mounted_image.wakeup));
+    pthread_mutex_unlock(&(mounted_image.lock));
+
+    if (running)
+        pthread_join(mounted_image.flusher, NULL);
+}
+
+int cvfs_set_checkpoint_interval(int seconds)
+{
+    if (mounted_image.fd == -1 || process_shared)
+        return -1;
+    if (seconds < 0)
+        return -2;
+
+    stop_checkpoint_worker();
+    if (seconds == 0)
+        return 0;
+
+    pthread_mutex_lock(&(mounted_image.lock));
+    mounted_image.checkpoint_interval = seconds;
+    if (pthread_create(&(mounted_image.flusher), NULL, checkpoint_worker, NULL) == 0)
+        mounted_image.flusher_running = 1;
+    else
+        mounted_image.checkpoint_interval = 0;
+    pthread_mutex_unlock(&(mounted_image.lock));
+
+    return mounted_image.flusher_running ? 0 : -1;
+}
+
+int cvfs_unmount(void)
+{
+    int status;
+
+    if (mounted_image.fd == -1)
+        return -1;
+
+    stop_checkpoint_worker();
+    cvfs_close_all();
+    if (process_shared)
+        status = 0; // other processes keep using segment
+    else if (mounted_image.journal_latency >= 0)
+        status = journal_close();
+    else
+        status = cvfs_checkpoint();
+
+    if (process_shared)
+        unmap_segment(mounted_image.base, mounted_image.size);
+    else
+    {
+        munmap(mounted_image.base, mounted_image.size);
+        inode_table = NULL;
+        free_block_stack = NULL;
+        block_pool = NULL;
+    }
+    close(mounted_image.fd);
+    mounted_image.fd = -1;
+    mounted_image.base = NULL;
+    mounted_image.size = 0;
+    return status;
+}
@@ -0,0 +1,252 @@
+#ifndef CVFS_INTERNAL_H
+#define CVFS_INTERNAL_H
+
+#include <pthread.h>
+
+#include "cvfs.h"
+
+// default geometry, every value can be given to compiler (-DCVFS_MAX_INODES=...) and changed at run time with cvfs_configure()
+#ifndef CVFS_MAX_INODES
+#define CVFS_MAX_INODES 50
+#endif
+#ifndef CVFS_MAX_BLOCKS
+#define CVFS_MAX_BLOCKS 262144   // number of data blocks (1 GB of file data)
+#endif
+#ifndef CVFS_BLOCK_SIZE
+#define CVFS_BLOCK_SIZE 4096     // size of one data block (power of 2)
+#endif
+
+struct geometry
+{
+    int max_inodes;
+    int max_blocks;
+    int block_size;
+    int block_shift; // log2 of block_size
+    int shard_size;  // number of slots in one shard of name index (power of 2)
+};
+
+extern struct geometry geometry;
+
+// -DCVFS_FIXED_GEOMETRY turns the defaults into constants (faster block arithmetic, cvfs_configure() can not change them)
+#ifdef CVFS_FIXED_GEOMETRY
+#define MAX_INODES CVFS_MAX_INODES
+#define MAX_BLOCKS CVFS_MAX_BLOCKS
+#define BLOCK_SIZE CVFS_BLOCK_SIZE
+#define BLOCK_SHIFT __builtin_ctz(CVFS_BLOCK_SIZE)
+#else
+#define MAX_INODES (geometry.max_inodes)
+#define MAX_BLOCKS (geometry.max_blocks)
+#define BLOCK_SIZE (geometry.block_size)
+#define BLOCK_SHIFT (geometry.block_shift)
+#endif
+
+// inode
+#define CACHE_LINE 64 // inodes are aligned to cache line so that one inode never straddles two lines
+
+// blocks
+#define DIRECT_BLOCKS 12                                    // block numbers stored directly in inode
+#define POINTERS_PER_BLOCK (BLOCK_SIZE / (int)sizeof(int))  // block numbers stored in one indirect block
+#define POINTERS_SHIFT (BLOCK_SHIFT - 2)                    // log2 of POINTERS_PER_BLOCK
+#define MAX_FILE_BLOCKS (DIRECT_BLOCKS + POINTERS_PER_BLOCK + (long long)POINTERS_PER_BLOCK * POINTERS_PER_BLOCK)
+
+// compression (cvfs_compress.cpp)
+#define UNIT_BLOCKS 16                    // compressed files are stored in units of this many blocks, each compressed on its own
+#define UNIT_SHIFT (BLOCK_SHIFT + 4)      // log2 of UNIT_BLOCKS * BLOCK_SIZE
+#define UNIT_SIZE (BLOCK_SIZE * UNIT_BLOCKS)
+#define UNIT_CACHE_SLOTS 64               // decompressed units kept in memory (power of 2)
+
+// name index
+#define INDEX_SHARDS 16 // name index is split into shards, each with its own lock (power of 2)
+#define SHARD_SIZE (geometry.shard_size)
+#define INDEX_EMPTY 0   // hash value of a slot which was never used
+#define INDEX_DELETED 1 // hash value of a slot whose file was deleted (tombstone)
+
+// dentry cache, directories of recently resolved paths
+#define DCACHE_SHARDS 16 // each shard has its own lock (power of 2)
+#define DCACHE_SLOTS 64  // slots of one shard, a slot holds the last directory whose path hashed to it (power of 2)
+#define DCACHE_PATH 128  // longer paths are not cached
+
+// operations counted by cvfs_perf.cpp
+#define PERF_CREATE 0
+#define PERF_OPEN 1
+#define PERF_READ 2     // cvfs_read() and cvfs_pread()
+#define PERF_WRITE 3    // cvfs_write() and cvfs_pwrite()
+#define PERF_LSEEK 4
+#define PERF_TRUNCATE 5
+#define PERF_UNLINK 6
+#define PERF_BACKUP 7   // cvfs_backup() and cvfs_backup_archive(), bytes are bytes written
+#define PERF_CLONE 8
+#define PERF_GREP 9     // bytes are bytes scanned
+#define PERF_RESTORE 10 // cvfs_restore_archive(), bytes are bytes restored
+#define PERF_OPS 11
+
+// atomic operations on plain integers (structures stay plain data)
+#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ATOMIC_ADD(ptr, value) __atomic_add_fetch((ptr), (value), __ATOMIC_ACQ_REL)
+#define ATOMIC_CAS(ptr, expected, desired) __atomic_compare_exchange_n((ptr), (expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+struct alignas(CACHE_LINE) inode
+{
+    char file_name[MAX_FILE_NAME];
+    int inode_number;
+    long long file_size;        // bytes of blocks allocated to file
+    long long file_actual_size; // to determine actual size of file
+    int file_type;              // REGULAR or DIRECTORY, 0 while inode is free
+    int direct_blocks[DIRECT_BLOCKS]; // block numbers of first blocks of file (0 means block not allocated)
+    int indirect_block;         // block holding block numbers of next POINTERS_PER_BLOCK blocks
+    int double_indirect_block;  // block holding block numbers of indirect blocks for rest of file
+    int link_count;           // remains 1 throughout the exexution (no hardlinks), 0 once file is removed
+    int parent_inode;         // inode number of directory holding the file (0 for root directory)
+    int permission;           // read, write and read + write
+    int next_free_inode;      // index of the next free inode in DILB (-1 at end of free list)
+    int compression;          // 1 if data is kept in compressed units (padding before, so 0 in older images)
+    long long change_generation; // incremented on every change of data or size
+    long long backup_generation; // change_generation which was last copied by cvfs_backup()
+    // fields below are not persistent, they are rebuilt when image is mounted
+    int reference_count;      // file tables and running calls using this inode (atomic), inode is freed when it drops to 0 after removal
+    int file_desc;            // file descriptor of a file table pointing at this inode (-1 if file is not opened)
+    int open_count;           // file tables pointing at this inode (changed with inode write lock)
+    int entry_count;          // files in directory (atomic), directory can be removed only when it is 0
+    pthread_rwlock_t lock;    // readers share data and size, writers and truncate are exclusive
+};
+
+struct filetable
+{
+    long long read_offset;        // from where to read
+    long long write_offset;       // from where to write
+    int reference_count;          // 1 while file is opened plus running calls on descriptor (atomic), 0 means table is free
+    int mode;                     // in which mode file is opened
+    struct inode *ptr_inode;      // pointer to an inode
+    pthread_mutex_t offset_lock;  // serializes calls which move offsets of this file table
+};
+
+struct ufdt
+{
+    struct filetable *ptr_filetable; // pointer to the filetable (NULL if descriptor is not opened)
+};
+
+struct superblock
+{
+    int total_inodes;       // total number of inodes
+    int free_inodes;        // to indicate free inodes
+    int total_blocks;       // total number of data blocks
+    int free_blocks;        // to indicate free data blocks
+    int initialized_inodes; // inodes beyond this index are not initialized yet (lazy initialization)
+    int free_inode_list;    // index of first inode in the list of released inodes
+    int initialized_blocks; // blocks from this number onwards were never handed out (still zero filled)
+    int free_block_count;   // number of entries in free_block_stack
+};
+
+// index holds inode numbers instead of pointers, so it can be shared by processes which map inode table elsewhere
+struct index_entry
+{
+    unsigned int hash;       // hash of file name (INDEX_EMPTY or INDEX_DELETED for unused slots)
+    int inode_number;        // inode of file
+};
+
+struct alignas(CACHE_LINE) index_shard
+{
+    pthread_rwlock_t lock;                 // lookups share shard, create and remove are exclusive
+    int used;                              // slots holding a file or a tombstone
+    int deleted;                           // number of tombstones
+};
+
+// globals defined in cvfs.cpp
+extern struct superblock *super_block;
+extern struct ufdt *ufdt_array;
+extern struct filetable *filetable_array;
+extern struct inode *inode_table;
+extern struct index_shard *name_index;
+extern struct index_entry *index_slots;
+extern char *block_pool;
+extern int *free_block_stack;
+extern int *block_shares;
+extern long long *shared_block_count;
+extern pthread_mutex_t *inode_alloc_lock;
+extern pthread_mutex_t *block_alloc_lock;
+extern int process_shared;
+
+// cvfs.cpp
+int validate_geometry(int max_inodes, int max_blocks, int block_size);
+void set_geometry(int max_inodes, int max_blocks, int block_size);
+void initialize_superblock();
+void init_rwlock(pthread_rwlock_t *lock);
+void init_mutex(pthread_mutex_t *mutex);
+int initialize_tables();
+int initialize_index(struct index_shard *shards, struct index_entry *slots);
+void use_process_memory();
+void index_rebuild();
+int shares_rebuild();
+unsigned int entry_hash(int parent, const char *name);
+struct index_shard *get_shard(unsigned int hash);
+struct inode *index_lookup(int parent, const char *name);
+void inode_get(struct inode *inode_ptr);
+void inode_put(struct inode *inode_ptr);
+int create_entry(struct inode *dir_ptr, const char *name, int file_type, int permission);
+void fill_stat(struct inode *inode_ptr, struct cvfs_stat *stat_buf);
+struct filetable *get_filetable(int fd); // release with put_filetable()
+void put_filetable(struct filetable *filetable_ptr);
+char *block_address(int block);
+int *get_block_slot(struct inode *inode_ptr, long long block_index, int allocate);
+char *get_file_block(struct inode *inode_ptr, long long block_index, int allocate); // 'allocate' also unshares a cloned block
+long long file_block_count(struct inode *inode_ptr);
+long long seek_extent(struct inode *inode_ptr, long long offset, int data);
+int block_is_zero(const char *data, long long length);
+void put_block(int block);
+int alloc_block();
+void release_block(int block);
+void release_file_blocks(struct inode *inode_ptr, long long first_block);
+void release_inode(struct inode *inode_ptr);
+long long copy_to_blocks(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill);
+long long copy_from_blocks(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes);
+long long copy_to_file(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill);
+long long copy_from_file(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes);
+void log_inode(struct inode *inode_ptr);
+void inode_changed(struct inode *inode_ptr);
+
+// cvfs_dir.cpp, paths are resolved to the directory holding their last component
+void initialize_directories();
+void dcache_clear();
+int resolve_parent(const char *path, struct inode **dir_ptr, char *name);
+struct inode *path_lookup(const char *path);
+int inode_path(struct inode *inode_ptr, char *path, int size);
+
+// cvfs_compress.cpp, data of compressed files is read and written through these
+extern int compress_new_files;
+void unit_cache_reset();
+void share_unit_sequence(long long *sequence);
+long long copy_to_units(struct inode *inode_ptr, long long offset, const char *data, long long no_of_bytes, char fill);
+long long copy_from_units(struct inode *inode_ptr, long long offset, char *buffer, long long no_of_bytes);
+int truncate_units(struct inode *inode_ptr, long long size);
+int unit_is_hole(struct inode *inode_ptr, long long unit);
+
+// cvfs_dedup.cpp, index of written blocks by their content
+extern int dedup_enabled;
+extern long long dedup_merged;
+int dedup_reset();
+int dedup_forget(int block);
+void dedup_block(struct inode *inode_ptr, long long block_index);
+
+// cvfs_journal.cpp, every change of image happens between journal_begin() and journal_end() and is reported with journal_log()
+int journal_open(const char *journal_path, int image_fd, long long image_size, int commit_latency_ms);
+int journal_start(char *base);
+void journal_begin();
+void journal_log(const void *address, long long length);
+int journal_end(); // -1: journal could not be written, changes of transaction are not durable
+int journal_checkpoint();
+int journal_close();
+
+// cvfs_tier.cpp, block pool of a file system kept in memory, with blocks beyond memory budget in a backing file
+extern unsigned char *tier_state;
+char *tier_create_pool();
+void tier_access(int block);
+int tier_clears_released();
+void tier_release(int block);
+void tier_statfs(struct cvfs_statfs *statfs_buf);
+
+// cvfs_perf.cpp, public functions call perf_start() on entry and return through perf_end() which passes result on
+long long perf_start();
+long long perf_end(int op, long long start, long long result);
+
+#endif
@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cvfs_internal.h"
+
+#define JOURNAL_MAGIC "CVFSJRN"
+#define JOURNAL_VERSION 1
+#define RECORD_MAGIC 0x4e585443u             // "CTXN", start of every committed transaction
+#define JOURNAL_LIMIT (64LL * 1024 * 1024)   // journal is checkpointed into image when it grows beyond this
+#define JOURNAL_BATCH (1024 * 1024)          // flusher stops waiting for more commits once this many bytes are pending
+#define MERGE_WINDOW 8                       // number of recent ranges checked when a range is logged again
+
+struct journal_header
+{
+    char magic[8];        // JOURNAL_MAGIC
+    int version;          // JOURNAL_VERSION
+    int reserved;
+    long long image_size; // size of image this journal belongs to
+};
+
+// one committed transaction: record, then 'range_count' times (journal_range + bytes of range)
+struct journal_record
+{
+    unsigned int magic;   // RECORD_MAGIC
+    unsigned int crc;     // crc32 of record (with this field 0) and everything after it
+    long long lsn;        // sequence number of transaction
+    long long length;     // bytes following this record
+    int range_count;
+    int reserved;
+};
+
+struct journal_range
+{
+    long long offset; // byte offset in image
+    long long length;
+};
+
+struct journal
+{
+    int active;                     // 1 while a journaled image is mounted
+    int fd;                         // journal file
+    int image_fd;                   // image file, written only at checkpoint
+    char *base;                     // mapping of image, logged addresses are converted to offsets from here
+    long long image_size;
+    int commit_latency_ms;          // longest a commit waits for other commits to join its batch
+    int failed;                     // 1 after journal could not be written
+
+    pthread_mutex_t txn_lock;       // one transaction at a time changes the image
+    struct journal_range *ranges;   // ranges changed by current transaction
+    int range_count;
+    int range_capacity;
+    char *staging;                  // current transaction serialized before it is handed to flusher
+    long long staging_capacity;
+    unsigned char *dirty_pages;     // bitmap of image pages changed since last checkpoint
+
+    pthread_mutex_t buffer_lock;    // protects everything below
+    pthread_cond_t committed;       // signaled when a transaction is added to pending buffer
+    pthread_cond_t flushed;         // broadcast when durable_lsn moves
+    char *pending;                  // committed transactions not yet written to journal file
+    long long pending_length;
+    long long pending_capacity;
+    char *writing;                  // buffer being written by flusher
+    long long writing_capacity;
+    long long committed_lsn;        // last transaction added to pending buffer
+    long long durable_lsn;          // last transaction which is on disk
+    long long journal_size;         // bytes in journal file
+    struct timespec first_pending;  // commit time of oldest pending transaction
+    int stop;                       // asks flusher to write what is pending and exit
+    pthread_t flusher;
+};
+
+struct journal journal = {0, -1, -1, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, NULL, 0, NULL,
+                          PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                          NULL, 0, 0, NULL, 0, 0, 0, 0, {0, 0}, 0, 0};
+
+__thread int journal_depth = 0; // nesting of journal_begin() in calling thread
+
+unsigned int crc_table[256];
+
+void crc_init()
+{
+    unsigned int value;
+    int counter;
+    int bit;
+
+    for (counter = 0; counter < 256; counter++)
+    {
+        value = counter;
+        for (bit = 0; bit < 8; bit++)
+            value = (value & 1) ? (value >> 1) ^ 0xedb88320u : value >> 1;
+        crc_table[counter] = value;
+    }
+}
+
+// crc32(crc32(0, a), b) is crc of 'a' followed by 'b'
+unsigned int crc32(unsigned int crc, const char *data, long long length)
+{
+    crc = ~crc;
+    while (length-- > 0)
+        crc = crc_table[(crc ^ (unsigned char)*data++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+int write_all(int fd, const char *data, long long length, long long offset)
+{
+    long long written;
+
+    while (length > 0)
+    {
+        written = pwrite(fd, data, length, offset);
+        if (written <= 0)
+        {
+            if (written == -1 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += written;
+        offset += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// empties journal file, everything in it is in image now
+int journal_reset()
+{
+    struct journal_header header;
+
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, JOURNAL_MAGIC);
+    header.version = JOURNAL_VERSION;
+    header.image_size = journal.image_size;
+
+    if (ftruncate(journal.fd, 0) == -1 || write_all(journal.fd, (char *)&header, sizeof(header), 0) == -1 || fdatasync(journal.fd) == -1)
+        return -1;
+
+    journal.journal_size = sizeof(header);
+    return 0;
+}
+
+// applies every complete transaction of journal to image file, stops at first torn or corrupted record
+int journal_replay()
+{
+    struct stat file_info;
+    struct journal_header *header;
+    struct journal_record record;
+    struct journal_range range;
+    unsigned int crc;
+    char *data;
+    char *position;
+    char *end;
+    char *record_end;
+    long long last_lsn = 0;
+    int counter;
+    int replayed = 0;
+
+    if (fstat(journal.fd, &file_info) == -1)
+        return -1;
+    if (file_info.st_size < (long long)sizeof(struct journal_header))
+        return 0; // new journal
+
+    data = (char *)mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, journal.fd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+
+    header = (struct journal_header *)data;
+    if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header->version != JOURNAL_VERSION || header->image_size != journal.image_size)
+    {
+        munmap(data, file_info.st_size);
+        return -2; // journal belongs to another image
+    }
+
+    position = data + sizeof(struct journal_header);
+    end = data + file_info.st_size;
+    while (end - position >= (long long)sizeof(record))
+    {
+        memcpy(&record, position, sizeof(record));
+        if (record.magic != RECORD_MAGIC || record.lsn <= last_lsn || record.length < 0 || record.length > end - position - (long long)sizeof(record))
+            break; // end of journal or torn write
+
+        crc = record.crc;
+        record.crc = 0;
+        if (crc32(crc32(0, (char *)&record, sizeof(record)), position + sizeof(record), record.length) != crc)
+            break;
+        position += sizeof(record);
+        record_end = position + record.length;
+
+        for (counter = 0; counter < record.range_count; counter++)
+        {
+            // journal is mapped as it is on disk, headers are copied out as they need not be aligned
+            if (record_end - position < (long long)sizeof(range))
+                break;
+            memcpy(&range, position, sizeof(range));
+            if (range.offset < 0 || range.length < 0 || range.length > record_end - position - (long long)sizeof(range) ||
+                range.offset + range.length > journal.image_size ||
+                write_all(journal.image_fd, position + sizeof(range), range.length, range.offset) == -1)
+            {
+                munmap(data, file_info.st_size);
+                return -1;
+            }
+            position += sizeof(range) + range.length;
+        }
+        if (counter < record.range_count)
+        {
+            munmap(data, file_info.st_size);
+            return -1;
+        }
+        position = record_end;
+        last_lsn = record.lsn;
+        replayed++;
+    }
+    munmap(data, file_info.st_size);
+
+    if (replayed > 0 && fdatasync(journal.image_fd) == -1)
+        return -1;
+    return replayed;
+}
+
+// opens journal next to image and brings image up to date with it, must be called before image is mapped
+// returns number of replayed transactions, -1: journal can not be used, -2: journal belongs to another image
+int journal_open(const char *journal_path, int image_fd, long long image_size, int commit_latency_ms)
+{
+    int replayed;
+
+    crc_init();
+    journal.fd = open(journal_path, O_RDWR | O_CREAT, 0644);
+    if (journal.fd == -1)
+        return -1;
+
+    journal.image_fd = image_fd;
+    journal.image_size = image_size;
+    journal.commit_latency_ms = commit_latency_ms;
+
+    replayed = journal_replay();
+    if (replayed < 0 || journal_reset() == -1)
+    {
+        close(journal.fd);
+        journal.fd = -1;
+        return replayed < 0 ? replayed : -1;
+    }
+    return replayed;
+}
+
+void *flush_worker(void *argument)
+{
+    char *buffer;
+    long long capacity;
+    long long length;
+    long long lsn;
+    int status;
+    struct timespec deadline;
+
+    (void)argument;
+    pthread_mutex_lock(&(journal.buffer_lock));
+    while (1)
+    {
+        while (!journal.stop && journal.pending_length == 0)
+            pthread_cond_wait(&(journal.committed), &(journal.buffer_lock));
+        if (journal.pending_length == 0)
+            break; // stopped and nothing is left to write
+
+        // waiting for more transactions so that one fdatasync() covers all of them
+        if (journal.commit_latency_ms > 0)
+        {
+            deadline = journal.first_pending;
+            deadline.tv_sec += journal.commit_latency_ms / 1000;
+            deadline.tv_nsec += (journal.commit_latency_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while (!journal.stop && journal.pending_length < JOURNAL_BATCH &&
+                   pthread_cond_timedwait(&(journal.committed), &(journal.buffer_lock), &deadline) != ETIMEDOUT)
+                ;
+        }
+
+        // committers keep filling the other buffer while this one is written
+        buffer = journal.pending;
+        capacity = journal.pending_capacity;
+        length = journal.pending_length;
+        lsn = journal.committed_lsn;
+        journal.pending = journal.writing;
+        journal.pending_capacity = journal.writing_capacity;
+        journal.pending_length = 0;
+        journal.writing = buffer;
+        journal.writing_capacity = capacity;
+        pthread_mutex_unlock(&(journal.buffer_lock));
+
+        status = write_all(journal.fd, buffer, length, journal.journal_size);
+        if (status == 0)
+            status = fdatasync(journal.fd);
+
+        pthread_mutex_lock(&(journal.buffer_lock));
+        journal.journal_size += length;
+        journal.durable_lsn = lsn;
+        if (status != 0)
+            journal.failed = 1;
+        pthread_cond_broadcast(&(journal.flushed));
+    }
+    pthread_mutex_unlock(&(journal.buffer_lock));
+    return NULL;
+}
+
+// starts journaling changes made to mapped image at 'base'
+int journal_start(char *base)
+{
+    journal.base = base;
+    journal.dirty_pages = (unsigned char *)calloc(journal.image_size / BLOCK_SIZE / 8 + 1, 1);
+    if (journal.dirty_pages == NULL)
+        return -1;
+
+    journal.stop = 0;
+    journal.failed = 0;
+    if (pthread_create(&(journal.flusher), NULL, flush_worker, NULL) != 0)
+    {
+        free(journal.dirty_pages);
+        journal.dirty_pages = NULL;
+        return -1;
+    }
+    journal.active = 1;
+    return 0;
+}
+
+void journal_begin()
+{
+    if (journal.active && journal_depth++ == 0)
+        pthread_mutex_lock(&(journal.txn_lock));
+}
+
+// records that 'length' bytes at 'address' in image were changed by current transaction
+void journal_log(const void *address, long long length)
+{
+    long long offset;
+    long long page;
+    int counter;
+    struct journal_range *range;
+
+    if (!journal.active || journal_depth == 0 || length <= 0)
+        return;
+
+    offset = (const char *)address - journal.base;
+    if (offset < 0 || offset + length > journal.image_size)
+        return; // memory outside image (scratch inode of cvfs_compress())
+    for (counter = journal.range_count - 1; counter >= 0 && counter >= journal.range_count - MERGE_WINDOW; counter--)
+    {
+        range = &(journal.ranges[counter]);
+        if (offset >= range->offset && offset + length <= range->offset + range->length)
+            return; // bytes are already part of transaction
+    }
+
+    range = (journal.range_count > 0) ? &(journal.ranges[journal.range_count - 1]) : NULL;
+    if (range != NULL && offset == range->offset + range->length)
+        range->length += length; // continues previous range (sequential write)
+    else
+    {
+        if (journal.range_count == journal.range_capacity)
+        {
+            journal.range_capacity = journal.range_capacity ? journal.range_capacity * 2 : 64;
+            journal.ranges = (struct journal_range *)realloc(journal.ranges, journal.range_capacity * sizeof(struct journal_range));
+        }
+        journal.ranges[journal.range_count].offset = offset;
+        journal.ranges[journal.range_count].length = length;
+        journal.range_count++;
+    }
+
+    for (page = offset / BLOCK_SIZE; page <= (offset + length - 1) / BLOCK_SIZE; page++)
+        journal.dirty_pages[page / 8] |= 1 << (page % 8);
+}
+
+int journal_wait(long long lsn)
+{
+    int failed;
+
+    pthread_mutex_lock(&(journal.buffer_lock));
+    while (journal.durable_lsn < lsn && !journal.failed)
+        pthread_cond_wait(&(journal.flushed), &(journal.buffer_lock));
+    failed = journal.failed;
+    pthread_mutex_unlock(&(journal.buffer_lock));
+
+    return failed ? -1 : 0;
+}
+
+// hands changed bytes of current transaction to flusher, returns its lsn (0 if nothing was changed)
+long long journal_commit()
+{
+    struct journal_record record;
+    struct journal_range *range;
+    long long length = 0;
+    long long position;
+    int counter;
+
+    if (journal.range_count == 0)
+        return 0;
+
+    for (counter = 0; counter < journal.range_count; counter++)
+        length += sizeof(struct journal_range) + journal.ranges[counter].length;
+
+    if ((long long)sizeof(record) + length > journal.staging_capacity)
+    {
+        journal.staging_capacity = sizeof(record) + length;
+        journal.staging = (char *)realloc(journal.staging, journal.staging_capacity);
+    }
+
+    // after images of changed ranges, taken while transaction lock is still held
+    position = sizeof(record);
+    for (counter = 0; counter < journal.range_count; counter++)
+    {
+        range = &(journal.ranges[counter]);
+        memcpy(journal.staging + position, range, sizeof(*range));
+        memcpy(journal.staging + position + sizeof(*range), journal.base + range->offset, range->length);
+        position += sizeof(*range) + range->length;
+    }
+    journal.range_count = 0;
+
+    memset(&record, 0, sizeof(record));
+    record.magic = RECORD_MAGIC;
+    record.lsn = journal.committed_lsn + 1; // committed_lsn only changes under transaction lock
+    record.length = length;
+    record.range_count = counter;
+    record.crc = crc32(crc32(0, (char *)&record, sizeof(record)), journal.staging + sizeof(record), length);
+    memcpy(journal.staging, &record, sizeof(record));
+
+    pthread_mutex_lock(&(journal.buffer_lock));
+    if (journal.pending_length + position > journal.pending_capacity)
+    {
+        journal.pending_capacity = (journal.pending_length + position) * 2;
+        journal.pending = (char *)realloc(journal.pending, journal.pending_capacity);
+    }
+    if (journal.pending_length == 0)
+        clock_gettime(CLOCK_REALTIME, &(journal.first_pending));
+    memcpy(journal.pending + journal.pending_length, journal.staging, position);
+    journal.pending_length += position;
+    journal.committed_lsn = record.lsn;
+    pthread_cond_signal(&(journal.committed));
+    pthread_mutex_unlock(&(journal.buffer_lock));
+
+    return record.lsn;
+}
+
+// ends transaction, returns when its changes are on disk, -1: journal could not be written (changes are not durable)
+int journal_end()
+{
+    long long lsn;
+    long long journal_size;
+
+    if (!journal.active || --journal_depth != 0)
+        return 0;
+
+    lsn = journal_commit();
+    pthread_mutex_unlock(&(journal.txn_lock));
+
+    if (lsn == 0)
+        return 0; // nothing was changed
+    if (journal_wait(lsn) != 0)
+        return -1;
+
+    pthread_mutex_lock(&(journal.buffer_lock));
+    journal_size = journal.journal_size;
+    pthread_mutex_unlock(&(journal.buffer_lock));
+
+    if (journal_size > JOURNAL_LIMIT)
+        journal_checkpoint();
+    return 0;
+}
+
+// writes pages changed since last checkpoint into image and empties journal, -2: image or journal could not be written
+int journal_checkpoint()
+{
+    long long page;
+    long long first;
+    long long pages = journal.image_size / BLOCK_SIZE;
+    int status = 0;
+
+    pthread_mutex_lock(&(journal.txn_lock)); // no transaction runs while image is written
+    pthread_mutex_lock(&(journal.buffer_lock));
+    while (journal.durable_lsn < journal.committed_lsn && !journal.failed)
+        pthread_cond_wait(&(journal.flushed), &(journal.buffer_lock));
+    if (journal.failed)
+        status = -2; // image can only be written after journal, otherwise a crash leaves half of a transaction in image
+    pthread_mutex_unlock(&(journal.buffer_lock));
+
+    for (page = 0; status == 0 && page < pages; page++)
+    {
+        if ((journal.dirty_pages[page / 8] & (1 << (page % 8))) == 0)
+            continue;
+
+        for (first = page; page < pages && (journal.dirty_pages[page / 8] & (1 << (page % 8))); page++)
+            ; // writing run of consecutive dirty pages with one call
+
+        if (write_all(journal.image_fd, journal.base + first * BLOCK_SIZE, (page - first) * BLOCK_SIZE, first * BLOCK_SIZE) == -1)
+            status = -2;
+    }
+
+    if (status == 0 && (fdatasync(journal.image_fd) == -1 || journal_reset() == -1))
+        status = -2;
+    if (status == 0)
+        memset(journal.dirty_pages, 0, pages / 8 + 1);
+
+    pthread_mutex_unlock(&(journal.txn_lock));
+    return status;
+}
+
+// writes everything to image and stops journaling
+int journal_close()
+{
+    int status;
+
+    if (!journal.active)
+        return 0;
+
+    status = journal_checkpoint();
+
+    pthread_mutex_lock(&(journal.buffer_lock));
+    journal.stop = 1;
+    pthread_cond_signal(&(journal.committed));
+    pthread_mutex_unlock(&(journal.buffer_lock));
+    pthread_join(journal.flusher, NULL);
+
+    journal.active = 0;
+    close(journal.fd);
+    journal.fd = -1;
+    free(journal.dirty_pages);
+    journal.dirty_pages = NULL;
+    return status;
+}
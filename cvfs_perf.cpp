@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cvfs_internal.h"
+
+#define PERF_SHARDS 64         // every thread counts in its own shard, shard 0 is shared by threads which found none free
+#define SUB_BUCKET_BITS 4      // every power of 2 of latency is split into 16 buckets (about 6% precision)
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define PERF_BUCKETS 640       // covers latencies up to about 2^43 ticks
+
+#define RELAXED_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+#define RELAXED_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define RELAXED_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+
+// latencies are measured in ticks of time stamp counter where it exists (half the cost of clock_gettime()),
+// ticks are converted to nanoseconds only when counters are read
+#if defined(__x86_64__) || defined(__i386__)
+#define PERF_TICKS() ((long long)__builtin_ia32_rdtsc())
+#else
+#define PERF_TICKS() perf_clock_ns()
+#endif
+
+struct perf_counters
+{
+    long long calls;
+    long long bytes;
+    long long total_ticks;
+    long long errors[CVFS_PERF_ERROR_CODES]; // errors[n] counts calls which returned -n
+    long long histogram[PERF_BUCKETS];       // number of calls per latency bucket (in ticks)
+};
+
+struct alignas(CACHE_LINE) perf_shard
+{
+    int owned; // 1 while a thread counts in this shard
+    struct perf_counters ops[PERF_OPS];
+};
+
+const char *perf_op_names[PERF_OPS] = {"create", "open", "read", "write", "lseek", "truncate", "unlink", "backup", "clone", "grep", "restore"};
+const int perf_op_moves_bytes[PERF_OPS] = {0, 0, 1, 1, 0, 0, 0, 1, 0, 1, 1}; // positive result is number of bytes
+
+struct perf_shard perf_shards[PERF_SHARDS];
+int perf_enabled = 1;
+pthread_key_t perf_shard_key; // gives shard back when its thread exits
+pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+__thread struct perf_shard *perf_thread_shard = NULL; // shard used by calling thread
+
+long long perf_clock_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long perf_epoch_ticks = PERF_TICKS(); // ticks and time at start of program, rate of ticks is measured from them
+long long perf_epoch_ns = perf_clock_ns();
+
+double perf_ns_per_tick()
+{
+    long long ticks = PERF_TICKS() - perf_epoch_ticks;
+    long long ns = perf_clock_ns() - perf_epoch_ns;
+
+    return (ticks > 0 && ns > 0) ? (double)ns / ticks : 1.0;
+}
+
+void perf_release_shard(void *shard)
+{
+    __atomic_store_n(&(((struct perf_shard *)shard)->owned), 0, __ATOMIC_RELEASE); // counts stay, next owner adds to them
+}
+
+void perf_create_key()
+{
+    pthread_key_create(&perf_shard_key, perf_release_shard);
+}
+
+struct perf_shard *perf_claim_shard()
+{
+    int counter;
+    int expected;
+
+    pthread_once(&perf_key_once, perf_create_key);
+    for (counter = 1; counter < PERF_SHARDS; counter++)
+    {
+        expected = 0;
+        if (__atomic_compare_exchange_n(&(perf_shards[counter].owned), &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            pthread_setspecific(perf_shard_key, &perf_shards[counter]);
+            return &perf_shards[counter];
+        }
+    }
+    return &perf_shards[0];
+}
+
+// only the owner writes its shard, so a plain load and store is enough (readers still see whole values)
+void perf_add(long long *counter, long long value, int shared)
+{
+    if (shared)
+        RELAXED_ADD(counter, value);
+    else
+        RELAXED_STORE(counter, RELAXED_LOAD(counter) + value);
+}
+
+long long perf_start()
+{
+    if (!RELAXED_LOAD(&perf_enabled))
+        return 0;
+    return PERF_TICKS();
+}
+
+int perf_bucket(long long value)
+{
+    int exponent;
+    int bucket;
+
+    if (value < SUB_BUCKETS)
+        return value < 0 ? 0 : (int)value;
+
+    exponent = 63 - __builtin_clzll(value); // position of highest bit, at least SUB_BUCKET_BITS
+    bucket = (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + (int)((value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+    return bucket < PERF_BUCKETS ? bucket : PERF_BUCKETS - 1;
+}
+
+// smallest latency which falls into 'bucket'
+double perf_bucket_value(int bucket)
+{
+    int exponent;
+
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    return (double)((long long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS));
+}
+
+long long perf_end(int op, long long start, long long result)
+{
+    int shared;
+    long long elapsed;
+    struct perf_counters *counters;
+
+    if (start == 0)
+        return result; // counting was disabled when call started
+
+    elapsed = PERF_TICKS() - start;
+
+    if (perf_thread_shard == NULL)
+        perf_thread_shard = perf_claim_shard();
+    shared = (perf_thread_shard == &perf_shards[0]);
+    counters = &(perf_thread_shard->ops[op]);
+
+    perf_add(&(counters->calls), 1, shared);
+    perf_add(&(counters->total_ticks), elapsed, shared);
+    perf_add(&(counters->histogram[perf_bucket(elapsed)]), 1, shared);
+    if (result < 0)
+        perf_add(&(counters->errors[(-result < CVFS_PERF_ERROR_CODES) ? -result : CVFS_PERF_ERROR_CODES - 1]), 1, shared);
+    else if (perf_op_moves_bytes[op])
+        perf_add(&(counters->bytes), result, shared);
+
+    return result;
+}
+
+double perf_percentile(long long *histogram, long long calls, double fraction)
+{
+    int bucket;
+    long long seen = 0;
+    long long wanted = (long long)(fraction * calls);
+
+    for (bucket = 0; bucket < PERF_BUCKETS; bucket++)
+    {
+        seen += histogram[bucket];
+        if (seen > wanted)
+            return perf_bucket_value(bucket);
+    }
+    return 0;
+}
+
+int cvfs_perf_snapshot(struct cvfs_perf_op *ops, int max_ops)
+{
+    int op;
+    int shard;
+    int counter;
+    long long histogram[PERF_BUCKETS];
+    long long total_ticks;
+    double ns_per_tick = perf_ns_per_tick();
+    struct perf_counters *counters;
+    struct cvfs_perf_op *out;
+
+    for (op = 0; op < PERF_OPS && op < max_ops; op++)
+    {
+        out = &ops[op];
+        memset(out, 0, sizeof(*out));
+        memset(histogram, 0, sizeof(histogram));
+        total_ticks = 0;
+        out->name = perf_op_names[op];
+
+        for (shard = 0; shard < PERF_SHARDS; shard++)
+        {
+            counters = &(perf_shards[shard].ops[op]);
+            out->calls += RELAXED_LOAD(&(counters->calls));
+            out->bytes += RELAXED_LOAD(&(counters->bytes));
+            total_ticks += RELAXED_LOAD(&(counters->total_ticks));
+            for (counter = 1; counter < CVFS_PERF_ERROR_CODES; counter++)
+                out->errors[counter] += RELAXED_LOAD(&(counters->errors[counter]));
+            for (counter = 0; counter < PERF_BUCKETS; counter++)
+                histogram[counter] += RELAXED_LOAD(&(counters->histogram[counter]));
+        }
+
+        for (counter = 1; counter < CVFS_PERF_ERROR_CODES; counter++)
+            out->error_calls += out->errors[counter];
+        if (out->calls == 0)
+            continue;
+
+        out->mean_ns = (double)total_ticks / out->calls * ns_per_tick;
+        out->p50_ns = perf_percentile(histogram, out->calls, 0.50) * ns_per_tick;
+        out->p90_ns = perf_percentile(histogram, out->calls, 0.90) * ns_per_tick;
+        out->p99_ns = perf_percentile(histogram, out->calls, 0.99) * ns_per_tick;
+        out->p999_ns = perf_percentile(histogram, out->calls, 0.999) * ns_per_tick;
+        for (counter = PERF_BUCKETS - 1; counter > 0 && histogram[counter] == 0; counter--)
+            ;
+        out->max_ns = perf_bucket_value(counter) * ns_per_tick;
+    }
+    return op;
+}
+
+void cvfs_perf_reset(void)
+{
+    int shard;
+
+    for (shard = 0; shard < PERF_SHARDS; shard++)
+        memset(perf_shards[shard].ops, 0, sizeof(perf_shards[shard].ops)); // counts of calls running meanwhile may be lost
+}
+
+void cvfs_perf_enable(int enable)
+{
+    __atomic_store_n(&perf_enabled, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int cvfs_perf_json(const char *path)
+{
+    int op;
+    int counter;
+    int first;
+    FILE *out = stdout;
+    struct cvfs_perf_op ops[PERF_OPS];
+
+    if (path != NULL && (out = fopen(path, "w")) == NULL)
+        return -1;
+
+    cvfs_perf_snapshot(ops, PERF_OPS);
+    fprintf(out, "{\n  \"operations\": [\n");
+    for (op = 0; op < PERF_OPS; op++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"calls\": %lld, \"bytes\": %lld, \"errors\": %lld, \"error_codes\": {",
+                ops[op].name, ops[op].calls, ops[op].bytes, ops[op].error_calls);
+        for (counter = 1, first = 1; counter < CVFS_PERF_ERROR_CODES; counter++)
+        {
+            if (ops[op].errors[counter] == 0)
+                continue;
+            fprintf(out, "%s\"-%d\": %lld", first ? "" : ", ", counter, ops[op].errors[counter]);
+            first = 0;
+        }
+        fprintf(out, "}, \"latency_ns\": {\"mean\": %.0f, \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f}}%s\n",
+                ops[op].mean_ns, ops[op].p50_ns, ops[op].p90_ns, ops[op].p99_ns, ops[op].p999_ns, ops[op].max_ns, op + 1 < PERF_OPS ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    if (path != NULL && fclose(out) != 0)
+        return -1;
+    if (path == NULL)
+        fflush(out);
+    return 0;
+}
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cvfs_internal.h"
+
+// Requests and completions travel through two bounded queues of cells (Vyukov's MPMC queue): a cell carries a
+// sequence number which says whether it may be filled or emptied at a position, so producers and consumers only
+// compete with a compare and swap on their own position and never take a lock. At most 'entries' requests are
+// in flight (submitted and not reaped), so neither queue can be full when something is pushed into it.
+//
+// Threads only sleep when their queue is empty. Sleeper counts are checked after a full fence on both sides,
+// so a push either sees the sleeper and wakes it, or the sleeper sees the pushed cell before it waits.
+
+#define MAX_RING_ENTRIES 65536
+#define MAX_RING_WORKERS 64
+
+struct ring_queue
+{
+    char *cells;            // 'mask + 1' cells, a cell is a sequence number followed by an element
+    long long cell_size;
+    long long element_size;
+    long long mask;
+    alignas(CACHE_LINE) long long tail; // next position to be filled (atomic)
+    alignas(CACHE_LINE) long long head; // next position to be emptied (atomic)
+};
+
+struct cvfs_ring
+{
+    struct ring_queue submissions;
+    struct ring_queue completions;
+    alignas(CACHE_LINE) int in_flight; // requests submitted and not reaped (atomic)
+    int entries;
+    int idle_workers;                  // workers waiting for requests (atomic)
+    int waiting_reapers;               // threads waiting for completions (atomic)
+    int stopping;                      // set by cvfs_ring_destroy(), workers leave once submissions are empty
+    pthread_mutex_t lock;              // sleeping and waking up only, queues do not use it
+    pthread_cond_t work;
+    pthread_cond_t done;
+    int worker_count;
+    pthread_t workers[MAX_RING_WORKERS];
+};
+
+long long *cell_sequence(struct ring_queue *queue, long long position)
+{
+    return (long long *)(queue->cells + (position & queue->mask) * queue->cell_size);
+}
+
+int queue_create(struct ring_queue *queue, int entries, long long element_size)
+{
+    long long position;
+
+    queue->element_size = element_size;
+    queue->cell_size = (sizeof(long long) + element_size + sizeof(long long) - 1) / sizeof(long long) * sizeof(long long);
+    queue->mask = entries - 1;
+    queue->tail = 0;
+    queue->head = 0;
+    if ((queue->cells = (char *)malloc(entries * queue->cell_size)) == NULL)
+        return -1;
+
+    for (position = 0; position < entries; position++)
+        *cell_sequence(queue, position) = position; // cell can be filled at its own position
+    return 0;
+}
+
+// caller made sure queue is not full (see in_flight)
+void queue_push(struct ring_queue *queue, const void *element)
+{
+    long long position = ATOMIC_LOAD(&(queue->tail));
+    long long *sequence;
+
+    while (1)
+    {
+        sequence = cell_sequence(queue, position);
+        if (ATOMIC_LOAD(sequence) == position)
+        {
+            if (ATOMIC_CAS(&(queue->tail), &position, position + 1))
+                break; // cell is ours
+        }
+        else
+            position = ATOMIC_LOAD(&(queue->tail)); // another producer took it first
+    }
+
+    memcpy(sequence + 1, element, queue->element_size);
+    ATOMIC_STORE(sequence, position + 1); // cell can be emptied now
+}
+
+// returns 0 if queue is empty
+int queue_pop(struct ring_queue *queue, void *element)
+{
+    long long position = ATOMIC_LOAD(&(queue->head));
+    long long *sequence;
+    long long difference;
+
+    while (1)
+    {
+        sequence = cell_sequence(queue, position);
+        difference = ATOMIC_LOAD(sequence) - (position + 1);
+        if (difference < 0)
+            return 0; // cell at head was not filled yet
+        if (difference == 0 && ATOMIC_CAS(&(queue->head), &position, position + 1))
+            break;
+        if (difference > 0)
+            position = ATOMIC_LOAD(&(queue->head)); // another consumer emptied it first
+    }
+
+    memcpy(element, sequence + 1, queue->element_size);
+    ATOMIC_STORE(sequence, position + queue->mask + 1); // cell can be filled again one lap later
+    return 1;
+}
+
+int queue_empty(struct ring_queue *queue)
+{
+    long long position = ATOMIC_LOAD(&(queue->head));
+
+    return ATOMIC_LOAD(cell_sequence(queue, position)) != position + 1;
+}
+
+long long run_ring_request(struct cvfs_ring_request *request)
+{
+    int status;
+    struct cvfs_stat stat_buf;
+
+    if (request->op == CVFS_RING_READ)
+        return cvfs_pread(request->fd, request->buffer, request->count, request->offset);
+    if (request->op == CVFS_RING_WRITE)
+        return cvfs_pwrite(request->fd, request->buffer, request->count, request->offset);
+    if (request->op == CVFS_RING_STAT)
+        return cvfs_fstat(request->fd, (struct cvfs_stat *)request->buffer);
+
+    if (cvfs_fstat(request->fd, &stat_buf) != 0)
+        return -1; // descriptor is not opened
+    status = cvfs_checkpoint();
+    return (status == -1) ? 0 : status; // file system only in memory has nothing to write
+}
+
+// 'sleepers' is counter of threads waiting on 'condition', called after something was pushed
+void wake(struct cvfs_ring *ring, int *sleepers, pthread_cond_t *condition)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleepers, __ATOMIC_SEQ_CST) == 0)
+        return;
+
+    pthread_mutex_lock(&(ring->lock));
+    pthread_cond_broadcast(condition);
+    pthread_mutex_unlock(&(ring->lock));
+}
+
+void *ring_worker(void *argument)
+{
+    struct cvfs_ring *ring = (struct cvfs_ring *)argument;
+    struct cvfs_ring_request request;
+    struct cvfs_ring_completion completion;
+
+    while (1)
+    {
+        if (queue_pop(&(ring->submissions), &request))
+        {
+            completion.result = run_ring_request(&request);
+            completion.user_data = request.user_data;
+            queue_push(&(ring->completions), &completion);
+            wake(ring, &(ring->waiting_reapers), &(ring->done));
+            continue;
+        }
+
+        pthread_mutex_lock(&(ring->lock));
+        __atomic_add_fetch(&(ring->idle_workers), 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while (queue_empty(&(ring->submissions)) && !ring->stopping)
+            pthread_cond_wait(&(ring->work), &(ring->lock));
+        __atomic_add_fetch(&(ring->idle_workers), -1, __ATOMIC_SEQ_CST);
+
+        if (ring->stopping && queue_empty(&(ring->submissions)))
+        {
+            pthread_mutex_unlock(&(ring->lock));
+            break;
+        }
+        pthread_mutex_unlock(&(ring->lock));
+    }
+    return NULL;
+}
+
+struct cvfs_ring *cvfs_ring_create(int entries, int workers)
+{
+    struct cvfs_ring *ring;
+
+    if (entries < 1 || entries > MAX_RING_ENTRIES || (entries & (entries - 1)) != 0 || workers < 1 || workers > MAX_RING_WORKERS)
+        return NULL;
+    if ((ring = (struct cvfs_ring *)aligned_alloc(CACHE_LINE, sizeof(struct cvfs_ring))) == NULL)
+        return NULL;
+
+    memset(ring, 0, sizeof(*ring));
+    if (queue_create(&(ring->submissions), entries, sizeof(struct cvfs_ring_request)) != 0 ||
+        queue_create(&(ring->completions), entries, sizeof(struct cvfs_ring_completion)) != 0)
+    {
+        free(ring->submissions.cells);
+        free(ring->completions.cells);
+        free(ring);
+        return NULL;
+    }
+    ring->entries = entries;
+    pthread_mutex_init(&(ring->lock), NULL);
+    pthread_cond_init(&(ring->work), NULL);
+    pthread_cond_init(&(ring->done), NULL);
+
+    for (ring->worker_count = 0; ring->worker_count < workers; ring->worker_count++)
+    {
+        if (pthread_create(&(ring->workers[ring->worker_count]), NULL, ring_worker, ring) != 0)
+            break;
+    }
+    if (ring->worker_count == 0)
+    {
+        cvfs_ring_destroy(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+int cvfs_ring_submit(struct cvfs_ring *ring, const struct cvfs_ring_request *requests, int count)
+{
+    int counter;
+    int in_flight;
+    int accepted;
+
+    if (ring == NULL || requests == NULL || count < 0)
+        return -1;
+    for (counter = 0; counter < count; counter++)
+    {
+        if (requests[counter].op < CVFS_RING_READ || requests[counter].op > CVFS_RING_STAT)
+            return -1;
+    }
+
+    // room is reserved first, so every request which is pushed has a cell in both queues
+    in_flight = ATOMIC_LOAD(&(ring->in_flight));
+    do
+    {
+        accepted = (count < ring->entries - in_flight) ? count : ring->entries - in_flight;
+    } while (accepted > 0 && !ATOMIC_CAS(&(ring->in_flight), &in_flight, in_flight + accepted));
+
+    for (counter = 0; counter < accepted; counter++)
+        queue_push(&(ring->submissions), &requests[counter]);
+    if (accepted > 0)
+        wake(ring, &(ring->idle_workers), &(ring->work));
+    return accepted;
+}
+
+int cvfs_ring_reap(struct cvfs_ring *ring, struct cvfs_ring_completion *completions, int count, int wait_for)
+{
+    int reaped = 0;
+
+    if (ring == NULL || completions == NULL || count < 0)
+        return -1;
+    if (wait_for > count)
+        wait_for = count;
+
+    while (1)
+    {
+        while (reaped < count && queue_pop(&(ring->completions), &completions[reaped]))
+        {
+            if (ATOMIC_ADD(&(ring->in_flight), -1) == 0)
+                wake(ring, &(ring->waiting_reapers), &(ring->done)); // another reaper may wait for nothing now
+            reaped++;
+        }
+        if (reaped >= wait_for || ATOMIC_LOAD(&(ring->in_flight)) == 0)
+            return reaped; // enough completions, or nothing more will complete
+
+        pthread_mutex_lock(&(ring->lock));
+        __atomic_add_fetch(&(ring->waiting_reapers), 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (queue_empty(&(ring->completions)) && ATOMIC_LOAD(&(ring->in_flight)) != 0)
+            pthread_cond_wait(&(ring->done), &(ring->lock));
+        __atomic_add_fetch(&(ring->waiting_reapers), -1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&(ring->lock));
+    }
+}
+
+void cvfs_ring_destroy(struct cvfs_ring *ring)
+{
+    int counter;
+
+    if (ring == NULL)
+        return;
+
+    pthread_mutex_lock(&(ring->lock));
+    ring->stopping = 1;
+    pthread_cond_broadcast(&(ring->work));
+    pthread_mutex_unlock(&(ring->lock));
+
+    for (counter = 0; counter < ring->worker_count; counter++)
+        pthread_join(ring->workers[counter], NULL);
+
+    pthread_mutex_destroy(&(ring->lock));
+    pthread_cond_destroy(&(ring->work));
+    pthread_cond_destroy(&(ring->done));
+    free(ring->submissions.cells);
+    free(ring->completions.cells);
+    free(ring);
+}
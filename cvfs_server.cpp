@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "cvfs_internal.h"
+#include "cvfs_client.h"
+
+// One thread serves every connection: sockets are non-blocking and an epoll loop reads whatever requests arrived,
+// runs them one after another and queues their responses, so a client sending many requests at once gets them
+// answered with few system calls. Calls of file system take microseconds, a thread per connection would cost more
+// in switches than it gains.
+
+#define SERVER_EVENTS 64
+#define SERVER_READ_SIZE (256 * 1024)                  // most bytes read from a connection per wakeup
+#define SERVER_OUTPUT_LIMIT (2LL * CVFS_WIRE_MAX_DATA) // a connection is not read while this many bytes of responses wait
+
+struct connection
+{
+    int socket;
+    int events;                // events epoll waits for
+    char *input;               // requests received and not run yet
+    long long input_length;
+    long long input_capacity;
+    char *output;              // responses not sent yet, from output_start to output_length
+    long long output_start;
+    long long output_length;
+    long long output_capacity;
+    int *files;                // descriptors opened by this connection
+    int file_count;
+    int file_capacity;
+    struct connection *next;   // list of open connections
+    struct connection *previous;
+};
+
+int server_stop_pipe[2] = {-1, -1}; // cvfs_server_stop() writes a byte to wake up event loop
+struct connection *connections = NULL;
+
+// grows 'buffer' to hold at least 'needed' bytes, -1 if memory allocation failed
+int reserve_buffer(char **buffer, long long *capacity, long long needed)
+{
+    long long size = (*capacity > 0) ? *capacity : 4096;
+    char *grown;
+
+    if (needed <= *capacity)
+        return 0;
+    while (size < needed)
+        size *= 2;
+    if ((grown = (char *)realloc(*buffer, size)) == NULL)
+        return -1;
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+int owns_file(struct connection *connection_ptr, int fd)
+{
+    int counter;
+
+    for (counter = 0; counter < connection_ptr->file_count; counter++)
+    {
+        if (connection_ptr->files[counter] == fd)
+            return 1;
+    }
+    return 0;
+}
+
+// descriptor is closed again if it can not be remembered, returns 'fd' or -4 (no free file descriptor)
+int add_file(struct connection *connection_ptr, int fd)
+{
+    int *grown;
+
+    if (connection_ptr->file_count == connection_ptr->file_capacity)
+    {
+        grown = (int *)realloc(connection_ptr->files, (connection_ptr->file_capacity * 2 + 4) * sizeof(int));
+        if (grown == NULL)
+        {
+            cvfs_close(fd);
+            return -4;
+        }
+        connection_ptr->files = grown;
+        connection_ptr->file_capacity = connection_ptr->file_capacity * 2 + 4;
+    }
+    connection_ptr->files[connection_ptr->file_count++] = fd;
+    return fd;
+}
+
+void remove_file(struct connection *connection_ptr, int fd)
+{
+    int counter;
+
+    for (counter = 0; counter < connection_ptr->file_count; counter++)
+    {
+        if (connection_ptr->files[counter] == fd)
+        {
+            connection_ptr->files[counter] = connection_ptr->files[--connection_ptr->file_count];
+            return;
+        }
+    }
+}
+
+// room for a response with 'length' bytes of data, returns where data goes (NULL if memory allocation failed)
+char *response_data(struct connection *connection_ptr, long long length)
+{
+    if (connection_ptr->output_start == connection_ptr->output_length)
+        connection_ptr->output_start = connection_ptr->output_length = 0; // everything was sent
+    else if (connection_ptr->output_start > connection_ptr->output_capacity / 2)
+    {
+        memmove(connection_ptr->output, connection_ptr->output + connection_ptr->output_start,
+                connection_ptr->output_length - connection_ptr->output_start);
+        connection_ptr->output_length -= connection_ptr->output_start;
+        connection_ptr->output_start = 0;
+    }
+    if (reserve_buffer(&(connection_ptr->output), &(connection_ptr->output_capacity),
+                connection_ptr->output_length + (long long)sizeof(struct cvfs_response) + length) != 0)
+        return NULL;
+    return connection_ptr->output + connection_ptr->output_length + sizeof(struct cvfs_response);
+}
+
+// queues response whose data was put where response_data() pointed
+void queue_response(struct connection *connection_ptr, long long result, int length)
+{
+    struct cvfs_response response;
+
+    memset(&response, 0, sizeof(response));
+    response.result = result;
+    response.length = length;
+    memcpy(connection_ptr->output + connection_ptr->output_length, &response, sizeof(response));
+    connection_ptr->output_length += sizeof(response) + length;
+}
+
+// runs one request, -1 if request is malformed or memory allocation failed (connection is closed)
+int run_request(struct connection *connection_ptr, struct cvfs_request *request, const char *payload)
+{
+    int op = request->op;
+    int length = 0;
+    long long count;
+    long long result;
+    char name[MAX_PATH_LENGTH];
+    char *data;
+    struct cvfs_stat stat_buf; // response data has no alignment, stat is copied there
+
+    if (op == CVFS_OP_CREATE || op == CVFS_OP_OPEN || op == CVFS_OP_STAT || op == CVFS_OP_UNLINK || op == CVFS_OP_TRUNCATE)
+    {
+        memcpy(name, payload, (request->length < MAX_PATH_LENGTH) ? request->length : 0);
+        name[(request->length < MAX_PATH_LENGTH) ? request->length : 0] = '\0'; // a path which is too long names no file
+    }
+    else if (op < CVFS_OP_CREATE || op > CVFS_OP_TRUNCATE)
+        return -1; // unknown operation
+
+    count = (op == CVFS_OP_READ) ? request->offset : request->count;
+    if (count < 0)
+        count = 0; // nothing to read
+    if (count > CVFS_WIRE_MAX_DATA)
+        count = CVFS_WIRE_MAX_DATA; // longer reads are short
+    if (op != CVFS_OP_READ && op != CVFS_OP_PREAD)
+        count = (op == CVFS_OP_STAT || op == CVFS_OP_FSTAT) ? sizeof(struct cvfs_stat) : 0;
+    if ((data = response_data(connection_ptr, count)) == NULL)
+        return -1;
+
+    if (op == CVFS_OP_CREATE)
+        result = cvfs_create(name, request->argument);
+    else if (op == CVFS_OP_OPEN)
+        result = cvfs_open(name, request->argument);
+    else if (op == CVFS_OP_STAT)
+        result = cvfs_stat(name, &stat_buf);
+    else if (op == CVFS_OP_UNLINK)
+        result = cvfs_unlink(name);
+    else if (op == CVFS_OP_TRUNCATE)
+        result = cvfs_truncate(name, request->offset);
+    else if (!owns_file(connection_ptr, request->fd))
+        result = -1; // file is not opened (by this connection)
+    else if (op == CVFS_OP_CLOSE)
+    {
+        result = cvfs_close(request->fd);
+        remove_file(connection_ptr, request->fd);
+    }
+    else if (op == CVFS_OP_READ)
+        result = cvfs_read(request->fd, data, count);
+    else if (op == CVFS_OP_PREAD)
+        result = cvfs_pread(request->fd, data, count, request->offset);
+    else if (op == CVFS_OP_WRITE)
+        result = cvfs_write(request->fd, payload, request->length);
+    else if (op == CVFS_OP_PWRITE)
+        result = cvfs_pwrite(request->fd, payload, request->length, request->offset);
+    else if (op == CVFS_OP_LSEEK)
+        result = cvfs_lseek(request->fd, request->offset, request->argument);
+    else
+        result = cvfs_fstat(request->fd, &stat_buf);
+
+    if ((op == CVFS_OP_CREATE || op == CVFS_OP_OPEN) && result >= 0)
+        result = add_file(connection_ptr, (int)result);
+    if ((op == CVFS_OP_READ || op == CVFS_OP_PREAD) && result > 0)
+        length = (int)result;
+    if ((op == CVFS_OP_STAT || op == CVFS_OP_FSTAT) && result == 0)
+    {
+        memcpy(data, &stat_buf, sizeof(stat_buf));
+        length = sizeof(stat_buf);
+    }
+
+    queue_response(connection_ptr, result, length);
+    return 0;
+}
+
+// runs every complete request received, -1 if connection has to be closed
+int run_requests(struct connection *connection_ptr)
+{
+    long long position = 0;
+    struct cvfs_request request;
+
+    while (connection_ptr->input_length - position >= (long long)sizeof(request) &&
+           connection_ptr->output_length - connection_ptr->output_start < SERVER_OUTPUT_LIMIT)
+    {
+        memcpy(&request, connection_ptr->input + position, sizeof(request));
+        if (request.length < 0 || request.length > CVFS_WIRE_MAX_DATA)
+            return -1;
+        if (connection_ptr->input_length - position < (long long)sizeof(request) + request.length)
+            break; // rest of request has not arrived yet
+
+        if (run_request(connection_ptr, &request, connection_ptr->input + position + sizeof(request)) != 0)
+            return -1;
+        position += sizeof(request) + request.length;
+    }
+
+    memmove(connection_ptr->input, connection_ptr->input + position, connection_ptr->input_length - position);
+    connection_ptr->input_length -= position;
+    return 0;
+}
+
+// -1 if connection was closed by client or failed
+int receive_requests(struct connection *connection_ptr)
+{
+    long long received;
+
+    if (reserve_buffer(&(connection_ptr->input), &(connection_ptr->input_capacity), connection_ptr->input_length + SERVER_READ_SIZE) != 0)
+        return -1;
+
+    received = read(connection_ptr->socket, connection_ptr->input + connection_ptr->input_length, SERVER_READ_SIZE);
+    if (received == 0 || (received == -1 && errno != EAGAIN && errno != EINTR))
+        return -1;
+    if (received > 0)
+        connection_ptr->input_length += received;
+    return run_requests(connection_ptr);
+}
+
+// -1 if connection failed
+int send_responses(struct connection *connection_ptr)
+{
+    long long sent;
+
+    while (connection_ptr->output_start < connection_ptr->output_length)
+    {
+        sent = send(connection_ptr->socket, connection_ptr->output + connection_ptr->output_start,
+                    connection_ptr->output_length - connection_ptr->output_start, MSG_NOSIGNAL);
+        if (sent == -1)
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        connection_ptr->output_start += sent;
+    }
+    return 0;
+}
+
+void close_connection(int epoll_fd, struct connection *connection_ptr)
+{
+    int counter;
+
+    for (counter = 0; counter < connection_ptr->file_count; counter++)
+        cvfs_close(connection_ptr->files[counter]);
+    if (connection_ptr->previous != NULL)
+        connection_ptr->previous->next = connection_ptr->next;
+    else
+        connections = connection_ptr->next;
+    if (connection_ptr->next != NULL)
+        connection_ptr->next->previous = connection_ptr->previous;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection_ptr->socket, NULL);
+    close(connection_ptr->socket);
+    free(connection_ptr->input);
+    free(connection_ptr->output);
+    free(connection_ptr->files);
+    free(connection_ptr);
+}
+
+// waits for requests while responses can be queued and for room in socket while responses wait
+void update_events(int epoll_fd, struct connection *connection_ptr)
+{
+    int events = 0;
+    struct epoll_event event;
+
+    if (connection_ptr->output_length - connection_ptr->output_start < SERVER_OUTPUT_LIMIT)
+        events |= EPOLLIN;
+    if (connection_ptr->output_start < connection_ptr->output_length)
+        events |= EPOLLOUT;
+    if (events == connection_ptr->events)
+        return;
+
+    event.events = events;
+    event.data.ptr = connection_ptr;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection_ptr->socket, &event);
+    connection_ptr->events = events;
+}
+
+void accept_connections(int epoll_fd, int listen_fd)
+{
+    int socket_fd;
+    struct connection *connection_ptr;
+    struct epoll_event event;
+
+    while ((socket_fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        connection_ptr = (struct connection *)calloc(1, sizeof(struct connection));
+        if (connection_ptr == NULL)
+        {
+            close(socket_fd);
+            continue;
+        }
+        connection_ptr->socket = socket_fd;
+        connection_ptr->events = EPOLLIN;
+        event.events = EPOLLIN;
+        event.data.ptr = connection_ptr;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) == -1)
+        {
+            close(socket_fd);
+            free(connection_ptr);
+            continue;
+        }
+        connection_ptr->next = connections;
+        if (connections != NULL)
+            connections->previous = connection_ptr;
+        connections = connection_ptr;
+    }
+}
+
+int listen_on(const char *socket_path)
+{
+    int listen_fd;
+    struct sockaddr_un address;
+
+    if (socket_path == NULL || strlen(socket_path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    unlink(socket_path); // socket left behind by a server which did not stop cleanly
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1)
+        return -1;
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(listen_fd, SOMAXCONN) == -1)
+    {
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+int cvfs_serve(const char *socket_path)
+{
+    int counter;
+    int ready;
+    int running = 1;
+    int listen_fd;
+    int epoll_fd;
+    char byte;
+    struct epoll_event event;
+    struct epoll_event events[SERVER_EVENTS];
+    struct connection *connection_ptr;
+
+    if ((listen_fd = listen_on(socket_path)) == -1)
+        return -1; // socket can not be created
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1 || pipe2(server_stop_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+    {
+        if (epoll_fd != -1)
+            close(epoll_fd);
+        close(listen_fd);
+        unlink(socket_path);
+        return -2;
+    }
+
+    // listening socket and stop pipe are told apart from connections by their data
+    event.events = EPOLLIN;
+    event.data.ptr = &listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = server_stop_pipe;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_stop_pipe[0], &event);
+
+    while (running)
+    {
+        ready = epoll_wait(epoll_fd, events, SERVER_EVENTS, -1);
+        for (counter = 0; counter < ready; counter++)
+        {
+            if (events[counter].data.ptr == &listen_fd)
+            {
+                accept_connections(epoll_fd, listen_fd);
+                continue;
+            }
+            if (events[counter].data.ptr == server_stop_pipe)
+            {
+                running = 0;
+                continue;
+            }
+
+            connection_ptr = (struct connection *)events[counter].data.ptr;
+            if (((events[counter].events & EPOLLOUT) && send_responses(connection_ptr) != 0) ||
+                ((events[counter].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && receive_requests(connection_ptr) != 0) ||
+                run_requests(connection_ptr) != 0 || send_responses(connection_ptr) != 0)
+            {
+                close_connection(epoll_fd, connection_ptr);
+                continue;
+            }
+            update_events(epoll_fd, connection_ptr);
+        }
+    }
+
+    // connections which are still open are closed with their descriptors, data stays in file system
+    while (connections != NULL)
+        close_connection(epoll_fd, connections);
+    while (read(server_stop_pipe[0], &byte, 1) == 1)
+        ;
+    close(server_stop_pipe[0]);
+    close(server_stop_pipe[1]);
+    server_stop_pipe[0] = server_stop_pipe[1] = -1;
+    close(epoll_fd);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
+
+void cvfs_server_stop(void)
+{
+    char byte = 0;
+    int fd = server_stop_pipe[1];
+
+    if (fd != -1 && write(fd, &byte, 1) == -1)
+        return; // pipe is full, a stop is already pending
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "cvfs_internal.h"
+
+// Block pool of a file system kept in memory. Without a memory budget it is anonymous memory. With a budget it is
+// a shared mapping of a backing file on host, and blocks beyond the budget are evicted in order of a CLOCK hand:
+// a block referenced since the hand last passed it gets another round, others are written to backing file and
+// dropped from memory. Kernel pages an evicted block back in from backing file when it is touched again, so data
+// is never lost, even when a block is evicted while another thread still uses it (it is then only paged back).
+// Eviction makes room for some more blocks than the one brought in, and writes its victims back in one pass after
+// CLOCK hand is let go, so a miss seldom pays for eviction and other misses do not wait for its disk writes.
+//
+// Only accesses through block_address() are counted: data of a view (cvfs_view_open()) is read through pointers
+// the view holds, so it neither counts as hit or miss nor marks its blocks referenced (they are paged back when
+// evicted meanwhile).
+//
+// Released blocks give their memory back (and their space in backing file), so deleted files do not keep it.
+
+#define TIER_RESIDENT 1   // block is in memory as far as budget is concerned
+#define TIER_REFERENCED 2 // block was touched since CLOCK hand last passed it
+#define TIER_BATCH 64     // most blocks written back by one pass of tier_evict()
+#define TIER_SHARDS 16    // hits and misses are counted per thread in one of these (more threads share them)
+
+struct tier
+{
+    long long budget;          // bytes given to cvfs_set_memory_budget() (0 if there is no budget)
+    char backing_path[MAX_PATH_LENGTH];
+    int fd;                    // backing file (-1 if pool is anonymous memory)
+    char *pool;                // pool made by tier_create_pool(), NULL if block pool belongs to an image
+    long long page_size;
+    long long budget_blocks;   // most blocks resident at once
+    long long resident_blocks; // (atomic)
+    long long hand;            // next block looked at by CLOCK hand (changed with lock)
+    long long evictions;       // (atomic)
+    pthread_mutex_t lock;      // one thread picks victims at a time
+};
+
+// every block access counts, so a counter shared by all threads would bounce between their caches
+struct alignas(CACHE_LINE) tier_counters
+{
+    long long hits;   // (atomic, a shard can be shared)
+    long long misses; // (atomic)
+};
+
+struct tier tier = {0, "", -1, NULL, 4096, 0, 0, 1, 0, PTHREAD_MUTEX_INITIALIZER};
+unsigned char *tier_state = NULL; // TIER_* bits of every block, NULL if there is no budget
+struct tier_counters tier_counters[TIER_SHARDS];
+unsigned int tier_threads = 0;                            // threads which counted so far
+__thread struct tier_counters *tier_thread_counters = NULL; // shard of calling thread
+
+int cvfs_set_memory_budget(long long budget_bytes, const char *backing_path)
+{
+    if (inode_table != NULL)
+        return -1; // file system is already initialized or mounted
+    if (budget_bytes < 0 || (budget_bytes > 0 && (backing_path == NULL || backing_path[0] == '\0' || strlen(backing_path) >= MAX_PATH_LENGTH)))
+        return -2;
+
+    tier.budget = budget_bytes;
+    if (budget_bytes > 0)
+        strcpy(tier.backing_path, backing_path);
+    return 0;
+}
+
+// returns NULL if memory or backing file can not be had
+char *tier_create_pool()
+{
+    long long size = (long long)MAX_BLOCKS * BLOCK_SIZE;
+    char *pool;
+
+    tier.page_size = sysconf(_SC_PAGESIZE);
+    if (tier.budget == 0)
+    {
+        pool = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return (pool == MAP_FAILED) ? NULL : (tier.pool = pool);
+    }
+
+    // backing file is removed at once, its space goes back to host when process exits
+    if ((tier.fd = open(tier.backing_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1)
+        return NULL;
+    unlink(tier.backing_path);
+    tier_state = (unsigned char *)calloc(MAX_BLOCKS, 1);
+    pool = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, tier.fd, 0);
+    if (tier_state == NULL || ftruncate(tier.fd, size) != 0 || pool == MAP_FAILED)
+    {
+        if (pool != MAP_FAILED)
+            munmap(pool, size);
+        free(tier_state);
+        tier_state = NULL;
+        close(tier.fd);
+        tier.fd = -1;
+        return NULL;
+    }
+
+    madvise(pool, size, MADV_RANDOM); // a miss brings in its block only, no neighbours around it
+    tier.budget_blocks = (tier.budget >> BLOCK_SHIFT > 0) ? tier.budget >> BLOCK_SHIFT : 1;
+    return (tier.pool = pool);
+}
+
+// a block smaller than a page takes its whole page along, neighbours are paged back in when they are touched
+void block_pages(long long first_block, long long block_count, long long *start, long long *length)
+{
+    long long end = ((first_block + block_count) << BLOCK_SHIFT) + tier.page_size - 1;
+
+    *start = (first_block << BLOCK_SHIFT) & ~(tier.page_size - 1);
+    *length = (end & ~(tier.page_size - 1)) - *start;
+}
+
+// victims follow CLOCK hand, so neighbouring victims are handled as one run (kernel drops cached pages only when
+// it gets their whole folio). Writing of every run is started before the first is waited for, data is in backing
+// file before memory is given back (kernel can only drop clean pages)
+void evict_blocks(long long *victims, int count)
+{
+    long long runs[TIER_BATCH][2]; // first block and number of blocks
+    long long start;
+    long long length;
+    int run_count = 0;
+    int counter;
+
+    for (counter = 0; counter < count; counter++)
+    {
+        if (run_count > 0 && victims[counter] == runs[run_count - 1][0] + runs[run_count - 1][1])
+            runs[run_count - 1][1]++;
+        else
+        {
+            runs[run_count][0] = victims[counter];
+            runs[run_count][1] = 1;
+            run_count++;
+        }
+    }
+
+    for (counter = 0; counter < run_count; counter++)
+    {
+        block_pages(runs[counter][0], runs[counter][1], &start, &length);
+        sync_file_range(tier.fd, start, length, SYNC_FILE_RANGE_WRITE);
+    }
+    for (counter = 0; counter < run_count; counter++)
+    {
+        block_pages(runs[counter][0], runs[counter][1], &start, &length);
+        sync_file_range(tier.fd, start, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        madvise(tier.pool + start, length, MADV_DONTNEED);
+        posix_fadvise(tier.fd, start, length, POSIX_FADV_DONTNEED);
+    }
+}
+
+void tier_evict()
+{
+    long long victims[TIER_BATCH];
+    long long low_mark = tier.budget_blocks - tier.budget_blocks / 32; // room for a few more misses is made at once
+    int count;
+    unsigned char state;
+
+    do
+    {
+        count = 0;
+        pthread_mutex_lock(&(tier.lock));
+        while (count < TIER_BATCH && ATOMIC_LOAD(&(tier.resident_blocks)) > low_mark)
+        {
+            state = ATOMIC_LOAD(&tier_state[tier.hand]);
+            if (state == (TIER_RESIDENT | TIER_REFERENCED))
+                ATOMIC_STORE(&tier_state[tier.hand], (unsigned char)TIER_RESIDENT); // second chance
+            else if (state == TIER_RESIDENT && ATOMIC_CAS(&tier_state[tier.hand], &state, (unsigned char)0))
+            {
+                victims[count++] = tier.hand;
+                ATOMIC_ADD(&(tier.resident_blocks), -1);
+            }
+            tier.hand = (tier.hand + 1 < MAX_BLOCKS) ? tier.hand + 1 : 1; // block 0 is never used
+        }
+        pthread_mutex_unlock(&(tier.lock));
+
+        evict_blocks(victims, count); // a victim touched again meanwhile is only paged back
+        ATOMIC_ADD(&(tier.evictions), count);
+    } while (count == TIER_BATCH);
+}
+
+struct tier_counters *tier_counters_of_thread()
+{
+    if (tier_thread_counters == NULL)
+        tier_thread_counters = &tier_counters[ATOMIC_ADD(&tier_threads, 1) % TIER_SHARDS];
+    return tier_thread_counters;
+}
+
+// called by block_address() for every access of a block while there is a budget
+void tier_access(int block)
+{
+    struct tier_counters *counters = tier_counters_of_thread();
+    unsigned char state = ATOMIC_LOAD(&tier_state[block]);
+
+    if (state & TIER_RESIDENT)
+    {
+        ATOMIC_ADD(&(counters->hits), 1);
+        if ((state & TIER_REFERENCED) == 0)
+            ATOMIC_STORE(&tier_state[block], (unsigned char)(TIER_RESIDENT | TIER_REFERENCED));
+        return;
+    }
+    if (!ATOMIC_CAS(&tier_state[block], &state, (unsigned char)(TIER_RESIDENT | TIER_REFERENCED)))
+    {
+        ATOMIC_ADD(&(counters->hits), 1); // another thread brought it in first
+        return;
+    }
+
+    ATOMIC_ADD(&(counters->misses), 1);
+    if (ATOMIC_ADD(&(tier.resident_blocks), 1) > tier.budget_blocks)
+        tier_evict();
+}
+
+// 1 if tier_release() clears blocks, reused blocks then need not be cleared by alloc_block()
+int tier_clears_released()
+{
+    if (tier.pool == NULL || block_pool != tier.pool)
+        return 0; // pool belongs to an image or a shared memory segment
+    return tier.fd != -1 || BLOCK_SIZE >= tier.page_size; // a smaller block shares its page with other blocks
+}
+
+// gives memory of a released block back, called before block is put on free block stack
+void tier_release(int block)
+{
+    long long offset = (long long)block << BLOCK_SHIFT;
+    unsigned char state;
+
+    if (!tier_clears_released())
+        return;
+
+    if (tier.fd == -1)
+    {
+        if (madvise(tier.pool + offset, BLOCK_SIZE, MADV_DONTNEED) != 0)
+            memset(tier.pool + offset, 0, BLOCK_SIZE);
+        return;
+    }
+
+    state = ATOMIC_LOAD(&tier_state[block]);
+    while ((state & TIER_RESIDENT) && !ATOMIC_CAS(&tier_state[block], &state, (unsigned char)0))
+        ;
+    if (state & TIER_RESIDENT)
+        ATOMIC_ADD(&(tier.resident_blocks), -1);
+    if (fallocate(tier.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, BLOCK_SIZE) != 0)
+        memset(tier.pool + offset, 0, BLOCK_SIZE); // file system of backing file can not punch holes
+}
+
+void tier_statfs(struct cvfs_statfs *statfs_buf)
+{
+    int shard;
+
+    statfs_buf->budget_blocks = tier.budget_blocks;
+    statfs_buf->resident_blocks = (tier_state != NULL) ? ATOMIC_LOAD(&(tier.resident_blocks)) : statfs_buf->total_blocks - statfs_buf->free_blocks;
+    statfs_buf->block_hits = 0;
+    statfs_buf->block_misses = 0;
+    for (shard = 0; shard < TIER_SHARDS; shard++)
+    {
+        statfs_buf->block_hits += ATOMIC_LOAD(&(tier_counters[shard].hits));
+        statfs_buf->block_misses += ATOMIC_LOAD(&(tier_counters[shard].misses));
+    }
+    statfs_buf->evicted_blocks = ATOMIC_LOAD(&(tier.evictions));
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cvfs_internal.h"
+
+// A view pins the data blocks it points into: every block gets one more share, as if a clone of the file held it.
+// Writes to a shared block give the file a copy (see get_file_block()) and truncate or unlink only drop a share,
+// so bytes of a view never change and its blocks are released when the view is closed. Holes point at block 0,
+// which is never handed out and stays zero filled. Compressed data is not kept as plain bytes, it is copied.
+
+// 'block' is pinned (0 is a hole), caller holds read lock of inode
+void pin_block(struct cvfs_view *view, int block)
+{
+    if (block == 0)
+        return;
+    ATOMIC_ADD(&block_shares[block], 1);
+    ATOMIC_ADD(shared_block_count, 1);
+    view->pinned[view->pinned_count++] = block;
+}
+
+// appends 'length' bytes at 'data' of 'block', joining them to last extent when they follow it in block pool
+void add_extent(struct cvfs_view *view, int block, int previous_block, const char *data, long long length)
+{
+    struct cvfs_extent *last = (view->extent_count == 0) ? NULL : &(view->extents[view->extent_count - 1]);
+
+    if (last != NULL && block != 0 && block == previous_block + 1 && last->data + last->length == data)
+        last->length += length;
+    else
+    {
+        view->extents[view->extent_count].data = data;
+        view->extents[view->extent_count].length = length;
+        view->extent_count++;
+    }
+}
+
+// caller holds read lock of inode, returns -4 if memory allocation failed
+int map_blocks(struct cvfs_view *view, struct inode *inode_ptr, long long offset, long long end)
+{
+    long long block_index;
+    long long first_block = offset >> BLOCK_SHIFT;
+    long long last_block = (end - 1) >> BLOCK_SHIFT;
+    long long start;
+    long long stop;
+    int block;
+    int previous_block = 0;
+    int *slot;
+
+    view->extents = (struct cvfs_extent *)malloc((last_block - first_block + 1) * sizeof(struct cvfs_extent));
+    view->pinned = (int *)malloc((last_block - first_block + 1) * sizeof(int));
+    if (view->extents == NULL || view->pinned == NULL)
+        return -4;
+
+    for (block_index = first_block; block_index <= last_block; block_index++)
+    {
+        slot = get_block_slot(inode_ptr, block_index, 0);
+        block = (slot == NULL) ? 0 : *slot;
+        pin_block(view, block);
+
+        start = (block_index == first_block) ? offset & (BLOCK_SIZE - 1) : 0;
+        stop = (block_index == last_block) ? ((end - 1) & (BLOCK_SIZE - 1)) + 1 : BLOCK_SIZE;
+        add_extent(view, block, previous_block, block_address(block) + start, stop - start);
+        previous_block = block;
+    }
+    return 0;
+}
+
+// data of compressed file is decompressed into memory of view, returns -4 if memory allocation failed
+int copy_blocks(struct cvfs_view *view, struct inode *inode_ptr, long long offset, long long end)
+{
+    view->copy = (char *)malloc(end - offset);
+    view->extents = (struct cvfs_extent *)malloc(sizeof(struct cvfs_extent));
+    if (view->copy == NULL || view->extents == NULL)
+        return -4;
+
+    view->extents[0].data = view->copy;
+    view->extents[0].length = copy_from_file(inode_ptr, offset, view->copy, end - offset);
+    view->extent_count = 1;
+    return 0;
+}
+
+int cvfs_view_open(int fd, long long offset, long long length, struct cvfs_view *view)
+{
+    long long start = perf_start();
+    long long end;
+    int status = 0;
+    struct filetable *filetable_ptr;
+    struct inode *inode_ptr;
+
+    if (view == NULL || offset < 0 || length < 0)
+        return perf_end(PERF_READ, start, -2); // invalid arguments
+    memset(view, 0, sizeof(*view));
+    view->offset = offset;
+
+    if ((filetable_ptr = get_filetable(fd)) == NULL)
+        return perf_end(PERF_READ, start, -1); // file is not opened
+    if ((filetable_ptr->mode & READ) == 0)
+    {
+        put_filetable(filetable_ptr);
+        return perf_end(PERF_READ, start, -3); // don't have pemission to read
+    }
+
+    inode_ptr = filetable_ptr->ptr_inode;
+    pthread_rwlock_rdlock(&(inode_ptr->lock));
+    end = (length > inode_ptr->file_actual_size - offset) ? inode_ptr->file_actual_size : offset + length;
+    if (end > offset)
+    {
+        view->length = end - offset;
+        status = inode_ptr->compression ? copy_blocks(view, inode_ptr, offset, end) : map_blocks(view, inode_ptr, offset, end);
+    }
+    pthread_rwlock_unlock(&(inode_ptr->lock));
+    put_filetable(filetable_ptr);
+
+    if (status != 0)
+    {
+        cvfs_view_close(view);
+        return perf_end(PERF_READ, start, status);
+    }
+    perf_end(PERF_READ, start, view->length);
+    return 0;
+}
+
+void cvfs_view_close(struct cvfs_view *view)
+{
+    int counter;
+
+    if (view == NULL)
+        return;
+
+    journal_begin(); // a block removed from its file meanwhile is released now
+    for (counter = 0; counter < view->pinned_count; counter++)
+        put_block(view->pinned[counter]);
+    journal_end();
+
+    free(view->pinned);
+    free(view->extents);
+    free(view->copy);
+    memset(view, 0, sizeof(*view));
+}